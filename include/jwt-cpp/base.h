@@ -1,6 +1,25 @@
 #pragma once
 #include <string>
 #include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <iterator>
+
+#if !defined(JWT_DISABLE_BASE64_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JWT_BASE64_AVX2 1
+#define JWT_BASE64_SSSE3 1
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define JWT_BASE64_SSSE3 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define JWT_BASE64_NEON 1
+#endif
+#endif
 
 namespace jwt {
 	namespace alphabet {
@@ -32,102 +51,342 @@ namespace jwt {
 				return fill;
 			}
 		};
+		/**
+		 * base64url without any padding, as required for JWS segments (RFC 7515, section 2).
+		 * Encoding emits no fill and decoding accepts input of any valid length.
+		 */
+		struct base64url_unpadded {
+			static const std::array<char, 64>& data() {
+				return base64url::data();
+			}
+			static const std::string& fill() {
+				static std::string fill;
+				return fill;
+			}
+		};
 	}
 
 	class base {
 	public:
 		template<typename T>
 		static std::string encode(const std::string& bin) {
-			return encode(bin, T::data(), T::fill());
+			std::string res;
+			encode_into<T>(bin, res);
+			return res;
 		}
 		template<typename T>
 		static std::string decode(const std::string& base) {
-			return decode(base, T::data(), T::fill());
+			std::string res;
+			decode_into<T>(base, res);
+			return res;
+		}
+
+		/**
+		 * Get the exact length of the encoded form of size bytes, fill included
+		 * \param size Number of bytes to encode
+		 * \return Number of characters encode_into will write
+		 */
+		template<typename T>
+		static size_t encoded_size(size_t size) {
+			const size_t mod = size % 3;
+			return size / 3 * 4 + (mod == 0 ? 0 : (mod + 1) + (3 - mod) * T::fill().size());
+		}
+		/**
+		 * Get an upper bound for the decoded length of size characters
+		 * \param size Number of characters to decode
+		 * \return Buffer size that is always large enough for decode_into
+		 */
+		static size_t max_decoded_size(size_t size) {
+			return size / 4 * 3 + 2;
+		}
+
+		/**
+		 * Encode into a caller provided buffer
+		 * \param bin Data to encode
+		 * \param size Length of data
+		 * \param out Output buffer, must hold at least encoded_size<T>(size) characters
+		 * \return Number of characters written
+		 */
+		template<typename T>
+		static size_t encode_into(const char* bin, size_t size, char* out) {
+			return encode(reinterpret_cast<const unsigned char*>(bin), size, out, lookup<T>(), T::fill());
+		}
+		/**
+		 * Encode into out, replacing its contents but reusing its capacity
+		 * \param bin Data to encode
+		 * \param out String receiving the encoded data
+		 */
+		template<typename T>
+		static void encode_into(const std::string& bin, std::string& out) {
+			out.resize(encoded_size<T>(bin.size()));
+			encode_into<T>(bin.data(), bin.size(), &out[0]);
+		}
+		/**
+		 * Decode into a caller provided buffer
+		 * \param base Data to decode
+		 * \param size Length of data
+		 * \param out Output buffer, must hold at least max_decoded_size(size) bytes
+		 * \return Number of bytes written
+		 * \throws std::runtime_error Input is not valid
+		 */
+		template<typename T>
+		static size_t decode_into(const char* base, size_t size, char* out) {
+			size_t written;
+			if (!decode(base, size, out, lookup<T>(), T::fill(), written))
+				throw std::runtime_error("Invalid input");
+			return written;
+		}
+		/**
+		 * Decode into a caller provided buffer without throwing
+		 * \param base Data to decode
+		 * \param size Length of data
+		 * \param out Output buffer, must hold at least max_decoded_size(size) bytes
+		 * \param written Receives the number of bytes written
+		 * \return false if the input is not valid, out holds garbage then
+		 */
+		template<typename T>
+		static bool try_decode_into(const char* base, size_t size, char* out, size_t& written) noexcept {
+			return decode(base, size, out, lookup<T>(), T::fill(), written);
+		}
+		/**
+		 * Decode into out, replacing its contents but reusing its capacity
+		 * \param base Data to decode
+		 * \param out String receiving the decoded data
+		 * \throws std::runtime_error Input is not valid
+		 */
+		template<typename T>
+		static void decode_into(const std::string& base, std::string& out) {
+			if (!try_decode_into<T>(base, out))
+				throw std::runtime_error("Invalid input");
+		}
+		/**
+		 * Decode into out, replacing its contents but reusing its capacity
+		 * \param base Data to decode
+		 * \param out String receiving the decoded data
+		 * \return false if the input is not valid, out is cleared then
+		 */
+		template<typename T>
+		static bool try_decode_into(const std::string& base, std::string& out) {
+			out.resize(max_decoded_size(base.size()));
+			size_t written = 0;
+			const bool ok = try_decode_into<T>(base.data(), base.size(), &out[0], written);
+			out.resize(ok ? written : 0);
+			return ok;
 		}
 
+		/**
+		 * Encode and append to out, keeping its current contents
+		 * \param bin Data to encode
+		 * \param size Length of data
+		 * \param out String receiving the encoded data
+		 */
+		template<typename T>
+		static void append_encoded(const char* bin, size_t size, std::string& out) {
+			const size_t offset = out.size();
+			out.resize(offset + encoded_size<T>(size));
+			encode_into<T>(bin, size, &out[offset]);
+		}
+
+		/**
+		 * Incremental encoder appending to a string.
+		 * Input is collected in blocks that are encoded as a whole, so data produced piece by piece does not
+		 * need to be stored in full before encoding. Fill is only written by finish.
+		 */
+		template<typename T>
+		class encoder {
+		public:
+			/// Output iterator feeding characters into the encoder
+			class iterator {
+				encoder* enc;
+			public:
+				typedef std::output_iterator_tag iterator_category;
+				typedef void value_type;
+				typedef void difference_type;
+				typedef void pointer;
+				typedef void reference;
+
+				explicit iterator(encoder& e) : enc(&e) {}
+				iterator& operator=(char c) { enc->put(c); return *this; }
+				iterator& operator*() { return *this; }
+				iterator& operator++() { return *this; }
+				iterator& operator++(int) { return *this; }
+
+				/// Found by picojson's unqualified copy calls, which otherwise rely on std being associated
+				friend iterator copy(const char* first, const char* last, iterator it) {
+					it.enc->write(first, last - first);
+					return it;
+				}
+			};
+
+			/**
+			 * Start encoding
+			 * \param out String the encoded data is appended to
+			 */
+			explicit encoder(std::string& out) : out(out), pending(0) {}
+			encoder(const encoder&) = delete;
+			encoder& operator=(const encoder&) = delete;
+
+			void put(char c) {
+				block[pending++] = c;
+				if (pending == sizeof(block))
+					flush();
+			}
+			void write(const char* data, size_t size) {
+				while (size > 0) {
+					const size_t n = std::min(size, sizeof(block) - pending);
+					memcpy(block + pending, data, n);
+					pending += n;
+					data += n;
+					size -= n;
+					if (pending == sizeof(block))
+						flush();
+				}
+			}
+			iterator begin() { return iterator(*this); }
+
+			/// Encode the remaining input, call once after all data was written
+			void finish() {
+				flush();
+			}
+		private:
+			void flush() {
+				append_encoded<T>(block, pending, out);
+				pending = 0;
+			}
+
+			std::string& out;
+			/// Multiple of 3 so full blocks never need fill
+			char block[768];
+			size_t pending;
+		};
+
 	private:
-		static std::string encode(const std::string& bin, const std::array<char, 64>& alphabet, const std::string& fill) {
-			size_t size = bin.size();
-			std::string res;
+		/// Forward and reverse lookup tables for an alphabet
+		struct table {
+			std::array<char, 64> alphabet;
+			/// Sextet for every possible input byte, -1 if not part of the alphabet
+			std::array<int8_t, 256> sextet;
+			/// The first 62 characters are A-Z, a-z, 0-9 so the vector code paths apply
+			bool simd;
+		};
+
+		template<typename T>
+		static const table& lookup() {
+			static const table t = make_table(T::data());
+			return t;
+		}
+
+		static table make_table(const std::array<char, 64>& alphabet) {
+			static const char standard[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+			table t;
+			t.alphabet = alphabet;
+			t.sextet.fill(-1);
+			for (size_t i = 0; i < alphabet.size(); i++)
+				t.sextet[(unsigned char)alphabet[i]] = (int8_t)i;
+			t.simd = std::memcmp(alphabet.data(), standard, 62) == 0
+				&& (unsigned char)alphabet[62] < 0x80
+				&& (unsigned char)alphabet[63] < 0x80;
+			for (size_t i = 0; i < alphabet.size(); i++)
+				if (t.sextet[(unsigned char)alphabet[i]] != (int8_t)i)
+					t.simd = false;
+			return t;
+		}
+
+		static size_t encode(const unsigned char* bin, size_t size, char* out, const table& t, const std::string& fill) {
+			const std::array<char, 64>& alphabet = t.alphabet;
+			char* res = out;
+			size_t i = 0;
+
+#if defined(JWT_BASE64_AVX2) || defined(JWT_BASE64_SSSE3) || defined(JWT_BASE64_NEON)
+			if (t.simd)
+				encode_simd(bin, size, i, res, alphabet[62], alphabet[63]);
+#endif
 
 			// clear incomplete bytes
 			size_t fast_size = size - size % 3;
-			for (size_t i = 0; i < fast_size;) {
-				uint32_t octet_a = (unsigned char)bin[i++];
-				uint32_t octet_b = (unsigned char)bin[i++];
-				uint32_t octet_c = (unsigned char)bin[i++];
+			for (; i < fast_size;) {
+				uint32_t octet_a = bin[i++];
+				uint32_t octet_b = bin[i++];
+				uint32_t octet_c = bin[i++];
 
 				uint32_t triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
 
-				res += alphabet[(triple >> 3 * 6) & 0x3F];
-				res += alphabet[(triple >> 2 * 6) & 0x3F];
-				res += alphabet[(triple >> 1 * 6) & 0x3F];
-				res += alphabet[(triple >> 0 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 3 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 2 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 1 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 0 * 6) & 0x3F];
 			}
 
 			if (fast_size == size)
-				return res;
+				return res - out;
 
 			size_t mod = size % 3;
 
-			uint32_t octet_a = fast_size < size ? (unsigned char)bin[fast_size++] : 0;
-			uint32_t octet_b = fast_size < size ? (unsigned char)bin[fast_size++] : 0;
-			uint32_t octet_c = fast_size < size ? (unsigned char)bin[fast_size++] : 0;
+			uint32_t octet_a = fast_size < size ? bin[fast_size++] : 0;
+			uint32_t octet_b = fast_size < size ? bin[fast_size++] : 0;
 
-			uint32_t triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
+			uint32_t triple = (octet_a << 0x10) + (octet_b << 0x08);
 
 			switch (mod) {
 			case 1:
-				res += alphabet[(triple >> 3 * 6) & 0x3F];
-				res += alphabet[(triple >> 2 * 6) & 0x3F];
-				res += fill;
-				res += fill;
+				*res++ = alphabet[(triple >> 3 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 2 * 6) & 0x3F];
+				res = std::copy(fill.begin(), fill.end(), res);
+				res = std::copy(fill.begin(), fill.end(), res);
 				break;
 			case 2:
-				res += alphabet[(triple >> 3 * 6) & 0x3F];
-				res += alphabet[(triple >> 2 * 6) & 0x3F];
-				res += alphabet[(triple >> 1 * 6) & 0x3F];
-				res += fill;
+				*res++ = alphabet[(triple >> 3 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 2 * 6) & 0x3F];
+				*res++ = alphabet[(triple >> 1 * 6) & 0x3F];
+				res = std::copy(fill.begin(), fill.end(), res);
 				break;
 			default:
 				break;
 			}
 
-			return res;
+			return res - out;
 		}
 
-		static std::string decode(const std::string& base, const std::array<char, 64>& alphabet, const std::string& fill) {
-			size_t size = base.size();
-
+		static bool decode(const char* base, size_t size, char* out, const table& t, const std::string& fill, size_t& written) noexcept {
 			size_t fill_cnt = 0;
-			while (size > fill.size()) {
-				if (base.substr(size - fill.size(), fill.size()) == fill) {
+			if (fill.empty()) {
+				// Unpadded input, the length alone tells how many characters are missing
+				fill_cnt = (4 - size % 4) % 4;
+				if (fill_cnt > 2)
+					return false;
+			}
+			else while (size > fill.size()) {
+				if (std::memcmp(base + size - fill.size(), fill.data(), fill.size()) == 0) {
 					fill_cnt++;
 					size -= fill.size();
 					if(fill_cnt > 2)
-						throw std::runtime_error("Invalid input");
+						return false;
 				}
 				else break;
 			}
 
 			if ((size + fill_cnt) % 4 != 0)
-				throw std::runtime_error("Invalid input");
+				return false;
 
-			size_t out_size = size / 4 * 3;
-			std::string res;
-			res.reserve(out_size);
+			const unsigned char* in = reinterpret_cast<const unsigned char*>(base);
+			char* res = out;
+			size_t i = 0;
 
-			auto get_sextet = [&](size_t offset) {
-				for (size_t i = 0; i < alphabet.size(); i++) {
-					if (alphabet[i] == base[offset])
-						return i;
-				}
-				throw std::runtime_error("Invalid input");
+#if defined(JWT_BASE64_AVX2) || defined(JWT_BASE64_SSSE3) || defined(JWT_BASE64_NEON)
+			if (t.simd)
+				decode_simd(in, size, i, res, t.alphabet[62], t.alphabet[63]);
+#endif
+
+			// Invalid characters map to negative values, checked once after decoding
+			int8_t invalid = 0;
+			auto get_sextet = [&](size_t offset) -> uint32_t {
+				const int8_t s = t.sextet[in[offset]];
+				invalid |= s;
+				return (uint32_t)(s & 0x3F);
 			};
 
-			
 			size_t fast_size = size - size % 4;
-			for (size_t i = 0; i < fast_size;) {
+			for (; i < fast_size;) {
 				uint32_t sextet_a = get_sextet(i++);
 				uint32_t sextet_b = get_sextet(i++);
 				uint32_t sextet_c = get_sextet(i++);
@@ -138,13 +397,15 @@ namespace jwt {
 					+ (sextet_c << 1 * 6)
 					+ (sextet_d << 0 * 6);
 
-				res += (triple >> 2 * 8) & 0xFF;
-				res += (triple >> 1 * 8) & 0xFF;
-				res += (triple >> 0 * 8) & 0xFF;
+				*res++ = (triple >> 2 * 8) & 0xFF;
+				*res++ = (triple >> 1 * 8) & 0xFF;
+				*res++ = (triple >> 0 * 8) & 0xFF;
 			}
 
-			if (fill_cnt == 0)
-				return res;
+			if (fill_cnt == 0) {
+				written = res - out;
+				return invalid >= 0;
+			}
 
 			uint32_t triple = (get_sextet(fast_size) << 3 * 6)
 				+ (get_sextet(fast_size + 1) << 2 * 6);
@@ -152,17 +413,215 @@ namespace jwt {
 			switch (fill_cnt) {
 			case 1:
 				triple |= (get_sextet(fast_size + 2) << 1 * 6);
-				res += (triple >> 2 * 8) & 0xFF;
-				res += (triple >> 1 * 8) & 0xFF;
+				*res++ = (triple >> 2 * 8) & 0xFF;
+				*res++ = (triple >> 1 * 8) & 0xFF;
 				break;
 			case 2:
-				res += (triple >> 2 * 8) & 0xFF;
+				*res++ = (triple >> 2 * 8) & 0xFF;
 				break;
 			default:
 				break;
 			}
 
-			return res;
+			written = res - out;
+			return invalid >= 0;
+		}
+
+		// Vector code paths. They handle whole blocks only, advance pos/out past what they consumed
+		// and leave the tail (or a block containing an invalid character) to the scalar loops above.
+#if defined(JWT_BASE64_SSSE3)
+		static inline __m128i sextets_to_ascii(__m128i idx, char c62, char c63) {
+			__m128i off = _mm_set1_epi8('A');
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(25)), _mm_set1_epi8('a' - 26 - 'A')));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(51)), _mm_set1_epi8('0' - 52 - ('a' - 26))));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(62)), _mm_set1_epi8((char)(c62 - 62 - ('0' - 52)))));
+			off = _mm_add_epi8(off, _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(63)), _mm_set1_epi8((char)(c63 - 63 - ('0' - 52)))));
+			return _mm_add_epi8(idx, off);
+		}
+
+		/// Split 12 bytes (in the low 12 bytes of in) into 16 sextets
+		static inline __m128i split_sextets(__m128i in) {
+			in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+			const __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+			const __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+			return _mm_or_si128(t0, t1);
+		}
+
+		/// Map 16 characters to sextets, returns false if any of them is not part of the alphabet
+		static inline bool ascii_to_sextets(__m128i in, char c62, char c63, __m128i& out) {
+			const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+			const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+			const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+			const __m128i is62 = _mm_cmpeq_epi8(in, _mm_set1_epi8(c62));
+			const __m128i is63 = _mm_cmpeq_epi8(in, _mm_set1_epi8(c63));
+			const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(is62, is63)));
+			if (_mm_movemask_epi8(valid) != 0xFFFF)
+				return false;
+			__m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+			shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+			shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+			shift = _mm_or_si128(shift, _mm_and_si128(is62, _mm_set1_epi8((char)(62 - c62))));
+			shift = _mm_or_si128(shift, _mm_and_si128(is63, _mm_set1_epi8((char)(63 - c63))));
+			out = _mm_add_epi8(in, shift);
+			return true;
+		}
+
+		/// Pack 16 sextets into 12 bytes (in the low 12 bytes of the result)
+		static inline __m128i pack_sextets(__m128i values) {
+			const __m128i ab = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+			const __m128i abcd = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+			return _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		}
+#endif
+#if defined(JWT_BASE64_AVX2)
+		static inline __m256i sextets_to_ascii(__m256i idx, char c62, char c63) {
+			__m256i off = _mm256_set1_epi8('A');
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpgt_epi8(idx, _mm256_set1_epi8(25)), _mm256_set1_epi8('a' - 26 - 'A')));
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpgt_epi8(idx, _mm256_set1_epi8(51)), _mm256_set1_epi8('0' - 52 - ('a' - 26))));
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpeq_epi8(idx, _mm256_set1_epi8(62)), _mm256_set1_epi8((char)(c62 - 62 - ('0' - 52)))));
+			off = _mm256_add_epi8(off, _mm256_and_si256(_mm256_cmpeq_epi8(idx, _mm256_set1_epi8(63)), _mm256_set1_epi8((char)(c63 - 63 - ('0' - 52)))));
+			return _mm256_add_epi8(idx, off);
+		}
+
+		static inline __m256i split_sextets(__m256i in) {
+			in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+				10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+			const __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+			const __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+			return _mm256_or_si256(t0, t1);
+		}
+
+		static inline __m256i in_range(__m256i in, char lo, char hi) {
+			return _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), in));
+		}
+
+		static inline bool ascii_to_sextets(__m256i in, char c62, char c63, __m256i& out) {
+			const __m256i upper = in_range(in, 'A', 'Z');
+			const __m256i lower = in_range(in, 'a', 'z');
+			const __m256i digit = in_range(in, '0', '9');
+			const __m256i is62 = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(c62));
+			const __m256i is63 = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(c63));
+			const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(is62, is63)));
+			if (_mm256_movemask_epi8(valid) != -1)
+				return false;
+			__m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+			shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+			shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+			shift = _mm256_or_si256(shift, _mm256_and_si256(is62, _mm256_set1_epi8((char)(62 - c62))));
+			shift = _mm256_or_si256(shift, _mm256_and_si256(is63, _mm256_set1_epi8((char)(63 - c63))));
+			out = _mm256_add_epi8(in, shift);
+			return true;
+		}
+
+		/// Pack 32 sextets into 24 bytes (in the low 24 bytes of the result)
+		static inline __m256i pack_sextets(__m256i values) {
+			const __m256i ab = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+			const __m256i abcd = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+			const __m256i packed = _mm256_shuffle_epi8(abcd, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+			return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		}
+#endif
+#if defined(JWT_BASE64_NEON)
+		static inline uint8x16_t sextets_to_ascii(uint8x16_t idx, char c62, char c63) {
+			uint8x16_t off = vdupq_n_u8('A');
+			off = vaddq_u8(off, vandq_u8(vcgtq_u8(idx, vdupq_n_u8(25)), vdupq_n_u8('a' - 26 - 'A')));
+			off = vaddq_u8(off, vandq_u8(vcgtq_u8(idx, vdupq_n_u8(51)), vdupq_n_u8((uint8_t)('0' - 52 - ('a' - 26)))));
+			off = vaddq_u8(off, vandq_u8(vceqq_u8(idx, vdupq_n_u8(62)), vdupq_n_u8((uint8_t)(c62 - 62 - ('0' - 52)))));
+			off = vaddq_u8(off, vandq_u8(vceqq_u8(idx, vdupq_n_u8(63)), vdupq_n_u8((uint8_t)(c63 - 63 - ('0' - 52)))));
+			return vaddq_u8(idx, off);
+		}
+
+		static inline uint8x16_t in_range(uint8x16_t in, char lo, char hi) {
+			return vandq_u8(vcgeq_u8(in, vdupq_n_u8(lo)), vcleq_u8(in, vdupq_n_u8(hi)));
+		}
+
+		static inline bool ascii_to_sextets(uint8x16_t in, char c62, char c63, uint8x16_t& out) {
+			const uint8x16_t upper = in_range(in, 'A', 'Z');
+			const uint8x16_t lower = in_range(in, 'a', 'z');
+			const uint8x16_t digit = in_range(in, '0', '9');
+			const uint8x16_t is62 = vceqq_u8(in, vdupq_n_u8(c62));
+			const uint8x16_t is63 = vceqq_u8(in, vdupq_n_u8(c63));
+			const uint8x16_t valid = vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(is62, is63)));
+			if (vminvq_u8(valid) != 0xFF)
+				return false;
+			uint8x16_t shift = vandq_u8(upper, vdupq_n_u8((uint8_t)-'A'));
+			shift = vorrq_u8(shift, vandq_u8(lower, vdupq_n_u8((uint8_t)(26 - 'a'))));
+			shift = vorrq_u8(shift, vandq_u8(digit, vdupq_n_u8((uint8_t)(52 - '0'))));
+			shift = vorrq_u8(shift, vandq_u8(is62, vdupq_n_u8((uint8_t)(62 - c62))));
+			shift = vorrq_u8(shift, vandq_u8(is63, vdupq_n_u8((uint8_t)(63 - c63))));
+			out = vaddq_u8(in, shift);
+			return true;
+		}
+#endif
+
+#if defined(JWT_BASE64_AVX2) || defined(JWT_BASE64_SSSE3) || defined(JWT_BASE64_NEON)
+		static void encode_simd(const unsigned char* bin, size_t size, size_t& pos, char*& out, char c62, char c63) {
+#if defined(JWT_BASE64_AVX2)
+			// Two overlapping 16 byte loads put 12 source bytes into each 128 bit lane
+			for (; size - pos >= 28; pos += 24, out += 32) {
+				const __m256i in = _mm256_inserti128_si256(
+					_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bin + pos))),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(bin + pos + 12)), 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), sextets_to_ascii(split_sextets(in), c62, c63));
+			}
+#endif
+#if defined(JWT_BASE64_SSSE3)
+			for (; size - pos >= 16; pos += 12, out += 16) {
+				const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bin + pos));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out), sextets_to_ascii(split_sextets(in), c62, c63));
+			}
+#endif
+#if defined(JWT_BASE64_NEON)
+			for (; size - pos >= 48; pos += 48, out += 64) {
+				const uint8x16x3_t in = vld3q_u8(bin + pos);
+				const uint8x16_t mask = vdupq_n_u8(0x3F);
+				uint8x16x4_t res;
+				res.val[0] = sextets_to_ascii(vshrq_n_u8(in.val[0], 2), c62, c63);
+				res.val[1] = sextets_to_ascii(vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask), c62, c63);
+				res.val[2] = sextets_to_ascii(vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask), c62, c63);
+				res.val[3] = sextets_to_ascii(vandq_u8(in.val[2], mask), c62, c63);
+				vst4q_u8(reinterpret_cast<uint8_t*>(out), res);
+			}
+#endif
+		}
+
+		static void decode_simd(const unsigned char* in, size_t size, size_t& pos, char*& out, char c62, char c63) {
+			// The store width exceeds the useful output, the loop bounds make sure it stays inside
+			// the max_decoded_size() buffer.
+#if defined(JWT_BASE64_AVX2)
+			for (; size - pos >= 48; pos += 32, out += 24) {
+				__m256i values;
+				if (!ascii_to_sextets(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + pos)), c62, c63, values))
+					return;
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), pack_sextets(values));
+			}
+#endif
+#if defined(JWT_BASE64_SSSE3)
+			for (; size - pos >= 24; pos += 16, out += 12) {
+				__m128i values;
+				if (!ascii_to_sextets(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos)), c62, c63, values))
+					return;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out), pack_sextets(values));
+			}
+#endif
+#if defined(JWT_BASE64_NEON)
+			for (; size - pos >= 64; pos += 64, out += 48) {
+				const uint8x16x4_t chars = vld4q_u8(in + pos);
+				uint8x16x4_t v;
+				if (!ascii_to_sextets(chars.val[0], c62, c63, v.val[0])
+					|| !ascii_to_sextets(chars.val[1], c62, c63, v.val[1])
+					|| !ascii_to_sextets(chars.val[2], c62, c63, v.val[2])
+					|| !ascii_to_sextets(chars.val[3], c62, c63, v.val[3]))
+					return;
+				uint8x16x3_t res;
+				res.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+				res.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+				res.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+				vst3q_u8(reinterpret_cast<uint8_t*>(out), res);
+			}
+#endif
 		}
+#endif
 	};
 }
@@ -3,48 +3,133 @@
 #include "picojson.h"
 #include "base.h"
 #include <set>
+#include <map>
 #include <chrono>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <system_error>
 
+#include <mbedtls/version.h>
 #include <mbedtls/ecdsa.h>
+#include <mbedtls/rsa.h>
+#include <mbedtls/pk.h>
 #include <mbedtls/md.h>
 #include <mbedtls/sha256.h>
+#include <mbedtls/sha512.h>
 #include <mbedtls/x509.h>
 #include <mbedtls/pem.h>
 #include <mbedtls/hmac_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/platform_util.h>
 
 #ifndef JWT_CLAIM_EXPLICIT
 #define JWT_CLAIM_EXPLICIT 0
 #endif
 
-namespace jwt {
-	using date = std::chrono::system_clock::time_point;
+#ifndef JWT_HAS_STRING_VIEW
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define JWT_HAS_STRING_VIEW 1
+#else
+#define JWT_HAS_STRING_VIEW 0
+#endif
+#endif
 
-	static int myrand(void *rng_state, unsigned char *output, size_t len)
-	{
-		size_t use_len;
-		int rnd;
+#if JWT_HAS_STRING_VIEW
+#include <string_view>
+#endif
 
-		if (rng_state != NULL)
-			rng_state = NULL;
+#ifndef JWT_HAS_MEMORY_RESOURCE
+#if JWT_HAS_STRING_VIEW && defined(__has_include)
+#if __has_include(<memory_resource>)
+#define JWT_HAS_MEMORY_RESOURCE 1
+#endif
+#endif
+#endif
+#ifndef JWT_HAS_MEMORY_RESOURCE
+#define JWT_HAS_MEMORY_RESOURCE 0
+#endif
 
-		while (len > 0)
-		{
-			use_len = len;
-			if (use_len > sizeof(int))
-				use_len = sizeof(int);
+#if JWT_HAS_MEMORY_RESOURCE
+#include <memory_resource>
+#endif
 
-			rnd = rand();
-			memcpy(output, &rnd, use_len);
-			output += use_len;
-			len -= use_len;
-		}
+#ifndef JWT_HAS_COROUTINE
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define JWT_HAS_COROUTINE 1
+#endif
+#endif
+#endif
+#ifndef JWT_HAS_COROUTINE
+#define JWT_HAS_COROUTINE 0
+#endif
 
-		return(0);
-	}
+#if JWT_HAS_COROUTINE
+#include <coroutine>
+#endif
+
+#if !defined(JWT_DISABLE_SHA256_SIMD)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define JWT_SHA256_X86 1
+#define JWT_SHA256_TARGET(features)
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define JWT_SHA256_X86 1
+#define JWT_SHA256_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace jwt {
+	/**
+	 * Reasons decoding or verifying a token fails, reported to observers and as std::error_code
+	 */
+	enum class failure {
+		malformed_token = 1,
+		invalid_base64,
+		invalid_json,
+		unknown_key_id,
+		wrong_algorithm,
+		invalid_signature,
+		expired,
+		not_yet_valid,
+		audience_mismatch,
+		missing_claim,
+		claim_type_mismatch,
+		claim_mismatch,
+		unsupported_claim,
+		token_too_large,
+		token_revoked,
+		token_replayed
+	};
+}
+
+namespace std {
+	template<>
+	struct is_error_code_enum<jwt::failure> : true_type {};
+}
 
-	static std::string generate_hash(const std::string& data, mbedtls_md_type_t md_type) {
+namespace jwt {
+	using date = std::chrono::system_clock::time_point;
+
+	inline std::string generate_hash(const std::string& data, mbedtls_md_type_t md_type) {
 		mbedtls_md_context_t ctx;
 		std::string res;
 		res.resize(mbedtls_md_get_size(mbedtls_md_info_from_type(md_type)));
@@ -95,6 +180,14 @@ namespace jwt {
 			: std::runtime_error(msg)
 		{}
 	};
+	struct eddsa_exception : public std::runtime_error {
+		explicit eddsa_exception(const std::string& msg)
+			: std::runtime_error(msg)
+		{}
+		explicit eddsa_exception(const char* msg)
+			: std::runtime_error(msg)
+		{}
+	};
 	struct token_verification_exception : public std::runtime_error {
 		token_verification_exception()
 			: std::runtime_error("token verification failed")
@@ -104,27 +197,77 @@ namespace jwt {
 		{}
 	};
 
+	/**
+	 * Error category of jwt::failure
+	 */
+	class failure_category : public std::error_category {
+	public:
+		const char* name() const noexcept override { return "jwt"; }
+		std::string message(int ev) const override {
+			switch (static_cast<failure>(ev)) {
+			case failure::malformed_token: return "invalid token supplied";
+			case failure::invalid_base64: return "invalid base64";
+			case failure::invalid_json: return "invalid json";
+			case failure::unknown_key_id: return "unknown key id";
+			case failure::wrong_algorithm: return "wrong algorithm";
+			case failure::invalid_signature: return "signature verification failed";
+			case failure::expired: return "token expired";
+			case failure::not_yet_valid: return "token not yet valid";
+			case failure::audience_mismatch: return "token doesn't contain the required audience";
+			case failure::missing_claim: return "required claim missing";
+			case failure::claim_type_mismatch: return "claim type mismatch";
+			case failure::claim_mismatch: return "claim does not match expected";
+			case failure::unsupported_claim: return "unsupported claim check";
+			case failure::token_too_large: return "token too large";
+			case failure::token_revoked: return "token revoked";
+			case failure::token_replayed: return "token already used";
+			default: return "unknown error";
+			}
+		}
+		static const failure_category& get() noexcept {
+			static const failure_category instance;
+			return instance;
+		}
+	};
+
+	inline std::error_code make_error_code(failure e) noexcept {
+		return std::error_code(static_cast<int>(e), failure_category::get());
+	}
+
 	class random {
 	private:
+		/// Seeds hmac_drbg and its reseeds, so it has to live as long
+		mbedtls_entropy_context entropy;
 		mbedtls_hmac_drbg_context hmac_drbg;
 
-		random(random &o) {}
-		random(const random &o) {}
+		random(random &) {}
+		random(const random &) {}
 	public:
+		/**
+		 * Create a generator seeded from the entropy sources of mbedtls
+		 * \throws std::runtime_error No entropy source could be polled
+		 */
 		random() {
-			std::string sig;
-			int ret_write_sign;
-			mbedtls_mpi r;
-			mbedtls_mpi s;
-			mbedtls_mpi_init(&r);
-			mbedtls_mpi_init(&s);
+			mbedtls_entropy_init(&entropy);
 			mbedtls_hmac_drbg_init(&hmac_drbg);
-			mbedtls_hmac_drbg_seed(&hmac_drbg, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), myrand, NULL, NULL, 0);
+			// Generators of different threads start apart even if the entropy sources repeat themselves
+			unsigned char personalization[sizeof("jwt-cpp random") + sizeof(std::thread::id) + sizeof(int64_t)];
+			std::memcpy(personalization, "jwt-cpp random", sizeof("jwt-cpp random"));
+			const std::thread::id thread = std::this_thread::get_id();
+			std::memcpy(personalization + sizeof("jwt-cpp random"), &thread, sizeof(thread));
+			const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+			std::memcpy(personalization + sizeof("jwt-cpp random") + sizeof(thread), &now, sizeof(now));
+			if (mbedtls_hmac_drbg_seed(&hmac_drbg, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), mbedtls_entropy_func, &entropy, personalization, sizeof(personalization)) != 0) {
+				mbedtls_hmac_drbg_free(&hmac_drbg);
+				mbedtls_entropy_free(&entropy);
+				throw std::runtime_error("failed to seed random generator");
+			}
 		}
 
 		virtual ~random()
 		{
 			mbedtls_hmac_drbg_free(&hmac_drbg);
+			mbedtls_entropy_free(&entropy);
 		}
 
 		void *random_context() {
@@ -134,365 +277,1447 @@ namespace jwt {
 		static int static_random(void *p, unsigned char *b, size_t s) {
 			return mbedtls_hmac_drbg_random(p, b, s);
 		}
+
+		/// Generator owned by the calling thread, used for blinding
+		static random& thread_instance() {
+			thread_local random rnd;
+			return rnd;
+		}
 	};
 
-	namespace algorithm {
+	/**
+	 * Process wide cache of parsed keys.
+	 * Algorithms constructed from the same key material and parameters share one parsed,
+	 * immutable key object, so a key used by many algorithm instances and verifiers is parsed once.
+	 * Entries only hold weak references and disappear with the last algorithm using them.
+	 */
+	class key_cache {
+	public:
+		typedef std::array<unsigned char, 32> key_type;
+
 		/**
-		 * "none" algorithm.
-		 * 
-		 * Returns and empty signature and checks if the given signature is empty.
+		 * Builds the id of a parsed key from everything that went into parsing it
 		 */
-		struct none {
-			/// Return an empty string
-			std::string sign(const std::string&) const {
-				return "";
+		class id_builder {
+			mbedtls_sha256_context ctx;
+			bool ok;
+		public:
+			id_builder() {
+				mbedtls_sha256_init(&ctx);
+				ok = mbedtls_sha256_starts_ret(&ctx, 0) == 0;
 			}
-			/// Check if the given signature is empty. JWT's with "none" algorithm should not contain a signature.
-			void verify(const std::string&, const std::string& signature) const {
-				if (!signature.empty())
-					throw signature_verification_exception();
+			~id_builder() {
+				mbedtls_sha256_free(&ctx);
 			}
-			/// Get algorithm name
-			std::string name() const {
-				return "none";
+			id_builder(const id_builder&) = delete;
+			id_builder& operator=(const id_builder&) = delete;
+
+			/// Add a part, prefixed by its length so parts cannot run into each other
+			id_builder& add(const std::string& part) {
+				unsigned char len[8];
+				for (size_t i = 0; i < sizeof(len); i++)
+					len[i] = (unsigned char)((uint64_t)part.size() >> (8 * i));
+				ok = ok && mbedtls_sha256_update_ret(&ctx, len, sizeof(len)) == 0
+					&& mbedtls_sha256_update_ret(&ctx, (const unsigned char*)part.data(), part.size()) == 0;
+				return *this;
+			}
+			id_builder& add(int part) {
+				return add(std::to_string(part));
 			}
-		};
-		/**
-		 * Base class for HMAC family of algorithms
-		 */
-		struct hmacsha {
-			/**
-			 * Construct new hmac algorithm
-			 * \param key Key to use for HMAC
-			 * \param md Pointer to hash function
-			 * \param name Name of the algorithm
-			 */
-			hmacsha(std::string key, const mbedtls_md_type_t md_type, const std::string& name)
-				: secret(std::move(key)), md_type(md_type), alg_name(name)
-			{}
 			/**
-			 * Sign jwt data
-			 * \param data The data to sign
-			 * \return HMAC signature for the given data
-			 * \throws signature_generation_exception
+			 * \throws std::runtime_error Hashing failed
 			 */
-			std::string sign(const std::string& data) const {
-				mbedtls_md_context_t ctx;
-				std::string res;
-				res.resize(mbedtls_md_get_size(mbedtls_md_info_from_type(md_type)));
-				mbedtls_md_init(&ctx);
-				mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(md_type), 1); //use hmac
-				mbedtls_md_hmac_starts(&ctx, (const unsigned char*)secret.c_str(), secret.length());
-				mbedtls_md_hmac_update(&ctx, (const unsigned char *)data.data(), data.size());
-				mbedtls_md_hmac_finish(&ctx, (unsigned char*)res.data());
-				mbedtls_md_free(&ctx);
+			key_type finish() {
+				key_type res;
+				if (!ok || mbedtls_sha256_finish_ret(&ctx, res.data()) != 0)
+					throw std::runtime_error("failed to hash key");
 				return res;
 			}
-			/**
-			 * Check if signature is valid
-			 * \param data The data to check signature against
-			 * \param signature Signature provided by the jwt
-			 * \throws signature_verification_exception If the provided signature does not match
-			 */
-			void verify(const std::string& data, const std::string& signature) const {
-				try {
-					auto res = sign(data);
-					bool matched = true;
-					for (size_t i = 0; i < std::min<size_t>(res.size(), signature.size()); i++)
-						if (res[i] != signature[i])
-							matched = false;
-					if (res.size() != signature.size())
-						matched = false;
-					if (!matched)
-						throw signature_verification_exception();
-				}
-				catch (const signature_generation_exception&) {
-					throw signature_verification_exception();
+		};
+
+		/// The cache used by all algorithms
+		static key_cache& instance() {
+			static key_cache cache;
+			return cache;
+		}
+
+		/**
+		 * Get a parsed key, parsing it if it is not in use yet.
+		 * Parsing happens outside the lock, so threads loading different keys do not wait for each other.
+		 * \param id Id built with id_builder, must include the type of the key object
+		 * \param make Returns a new std::shared_ptr<T>, only called on a miss
+		 */
+		template<typename T, typename Make>
+		std::shared_ptr<T> get(const key_type& id, Make make) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto it = entries.find(id);
+				if (it != entries.end()) {
+					std::shared_ptr<void> res = it->second.lock();
+					if (res)
+						return std::static_pointer_cast<T>(res);
 				}
 			}
-			/**
-			 * Returns the algorithm name provided to the constructor
-			 * \return Algorithmname
-			 */
-			std::string name() const {
-				return alg_name;
+			std::shared_ptr<T> res = make();
+			std::lock_guard<std::mutex> lock(mutex);
+			std::weak_ptr<void>& entry = entries[id];
+			// Another thread may have parsed the same key meanwhile, keep the first one
+			std::shared_ptr<void> existing = entry.lock();
+			if (existing)
+				return std::static_pointer_cast<T>(existing);
+			entry = res;
+			if (entries.size() >= prune_at)
+				prune();
+			return res;
+		}
+
+		/// Number of parsed keys still in use
+		size_t size() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t res = 0;
+			for (auto& e : entries) {
+				if (!e.second.expired())
+					res++;
+			}
+			return res;
+		}
+	private:
+		struct key_hash {
+			size_t operator()(const key_type& key) const {
+				size_t res;
+				memcpy(&res, key.data(), sizeof(res));
+				return res;
 			}
-		private:
-			/// HMAC secrect
-			const std::string secret;
-			/// HMAC hash generator
-			const mbedtls_md_type_t md_type;
-			/// Algorithmname
-			const std::string alg_name;
 		};
-#if 0
+
+		/// Drop entries whose key is no longer used
+		void prune() {
+			for (auto it = entries.begin(); it != entries.end();) {
+				if (it->second.expired())
+					it = entries.erase(it);
+				else
+					++it;
+			}
+			prune_at = entries.size() * 2 < 16 ? 16 : entries.size() * 2;
+		}
+
+		mutable std::mutex mutex;
+		std::unordered_map<key_type, std::weak_ptr<void>, key_hash> entries;
+		size_t prune_at = 16;
+	};
+
+	namespace details {
 		/**
-		 * Base class for RSA family of algorithms
+		 * SHA-256 for HMAC-SHA-256 (HS256), which is hashed far more often than anything else.
+		 * mbedtls only has a portable implementation handling one message at a time, here the
+		 * x86 SHA extensions are used for single messages and AVX2 hashes eight messages at once.
+		 * Both are picked at runtime from the CPU features, other CPUs use the portable code.
+		 * Define JWT_DISABLE_SHA256_SIMD to only use the portable code.
 		 */
-		struct rsa {
+		struct sha256 {
+			/// Messages hashed together by the multi buffer code
+			enum { lanes = 8 };
+
 			/**
-			 * Construct new rsa algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 * \param md Pointer to hash function
-			 * \param name Name of the algorithm
+			 * Stop using the SHA extensions or AVX2 even if the CPU has them, so tests can run the portable
+			 * and multi buffer code everywhere. Features the CPU lacks stay off.
+			 * Other threads may hash meanwhile, a hash picks its kernels once when it starts.
+			 * \param sha Whether the SHA extensions may be used
+			 * \param avx2 Whether the multi buffer code may be used
 			 */
-			rsa(const std::string& public_key, const std::string& private_key, const std::string& public_key_password, const std::string& private_key_password, const mbedtls_md_type_t md_type, const std::string& name)
-				: md_type(md_type), alg_name(name)
-			{
-				mbedtls_rsa_init(&rsa_ctx, MBEDTLS_RSA_PKCS_V15, md_type);
-				mbedtls_rsa_
+			static void limit_features(bool sha, bool avx2) noexcept {
+#ifdef JWT_SHA256_X86
+				const features detected = detect();
+				features f;
+				f.sha = sha && detected.sha;
+				f.avx2 = avx2 && detected.avx2;
+				enabled().store(f.bits(), std::memory_order_relaxed);
+#else
+				(void)sha;
+				(void)avx2;
+#endif
 			}
 
-			virtual ~rsa() {
-				mbedtls_rsa_free(&rsa_ctx);
+			/// Set state to the initial hash value
+			static void init(uint32_t* state) noexcept {
+				static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+				std::memcpy(state, iv, sizeof(iv));
 			}
+
 			/**
-			 * Sign jwt data
-			 * \param data The data to sign
-			 * \return RSA signature for the given data
-			 * \throws signature_generation_exception
+			 * Process whole 64 byte blocks
+			 * \param state Eight words of hash state
+			 * \param blocks Data to absorb
+			 * \param count Number of blocks
 			 */
-			std::string sign(const std::string& data) {
-				std::string hash = generate_hash(data, md_type);
-				std::string res;
-				int rc;
-				res.resize(mbedtls_rsa_get_len(&rsa_ctx));
-				rc = mbedtls_rsa_pkcs1_sign(&rsa_ctx, rnd.static_random, rnd.random_context(), MBEDTLS_RSA_PRIVATE, md_type, hash.length(), (const unsigned char*)hash.data(), (unsigned char*)res.data());
-				return res;
+			static void compress(uint32_t* state, const unsigned char* blocks, size_t count) noexcept {
+				compressor()(state, blocks, count);
 			}
+
 			/**
-			 * Check if signature is valid
-			 * \param data The data to check signature against
-			 * \param signature Signature provided by the jwt
-			 * \throws signature_verification_exception If the provided signature does not match
+			 * Compute HMACs, continuing from the states after the key xor ipad and key xor opad blocks
+			 * \param inner Inner state of each message
+			 * \param outer Outer state of each message
+			 * \param data Messages
+			 * \param len Length of each message
+			 * \param count Number of messages
+			 * \param mac Receives 32 bytes per message
 			 */
-			void verify(const std::string& data, const std::string& signature) {
-				std::string hash = generate_hash(data, md_type);
-				int rc = mbedtls_rsa_pkcs1_verify(&rsa_ctx, rnd.static_random, rnd.random_context(), MBEDTLS_RSA_PUBLIC, MBEDTLS_MD_NONE, hash.length(), (const unsigned char*)hash.data(), (const unsigned char*)signature.data());
-				if (rc != 0)
-				{
-					throw signature_verification_exception();
+			static void hmac(const uint32_t* const* inner, const uint32_t* const* outer, const unsigned char* const* data, const size_t* len, size_t count, unsigned char* mac) noexcept {
+#ifdef JWT_SHA256_X86
+				// The SHA extensions beat eight AVX2 lanes, so multi buffer is only used without them
+				const features f = cpu();
+				if (count > 1 && f.avx2 && !f.sha) {
+					for (size_t i = 0; i < count; i += lanes) {
+						const size_t n = count - i < size_t(lanes) ? count - i : size_t(lanes);
+						hmac_lanes(inner + i, outer + i, data + i, len + i, n, mac + 32 * i);
+					}
+					return;
 				}
+#endif
+				for (size_t i = 0; i < count; i++)
+					hmac(inner[i], outer[i], data[i], len[i], mac + 32 * i);
 			}
 			/**
-			 * Returns the algorithm name provided to the constructor
-			 * \return Algorithmname
+			 * Compute the HMAC of a single message, see hmac() above
+			 * \param absorbed Bytes of the message inner already absorbed, a multiple of 64
 			 */
-			std::string name() const {
-				return alg_name;
+			static void hmac(const uint32_t* inner, const uint32_t* outer, const unsigned char* data, size_t len, unsigned char* mac, size_t absorbed = 0) noexcept {
+				const compress_function compress_blocks = compressor();
+				uint32_t state[8];
+				std::memcpy(state, inner, sizeof(state));
+				compress_blocks(state, data, len / 64);
+				unsigned char tail[128];
+				compress_blocks(state, tail, pad(tail, data + len - len % 64, absorbed + len));
+				unsigned char block[64];
+				outer_block(block, state);
+				std::memcpy(state, outer, sizeof(state));
+				compress_blocks(state, block, 1);
+				for (size_t i = 0; i < 8; i++)
+					store(mac + 4 * i, state[i]);
 			}
+
 		private:
-			random rnd;
+			/// Block function of compress()
+			typedef void (*compress_function)(uint32_t* state, const unsigned char* blocks, size_t count);
+			/// Kernel compress() uses right now, for hashes that must compress all blocks with the same one
+			static compress_function compressor() noexcept {
+#ifdef JWT_SHA256_X86
+				if (cpu().sha)
+					return &compress_sha;
+#endif
+				return &compress_portable;
+			}
 
-			mbedtls_rsa_context rsa_ctx;
+			static const uint32_t* round_constants() noexcept {
+				static const uint32_t k[64] = {
+					0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+					0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+					0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+					0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+					0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+					0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+					0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+					0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+				};
+				return k;
+			}
 
-			/// Hash generator
-			const mbedtls_md_type_t md_type;
-			/// Algorithmname
-			const std::string alg_name;
-		};
-#endif
-		/**
-		 * Base class for ECDSA family of algorithms
-		 */
-		struct ecdsa {
-			struct impl {
-				random rnd;
-				mbedtls_md_type_t md_type;
-				mbedtls_ecdsa_context ecdsa_ctx;
+			static uint32_t load(const unsigned char* p) noexcept {
+				return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+			}
+			static void store(unsigned char* p, uint32_t v) noexcept {
+				p[0] = (unsigned char)(v >> 24);
+				p[1] = (unsigned char)(v >> 16);
+				p[2] = (unsigned char)(v >> 8);
+				p[3] = (unsigned char)v;
+			}
+			static uint32_t rotr(uint32_t x, int n) noexcept {
+				return (x >> n) | (x << (32 - n));
+			}
 
-				/// Algorithmname
-				const std::string alg_name;
+			/**
+			 * Write the padded last blocks of an inner hash, which follows the 64 byte key block
+			 * \param tail Receives up to two blocks
+			 * \param rest Bytes of the message after its last whole block
+			 * \param len Length of the whole message
+			 * \return Number of blocks written
+			 */
+			static size_t pad(unsigned char* tail, const unsigned char* rest, size_t len) noexcept {
+				const size_t r = len % 64;
+				const size_t blocks = r + 9 <= 64 ? 1 : 2;
+				std::memcpy(tail, rest, r);
+				tail[r] = 0x80;
+				std::memset(tail + r + 1, 0, 64 * blocks - r - 1);
+				const uint64_t bits = ((uint64_t)len + 64) * 8;
+				store(tail + 64 * blocks - 8, (uint32_t)(bits >> 32));
+				store(tail + 64 * blocks - 4, (uint32_t)bits);
+				return blocks;
+			}
+			/// Write the only block of an outer hash, the inner digest after the 64 byte key block
+			static void outer_block(unsigned char* block, const uint32_t* digest) noexcept {
+				for (size_t i = 0; i < 8; i++)
+					store(block + 4 * i, digest[i]);
+				std::memset(block + 32, 0, 32);
+				block[32] = 0x80;
+				// 96 bytes in bits
+				block[62] = 0x03;
+			}
 
-				impl(const mbedtls_ecp_keypair *keypair, const mbedtls_md_type_t md_type, const std::string& name)
-					: md_type(md_type), alg_name(name)
-				{
-					mbedtls_ecdsa_init(&ecdsa_ctx);
-					mbedtls_ecdsa_from_keypair(&ecdsa_ctx, keypair);
+			static void compress_portable(uint32_t* state, const unsigned char* blocks, size_t count) noexcept {
+				const uint32_t* k = round_constants();
+				for (; count != 0; count--, blocks += 64) {
+					uint32_t w[64];
+					for (size_t i = 0; i < 16; i++)
+						w[i] = load(blocks + 4 * i);
+					for (size_t i = 16; i < 64; i++) {
+						const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+						const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+						w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+					}
+					uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+					uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+					for (size_t i = 0; i < 64; i++) {
+						const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+						const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+						h = g;
+						g = f;
+						f = e;
+						e = d + t1;
+						d = c;
+						c = b;
+						b = a;
+						a = t1 + t2;
+					}
+					state[0] += a;
+					state[1] += b;
+					state[2] += c;
+					state[3] += d;
+					state[4] += e;
+					state[5] += f;
+					state[6] += g;
+					state[7] += h;
 				}
+			}
 
-				~impl() {
-					mbedtls_ecdsa_free(&ecdsa_ctx);
-				}
+#ifdef JWT_SHA256_X86
+			struct features {
+				bool sha = false;
+				bool avx2 = false;
+				unsigned bits() const noexcept { return (sha ? 1u : 0u) | (avx2 ? 2u : 0u); }
 			};
+			/// Features the kernels are picked by as features::bits(), detect() unless limit_features changed them
+			static std::atomic<unsigned>& enabled() noexcept {
+				static std::atomic<unsigned> bits{ detect().bits() };
+				return bits;
+			}
+			static features cpu() noexcept {
+				const unsigned bits = enabled().load(std::memory_order_relaxed);
+				features f;
+				f.sha = (bits & 1u) != 0;
+				f.avx2 = (bits & 2u) != 0;
+				return f;
+			}
+			static features detect() noexcept {
+				unsigned int leaf1[4] = {};
+				unsigned int leaf7[4] = {};
+				unsigned long long xcr0 = 0;
+#if defined(_MSC_VER)
+				int r[4];
+				__cpuid(r, 0);
+				const unsigned int max_leaf = (unsigned int)r[0];
+				__cpuid(r, 1);
+				for (size_t i = 0; i < 4; i++)
+					leaf1[i] = (unsigned int)r[i];
+				if (max_leaf >= 7) {
+					__cpuidex(r, 7, 0);
+					for (size_t i = 0; i < 4; i++)
+						leaf7[i] = (unsigned int)r[i];
+				}
+				if (leaf1[2] & (1u << 27))
+					xcr0 = _xgetbv(0);
+#else
+				const unsigned int max_leaf = __get_cpuid_max(0, nullptr);
+				__cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+				if (max_leaf >= 7)
+					__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+				if (leaf1[2] & (1u << 27)) {
+					unsigned int lo, hi;
+					__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+					xcr0 = (unsigned long long)hi << 32 | lo;
+				}
+#endif
+				features f;
+				// SSSE3 and SSE4.1 are needed besides the SHA extensions
+				f.sha = (leaf7[1] & (1u << 29)) && (leaf1[2] & (1u << 9)) && (leaf1[2] & (1u << 19));
+				// AVX2 also needs the OS to save the ymm registers
+				f.avx2 = (leaf7[1] & (1u << 5)) && (leaf1[2] & (1u << 28)) && (xcr0 & 6) == 6;
+				return f;
+			}
 
-			std::shared_ptr<impl> _impl;
+			/// Next four message words from the previous sixteen, oldest first
+			JWT_SHA256_TARGET("sha,sse4.1,ssse3")
+			static inline __m128i schedule(__m128i w0, __m128i w4, __m128i w8, __m128i w12) noexcept {
+				return _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w0, w4), _mm_alignr_epi8(w12, w8, 4)), w12);
+			}
+			/// Four rounds, k points to their round constants
+			JWT_SHA256_TARGET("sha,sse4.1,ssse3")
+			static inline void rounds(__m128i& abef, __m128i& cdgh, __m128i w, const uint32_t* k) noexcept {
+				const __m128i wk = _mm_add_epi32(w, _mm_loadu_si128((const __m128i*)k));
+				cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+				abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));
+			}
+			JWT_SHA256_TARGET("sha,sse4.1,ssse3")
+			static void compress_sha(uint32_t* state, const unsigned char* blocks, size_t count) noexcept {
+				const uint32_t* k = round_constants();
+				const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+				// The instructions keep the state as ABEF and CDGH
+				__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xB1);
+				__m128i cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 0x1B);
+				__m128i abef = _mm_alignr_epi8(tmp, cdgh, 8);
+				cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+				for (; count != 0; count--, blocks += 64) {
+					const __m128i abef_start = abef;
+					const __m128i cdgh_start = cdgh;
+					__m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)blocks), swap);
+					__m128i w4 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 16)), swap);
+					__m128i w8 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 32)), swap);
+					__m128i w12 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 48)), swap);
+					rounds(abef, cdgh, w0, k);
+					rounds(abef, cdgh, w4, k + 4);
+					rounds(abef, cdgh, w8, k + 8);
+					rounds(abef, cdgh, w12, k + 12);
+					for (size_t i = 16; i < 64; i += 16) {
+						w0 = schedule(w0, w4, w8, w12);
+						rounds(abef, cdgh, w0, k + i);
+						w4 = schedule(w4, w8, w12, w0);
+						rounds(abef, cdgh, w4, k + i + 4);
+						w8 = schedule(w8, w12, w0, w4);
+						rounds(abef, cdgh, w8, k + i + 8);
+						w12 = schedule(w12, w0, w4, w8);
+						rounds(abef, cdgh, w12, k + i + 12);
+					}
+					abef = _mm_add_epi32(abef, abef_start);
+					cdgh = _mm_add_epi32(cdgh, cdgh_start);
+				}
+				tmp = _mm_shuffle_epi32(abef, 0x1B);
+				cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+				_mm_storeu_si128((__m128i*)state, _mm_blend_epi16(tmp, cdgh, 0xF0));
+				_mm_storeu_si128((__m128i*)(state + 4), _mm_alignr_epi8(cdgh, tmp, 8));
+			}
 
-			ecdsa(const mbedtls_ecp_keypair *keypair, const mbedtls_md_type_t md_type, const std::string& name) : 
-				_impl(new impl(keypair, md_type, name))
-			{
+			JWT_SHA256_TARGET("avx2")
+			static inline __m256i rotr(__m256i x, int n) noexcept {
+				return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+			}
+			/// Load word offset to offset + 7 of eight blocks, one block per lane
+			JWT_SHA256_TARGET("avx2")
+			static inline void load_words(const unsigned char* const* blocks, size_t offset, __m256i* w) noexcept {
+				const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+					3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+				__m256i r[8];
+				for (size_t l = 0; l < 8; l++)
+					r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(blocks[l] + 4 * offset)), swap);
+				// Transpose the 8x8 words
+				__m256i t[8];
+				for (size_t l = 0; l < 8; l += 2) {
+					t[l] = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+					t[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
+				}
+				for (size_t l = 0; l < 8; l += 4) {
+					r[l] = _mm256_unpacklo_epi64(t[l], t[l + 2]);
+					r[l + 1] = _mm256_unpackhi_epi64(t[l], t[l + 2]);
+					r[l + 2] = _mm256_unpacklo_epi64(t[l + 1], t[l + 3]);
+					r[l + 3] = _mm256_unpackhi_epi64(t[l + 1], t[l + 3]);
+				}
+				for (size_t i = 0; i < 4; i++) {
+					w[offset + i] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20);
+					w[offset + i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31);
+				}
 			}
-#if 0
 			/**
-			 * Construct new ecdsa algorithm
-			 * \param public_key ECDSA public key in PEM format
-			 * \param private_key ECDSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 * \param md Pointer to hash function
-			 * \param name Name of the algorithm
+			 * Process one block per lane with AVX2
+			 * \param state Word i of lane l at state[i * lanes + l]
+			 * \param blocks Block of each lane
+			 * \param active All bits set for lanes whose state is updated, the others are left as they are
 			 */
-			ecdsa(const std::string& public_key, const std::string& private_key, const std::string& public_key_password, const std::string& private_key_password, const EVP_MD*(*md)(), const std::string& name)
-				: md(md), alg_name(name)
-			{
-				if (private_key.empty()) {
-					std::unique_ptr<BIO, decltype(&BIO_free_all)> pubkey_bio(BIO_new(BIO_s_mem()), BIO_free_all);
-					if ((size_t)BIO_write(pubkey_bio.get(), public_key.data(), public_key.size()) != public_key.size())
-						throw ecdsa_exception("failed to load public key: bio_write failed");
-
-					pkey.reset(PEM_read_bio_EC_PUBKEY(pubkey_bio.get(), nullptr, nullptr, (void*)public_key_password.c_str()), EC_KEY_free);
-					if (!pkey)
-						throw ecdsa_exception("failed to load public key: PEM_read_bio_EC_PUBKEY failed");
-				} else {
-					std::unique_ptr<BIO, decltype(&BIO_free_all)> privkey_bio(BIO_new(BIO_s_mem()), BIO_free_all);
-					if ((size_t)BIO_write(privkey_bio.get(), private_key.data(), private_key.size()) != private_key.size())
-						throw ecdsa_exception("failed to load private key: bio_write failed");
-					pkey.reset(PEM_read_bio_ECPrivateKey(privkey_bio.get(), nullptr, nullptr, (void*)private_key_password.c_str()), EC_KEY_free);
-					if (!pkey)
-						throw ecdsa_exception("failed to load private key: PEM_read_bio_RSAPrivateKey failed");
-				}
-
-				if(EC_KEY_check_key(pkey.get()) == 0)
-					throw ecdsa_exception("failed to load key: key is invalid");
+			JWT_SHA256_TARGET("avx2")
+			static void compress_avx2(uint32_t* state, const unsigned char* const* blocks, const int32_t* active) noexcept {
+				const uint32_t* k = round_constants();
+				__m256i w[16];
+				load_words(blocks, 0, w);
+				load_words(blocks, 8, w);
+				__m256i s[8];
+				for (size_t i = 0; i < 8; i++)
+					s[i] = _mm256_loadu_si256((const __m256i*)(state + i * lanes));
+				__m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+				for (size_t i = 0; i < 64; i++) {
+					if (i >= 16) {
+						const __m256i w15 = w[(i - 15) % 16];
+						const __m256i w2 = w[(i - 2) % 16];
+						const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(w15, 7), rotr(w15, 18)), _mm256_srli_epi32(w15, 3));
+						const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(w2, 17), rotr(w2, 19)), _mm256_srli_epi32(w2, 10));
+						w[i % 16] = _mm256_add_epi32(_mm256_add_epi32(w[i % 16], s0), _mm256_add_epi32(w[(i - 7) % 16], s1));
+					}
+					const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+					const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+					const __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, w[i % 16])),
+						_mm256_set1_epi32((int)k[i]));
+					const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+					const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+					h = g;
+					g = f;
+					f = e;
+					e = _mm256_add_epi32(d, t1);
+					d = c;
+					c = b;
+					b = a;
+					a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+				}
+				const __m256i mask = _mm256_loadu_si256((const __m256i*)active);
+				const __m256i out[8] = { a, b, c, d, e, f, g, h };
+				for (size_t i = 0; i < 8; i++)
+					_mm256_storeu_si256((__m256i*)(state + i * lanes), _mm256_blendv_epi8(s[i], _mm256_add_epi32(s[i], out[i]), mask));
+			}
+
+			/// Compute up to eight HMACs with compress_avx2, lanes run until their message ends
+			static void hmac_lanes(const uint32_t* const* inner, const uint32_t* const* outer, const unsigned char* const* data, const size_t* len, size_t count, unsigned char* mac) noexcept {
+				static const unsigned char unused[64] = {};
+				uint32_t state[8 * lanes];
+				unsigned char tails[lanes][128];
+				size_t whole[lanes];
+				size_t total[lanes];
+				size_t steps = 0;
+				for (size_t l = 0; l < lanes; l++) {
+					whole[l] = total[l] = 0;
+					for (size_t i = 0; i < 8; i++)
+						state[i * lanes + l] = l < count ? inner[l][i] : 0;
+					if (l >= count)
+						continue;
+					whole[l] = len[l] / 64;
+					total[l] = whole[l] + pad(tails[l], data[l] + len[l] - len[l] % 64, len[l]);
+					steps = total[l] > steps ? total[l] : steps;
+				}
+				const unsigned char* blocks[lanes];
+				int32_t active[lanes];
+				for (size_t t = 0; t < steps; t++) {
+					for (size_t l = 0; l < lanes; l++) {
+						active[l] = t < total[l] ? -1 : 0;
+						blocks[l] = t < whole[l] ? data[l] + 64 * t : (t < total[l] ? tails[l] + 64 * (t - whole[l]) : unused);
+					}
+					compress_avx2(state, blocks, active);
+				}
+				unsigned char outer_blocks[lanes][64];
+				for (size_t l = 0; l < lanes; l++) {
+					uint32_t digest[8];
+					for (size_t i = 0; i < 8; i++) {
+						digest[i] = state[i * lanes + l];
+						state[i * lanes + l] = l < count ? outer[l][i] : 0;
+					}
+					outer_block(outer_blocks[l], digest);
+					blocks[l] = outer_blocks[l];
+					active[l] = l < count ? -1 : 0;
+				}
+				compress_avx2(state, blocks, active);
+				for (size_t l = 0; l < count; l++) {
+					for (size_t i = 0; i < 8; i++)
+						store(mac + 32 * l + 4 * i, state[i * lanes + l]);
+				}
 			}
 #endif
+		};
 
+		/**
+		 * Ed25519 (RFC 8032) for the default EdDSA backend, mbedtls has no Edwards curves.
+		 * Field elements are five 51 bit limbs and points use extended coordinates. Whatever depends on
+		 * the private key runs in constant time: multiples of the base point are the sum of one table
+		 * entry per four bits, each looked up by reading the whole row, and scalars are reduced bit by bit.
+		 * Verification only handles public values and uses a variable time window for the public key.
+		 */
+		struct ed25519 {
 			/**
-			 * Sign jwt data
-			 * \param data The data to sign
-			 * \return ECDSA signature for the given data
-			 * \throws signature_generation_exception
+			 * Compute the public key of a private key
+			 * \param seed 32 byte private key
+			 * \param pub Receives the 32 byte public key
+			 * \return false if hashing failed
 			 */
-			std::string sign(const std::string& data) {
-				const std::string hash = generate_hash(data, _impl->md_type);
-				std::string sig;
-				int ret_write_sign;
-				mbedtls_mpi r;
-				mbedtls_mpi s;
-				mbedtls_mpi_init(&r);
-				mbedtls_mpi_init(&s);
-				ret_write_sign = mbedtls_ecdsa_sign(&_impl->ecdsa_ctx.grp, &r, &s, &_impl->ecdsa_ctx.d, (const unsigned char*)hash.data(), hash.size() * 8, _impl->rnd.static_random, _impl->rnd.random_context());
-				
-				raw2bn(&r, (unsigned char*)sig.data(), sig.size() / 2);
-				raw2bn(&r, (unsigned char*)sig.data() + (sig.size() / 2), sig.size() / 2);
-
-				mbedtls_mpi_free(&r);
-				mbedtls_mpi_free(&s);
-
-				if(ret_write_sign)
-					throw signature_generation_exception();
-
-				if (sig.size() % 2 == 1 && sig[0] == 0x00)
-					return sig.substr(1);
-				return sig;
+			static bool public_key(const unsigned char* seed, unsigned char* pub) noexcept {
+				unsigned char h[64];
+				const bool ok = hash(h, seed, 32, nullptr, 0, nullptr, 0);
+				if (ok) {
+					clamp(h);
+					point a;
+					multiply_base(a, h);
+					encode(pub, a);
+				}
+				mbedtls_platform_zeroize(h, sizeof(h));
+				return ok;
 			}
 			/**
-			 * Check if signature is valid
-			 * \param data The data to check signature against
-			 * \param signature Signature provided by the jwt
-			 * \throws signature_verification_exception If the provided signature does not match
+			 * Sign a message
+			 * \param seed 32 byte private key
+			 * \param pub Public key of seed
+			 * \param data Message
+			 * \param len Length of the message
+			 * \param sig Receives the 64 byte signature R || S
+			 * \return false if hashing failed
 			 */
-			void verify(const std::string& data, const std::string& signature) {
-				const std::string hash = generate_hash(data, _impl->md_type);
-				int ret_read_sign;
-				mbedtls_mpi r;
-				mbedtls_mpi s;
+			static bool sign(const unsigned char* seed, const unsigned char* pub, const unsigned char* data, size_t len, unsigned char* sig) noexcept {
+				unsigned char h[64];
+				unsigned char digest[64];
+				uint64_t wide_value[8];
+				uint64_t r[4], a[4], k[4], s[4];
+				bool ok = hash(h, seed, 32, nullptr, 0, nullptr, 0);
+				if (ok) {
+					clamp(h);
+					ok = hash(digest, h + 32, 32, data, len, nullptr, 0);
+				}
+				if (ok) {
+					load_wide(wide_value, digest);
+					reduce(r, wide_value);
+					store_scalar(digest, r);
+					point big_r;
+					multiply_base(big_r, digest);
+					encode(sig, big_r);
+					ok = hash(digest, sig, 32, pub, 32, data, len);
+				}
+				if (ok) {
+					load_wide(wide_value, digest);
+					reduce(k, wide_value);
+					for (int i = 0; i < 4; i++)
+						a[i] = load64(h + 8 * i);
+					// S = r + k * a mod L
+					multiply_add(s, k, a, r);
+					store_scalar(sig + 32, s);
+				}
+				mbedtls_platform_zeroize(h, sizeof(h));
+				mbedtls_platform_zeroize(digest, sizeof(digest));
+				mbedtls_platform_zeroize(wide_value, sizeof(wide_value));
+				mbedtls_platform_zeroize(r, sizeof(r));
+				mbedtls_platform_zeroize(a, sizeof(a));
+				return ok;
+			}
+			/**
+			 * Check a signature, rejecting non canonical encodings of S and of the public key
+			 * \param pub 32 byte public key
+			 * \param data Message
+			 * \param len Length of the message
+			 * \param sig 64 byte signature
+			 * \return true if the signature is valid
+			 */
+			static bool verify(const unsigned char* pub, const unsigned char* data, size_t len, const unsigned char* sig) noexcept {
+				point a;
+				if (!is_reduced(sig + 32) || !decode(a, pub))
+					return false;
+				unsigned char digest[64];
+				if (!hash(digest, sig, 32, pub, 32, data, len))
+					return false;
+				uint64_t wide_value[8];
+				uint64_t k[4];
+				load_wide(wide_value, digest);
+				reduce(k, wide_value);
+				store_scalar(digest, k);
 
-				mbedtls_mpi_init(&r);
-				mbedtls_mpi_init(&s);
-				raw2bn(&r, (const unsigned char*)signature.data(), signature.size() / 2);
-				raw2bn(&s, (const unsigned char*)signature.data() + (signature.size() / 2), signature.size() / 2);
+				// R' = S * B - k * A, valid if it encodes to R
+				negate(a.X, a.X);
+				negate(a.T, a.T);
+				cached multiples[8];
+				to_cached(multiples[0], a);
+				point p = a;
+				for (int i = 1; i < 8; i++) {
+					add(p, p, multiples[0]);
+					to_cached(multiples[i], p);
+				}
+				int e[64];
+				recode(e, digest);
+				identity(p);
+				for (int i = 63; i >= 0; i--) {
+					if (i != 63) {
+						for (int j = 0; j < 4; j++)
+							twice(p, p);
+					}
+					if (e[i] > 0)
+						add(p, p, multiples[e[i] - 1]);
+					else if (e[i] < 0) {
+						cached minus;
+						negate(minus, multiples[-e[i] - 1]);
+						add(p, p, minus);
+					}
+				}
+				point sb;
+				multiply_base(sb, sig + 32);
+				cached c;
+				to_cached(c, sb);
+				add(p, p, c);
+				unsigned char check[32];
+				encode(check, p);
+				return std::memcmp(check, sig, 32) == 0;
+			}
+
+		private:
+#if defined(__SIZEOF_INT128__)
+			typedef unsigned __int128 wide;
+			static wide mul64(uint64_t a, uint64_t b) noexcept { return (wide)a * b; }
+			static uint64_t low(wide x) noexcept { return (uint64_t)x; }
+			/// x >> n for 0 < n <= 64
+			static uint64_t shift(wide x, int n) noexcept { return (uint64_t)(x >> n); }
+#else
+			/// 128 bit accumulator for compilers without a native type
+			struct wide {
+				uint64_t lo, hi;
+				wide& operator+=(const wide& o) noexcept {
+					lo += o.lo;
+					hi += o.hi + (lo < o.lo ? 1 : 0);
+					return *this;
+				}
+				wide& operator+=(uint64_t o) noexcept {
+					lo += o;
+					hi += lo < o ? 1 : 0;
+					return *this;
+				}
+			};
+			static wide mul64(uint64_t a, uint64_t b) noexcept {
+				wide r;
+#if defined(_MSC_VER) && defined(_M_X64)
+				r.lo = _umul128(a, b, &r.hi);
+#else
+				const uint64_t a0 = a & 0xffffffff, a1 = a >> 32, b0 = b & 0xffffffff, b1 = b >> 32;
+				const uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+				const uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+				r.lo = (mid << 32) | (p00 & 0xffffffff);
+				r.hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+				return r;
+			}
+			static uint64_t low(const wide& x) noexcept { return x.lo; }
+			/// x >> n for 0 < n <= 64
+			static uint64_t shift(const wide& x, int n) noexcept { return n == 64 ? x.hi : (x.lo >> n) | (x.hi << (64 - n)); }
+#endif
 
-				ret_read_sign = mbedtls_ecdsa_verify(&_impl->ecdsa_ctx.grp, (const unsigned char*)hash.data(), hash.size() * 8, &_impl->ecdsa_ctx.Q, &r, &s);
+			/// Element of GF(2^255 - 19), limbs stay below 2^52 between operations
+			struct field {
+				uint64_t v[5];
+			};
+			/// Point in extended coordinates, x = X / Z, y = Y / Z, x * y = T / Z
+			struct point {
+				field X, Y, Z, T;
+			};
+			/// Point prepared for addition
+			struct cached {
+				field y_plus_x, y_minus_x, z2, t2d;
+			};
 
-				mbedtls_mpi_free(&r);
-				mbedtls_mpi_free(&s);
+			static constexpr uint64_t mask51 = (uint64_t(1) << 51) - 1;
 
-				if (ret_read_sign)
-				{
-					throw signature_verification_exception("Invalid signature");
+			static uint64_t load64(const unsigned char* s) noexcept {
+				uint64_t r = 0;
+				for (int i = 7; i >= 0; i--)
+					r = (r << 8) | s[i];
+				return r;
+			}
+			static void store64(unsigned char* s, uint64_t v) noexcept {
+				for (int i = 0; i < 8; i++)
+					s[i] = (unsigned char)(v >> (8 * i));
+			}
+
+			static void set(field& h, uint64_t v0, uint64_t v1, uint64_t v2, uint64_t v3, uint64_t v4) noexcept {
+				h.v[0] = v0;
+				h.v[1] = v1;
+				h.v[2] = v2;
+				h.v[3] = v3;
+				h.v[4] = v4;
+			}
+			static const field& d() noexcept {
+				static const field v = { { 0x34dca135978a3, 0x1a8283b156ebd, 0x5e7a26001c029, 0x739c663a03cbb, 0x52036cee2b6ff } };
+				return v;
+			}
+			static const field& d2() noexcept {
+				static const field v = { { 0x69b9426b2f159, 0x35050762add7a, 0x3cf44c0038052, 0x6738cc7407977, 0x2406d9dc56dff } };
+				return v;
+			}
+			static const field& sqrt_m1() noexcept {
+				static const field v = { { 0x61b274a0ea0b0, 0xd5a5fc8f189d, 0x7ef5e9cbd0c60, 0x78595a6804c9e, 0x2b8324804fc1d } };
+				return v;
+			}
+
+			static void carry(field& h) noexcept {
+				uint64_t c;
+				c = h.v[0] >> 51; h.v[0] &= mask51; h.v[1] += c;
+				c = h.v[1] >> 51; h.v[1] &= mask51; h.v[2] += c;
+				c = h.v[2] >> 51; h.v[2] &= mask51; h.v[3] += c;
+				c = h.v[3] >> 51; h.v[3] &= mask51; h.v[4] += c;
+				c = h.v[4] >> 51; h.v[4] &= mask51; h.v[0] += 19 * c;
+			}
+			static void add(field& h, const field& f, const field& g) noexcept {
+				for (int i = 0; i < 5; i++)
+					h.v[i] = f.v[i] + g.v[i];
+				carry(h);
+			}
+			/// h = f - g, computed as f + 2p - g to stay positive
+			static void sub(field& h, const field& f, const field& g) noexcept {
+				h.v[0] = f.v[0] + 0xfffffffffffda - g.v[0];
+				for (int i = 1; i < 5; i++)
+					h.v[i] = f.v[i] + 0xffffffffffffe - g.v[i];
+				carry(h);
+			}
+			static void negate(field& h, const field& f) noexcept {
+				field zero = { { 0, 0, 0, 0, 0 } };
+				sub(h, zero, f);
+			}
+			static void reduce_wide(field& h, wide r0, wide r1, wide r2, wide r3, wide r4) noexcept {
+				r1 += shift(r0, 51);
+				r2 += shift(r1, 51);
+				r3 += shift(r2, 51);
+				r4 += shift(r3, 51);
+				h.v[0] = (low(r0) & mask51) + 19 * shift(r4, 51);
+				h.v[1] = (low(r1) & mask51) + (h.v[0] >> 51);
+				h.v[0] &= mask51;
+				h.v[2] = low(r2) & mask51;
+				h.v[3] = low(r3) & mask51;
+				h.v[4] = low(r4) & mask51;
+			}
+			static void mul(field& h, const field& f, const field& g) noexcept {
+				const uint64_t f0 = f.v[0], f1 = f.v[1], f2 = f.v[2], f3 = f.v[3], f4 = f.v[4];
+				const uint64_t g0 = g.v[0], g1 = g.v[1], g2 = g.v[2], g3 = g.v[3], g4 = g.v[4];
+				const uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4;
+				wide r0 = mul64(f0, g0); r0 += mul64(f1, g4_19); r0 += mul64(f2, g3_19); r0 += mul64(f3, g2_19); r0 += mul64(f4, g1_19);
+				wide r1 = mul64(f0, g1); r1 += mul64(f1, g0); r1 += mul64(f2, g4_19); r1 += mul64(f3, g3_19); r1 += mul64(f4, g2_19);
+				wide r2 = mul64(f0, g2); r2 += mul64(f1, g1); r2 += mul64(f2, g0); r2 += mul64(f3, g4_19); r2 += mul64(f4, g3_19);
+				wide r3 = mul64(f0, g3); r3 += mul64(f1, g2); r3 += mul64(f2, g1); r3 += mul64(f3, g0); r3 += mul64(f4, g4_19);
+				wide r4 = mul64(f0, g4); r4 += mul64(f1, g3); r4 += mul64(f2, g2); r4 += mul64(f3, g1); r4 += mul64(f4, g0);
+				reduce_wide(h, r0, r1, r2, r3, r4);
+			}
+			static void square(field& h, const field& f) noexcept {
+				const uint64_t f0 = f.v[0], f1 = f.v[1], f2 = f.v[2], f3 = f.v[3], f4 = f.v[4];
+				const uint64_t f0_2 = 2 * f0, f1_2 = 2 * f1, f2_2 = 2 * f2, f3_2 = 2 * f3;
+				const uint64_t f3_19 = 19 * f3, f4_19 = 19 * f4;
+				wide r0 = mul64(f0, f0); r0 += mul64(f1_2, f4_19); r0 += mul64(f2_2, f3_19);
+				wide r1 = mul64(f0_2, f1); r1 += mul64(f2_2, f4_19); r1 += mul64(f3, f3_19);
+				wide r2 = mul64(f0_2, f2); r2 += mul64(f1, f1); r2 += mul64(f3_2, f4_19);
+				wide r3 = mul64(f0_2, f3); r3 += mul64(f1_2, f2); r3 += mul64(f4, f4_19);
+				wide r4 = mul64(f0_2, f4); r4 += mul64(f1_2, f3); r4 += mul64(f2, f2);
+				reduce_wide(h, r0, r1, r2, r3, r4);
+			}
+			static void square_times(field& h, const field& f, int n) noexcept {
+				square(h, f);
+				for (int i = 1; i < n; i++)
+					square(h, h);
+			}
+			/// t = z^(2^250 - 1), z11 = z^11, shared by invert and pow22523
+			static void pow250(field& t, field& z11, const field& z) noexcept {
+				field t0, t1, t2;
+				square(t0, z);
+				square_times(t1, t0, 2);
+				mul(t1, t1, z);
+				mul(z11, t0, t1);
+				square(t0, z11);
+				mul(t0, t0, t1);
+				square_times(t1, t0, 5);
+				mul(t0, t1, t0);
+				square_times(t1, t0, 10);
+				mul(t1, t1, t0);
+				square_times(t2, t1, 20);
+				mul(t2, t2, t1);
+				square_times(t2, t2, 10);
+				mul(t0, t2, t0);
+				square_times(t1, t0, 50);
+				mul(t1, t1, t0);
+				square_times(t2, t1, 100);
+				mul(t2, t2, t1);
+				square_times(t2, t2, 50);
+				mul(t, t2, t0);
+			}
+			/// h = z^(p - 2) = 1 / z
+			static void invert(field& h, const field& z) noexcept {
+				field t, z11;
+				pow250(t, z11, z);
+				square_times(t, t, 5);
+				mul(h, t, z11);
+			}
+			/// h = z^((p - 5) / 8), used for square roots
+			static void pow22523(field& h, const field& z) noexcept {
+				field t, z11;
+				pow250(t, z11, z);
+				square_times(t, t, 2);
+				mul(h, t, z);
+			}
+			/// Canonical little endian encoding
+			static void store(unsigned char* s, const field& f) noexcept {
+				field t = f;
+				carry(t);
+				// t is below 2p, subtract p once if t + 19 reaches 2^255
+				uint64_t q = (t.v[0] + 19) >> 51;
+				q = (t.v[1] + q) >> 51;
+				q = (t.v[2] + q) >> 51;
+				q = (t.v[3] + q) >> 51;
+				q = (t.v[4] + q) >> 51;
+				t.v[0] += 19 * q;
+				t.v[1] += t.v[0] >> 51; t.v[0] &= mask51;
+				t.v[2] += t.v[1] >> 51; t.v[1] &= mask51;
+				t.v[3] += t.v[2] >> 51; t.v[2] &= mask51;
+				t.v[4] += t.v[3] >> 51; t.v[3] &= mask51;
+				t.v[4] &= mask51;
+				store64(s, t.v[0] | (t.v[1] << 51));
+				store64(s + 8, (t.v[1] >> 13) | (t.v[2] << 38));
+				store64(s + 16, (t.v[2] >> 26) | (t.v[3] << 25));
+				store64(s + 24, (t.v[3] >> 39) | (t.v[4] << 12));
+			}
+			/// Read 255 bits, the top bit is ignored
+			static void load(field& h, const unsigned char* s) noexcept {
+				const uint64_t w0 = load64(s), w1 = load64(s + 8), w2 = load64(s + 16), w3 = load64(s + 24);
+				set(h, w0 & mask51, ((w0 >> 51) | (w1 << 13)) & mask51, ((w1 >> 38) | (w2 << 26)) & mask51,
+					((w2 >> 25) | (w3 << 39)) & mask51, (w3 >> 12) & mask51);
+			}
+			static bool is_zero(const field& f) noexcept {
+				unsigned char s[32];
+				store(s, f);
+				unsigned char acc = 0;
+				for (int i = 0; i < 32; i++)
+					acc |= s[i];
+				return acc == 0;
+			}
+			static unsigned is_negative(const field& f) noexcept {
+				unsigned char s[32];
+				store(s, f);
+				return s[0] & 1;
+			}
+			/// f = g if flag is 1, unchanged if it is 0, without branching
+			static void select(field& f, const field& g, uint64_t flag) noexcept {
+				const uint64_t m = 0 - flag;
+				for (int i = 0; i < 5; i++)
+					f.v[i] ^= m & (f.v[i] ^ g.v[i]);
+			}
+
+			static void identity(point& p) noexcept {
+				set(p.X, 0, 0, 0, 0, 0);
+				set(p.Y, 1, 0, 0, 0, 0);
+				set(p.Z, 1, 0, 0, 0, 0);
+				set(p.T, 0, 0, 0, 0, 0);
+			}
+			static void identity(cached& c) noexcept {
+				set(c.y_plus_x, 1, 0, 0, 0, 0);
+				set(c.y_minus_x, 1, 0, 0, 0, 0);
+				set(c.z2, 2, 0, 0, 0, 0);
+				set(c.t2d, 0, 0, 0, 0, 0);
+			}
+			static void to_cached(cached& c, const point& p) noexcept {
+				add(c.y_plus_x, p.Y, p.X);
+				sub(c.y_minus_x, p.Y, p.X);
+				add(c.z2, p.Z, p.Z);
+				mul(c.t2d, p.T, d2());
+			}
+			static void negate(cached& r, const cached& c) noexcept {
+				r.y_plus_x = c.y_minus_x;
+				r.y_minus_x = c.y_plus_x;
+				r.z2 = c.z2;
+				negate(r.t2d, c.t2d);
+			}
+			static void select(cached& c, const cached& o, uint64_t flag) noexcept {
+				select(c.y_plus_x, o.y_plus_x, flag);
+				select(c.y_minus_x, o.y_minus_x, flag);
+				select(c.z2, o.z2, flag);
+				select(c.t2d, o.t2d, flag);
+			}
+			/// r = p + q, complete so it also works for doubling and the identity (RFC 8032 5.1.4)
+			static void add(point& r, const point& p, const cached& q) noexcept {
+				field a, b, c, dd, e, f, g, h;
+				sub(a, p.Y, p.X);
+				mul(a, a, q.y_minus_x);
+				add(b, p.Y, p.X);
+				mul(b, b, q.y_plus_x);
+				mul(c, p.T, q.t2d);
+				mul(dd, p.Z, q.z2);
+				sub(e, b, a);
+				sub(f, dd, c);
+				add(g, dd, c);
+				add(h, b, a);
+				mul(r.X, e, f);
+				mul(r.Y, g, h);
+				mul(r.T, e, h);
+				mul(r.Z, f, g);
+			}
+			/// r = 2 * p
+			static void twice(point& r, const point& p) noexcept {
+				field a, b, c, e, f, g, h;
+				square(a, p.X);
+				square(b, p.Y);
+				square(c, p.Z);
+				add(c, c, c);
+				add(h, a, b);
+				add(e, p.X, p.Y);
+				square(e, e);
+				sub(e, h, e);
+				sub(g, a, b);
+				add(f, c, g);
+				mul(r.X, e, f);
+				mul(r.Y, g, h);
+				mul(r.T, e, h);
+				mul(r.Z, f, g);
+			}
+			static void encode(unsigned char* s, const point& p) noexcept {
+				field z_inv, x, y;
+				invert(z_inv, p.Z);
+				mul(x, p.X, z_inv);
+				mul(y, p.Y, z_inv);
+				store(s, y);
+				s[31] ^= (unsigned char)(is_negative(x) << 7);
+			}
+			/// Decompress a point (RFC 8032 5.1.3), only used for public values
+			static bool decode(point& p, const unsigned char* s) noexcept {
+				load(p.Y, s);
+				unsigned char canonical[32];
+				store(canonical, p.Y);
+				canonical[31] |= s[31] & 0x80;
+				if (std::memcmp(canonical, s, 32) != 0)
+					return false;
+				field u, v, v3, vxx, check;
+				set(p.Z, 1, 0, 0, 0, 0);
+				square(u, p.Y);
+				mul(v, u, d());
+				sub(u, u, p.Z);
+				add(v, v, p.Z);
+				// x = u * v^3 * (u * v^7)^((p - 5) / 8)
+				square(v3, v);
+				mul(v3, v3, v);
+				square(p.X, v3);
+				mul(p.X, p.X, v);
+				mul(p.X, p.X, u);
+				pow22523(p.X, p.X);
+				mul(p.X, p.X, v3);
+				mul(p.X, p.X, u);
+				square(vxx, p.X);
+				mul(vxx, vxx, v);
+				sub(check, vxx, u);
+				if (!is_zero(check)) {
+					add(check, vxx, u);
+					if (!is_zero(check))
+						return false;
+					mul(p.X, p.X, sqrt_m1());
 				}
+				if (is_negative(p.X) != (unsigned)(s[31] >> 7)) {
+					if (is_zero(p.X))
+						return false;
+					negate(p.X, p.X);
+				}
+				mul(p.T, p.X, p.Y);
+				return true;
+			}
+
+			/// Multiples 1 to 8 of 256^i * B for every i, so a multiple of B takes 64 additions
+			struct base_table {
+				cached entries[32][8];
+				base_table() noexcept {
+					static const unsigned char base[32] = {
+						0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+						0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66
+					};
+					point p;
+					decode(p, base);
+					for (int i = 0; i < 32; i++) {
+						cached step;
+						to_cached(step, p);
+						point q = p;
+						for (int j = 0; j < 8; j++) {
+							to_cached(entries[i][j], q);
+							add(q, q, step);
+						}
+						for (int j = 0; j < 8; j++)
+							twice(p, p);
+					}
+				}
+			};
+			static const base_table& table() noexcept {
+				static const base_table t;
+				return t;
+			}
+			/// Split a scalar below 2^255 into 64 digits from -8 to 8, a = sum of e[i] * 16^i
+			static void recode(int* e, const unsigned char* a) noexcept {
+				for (int i = 0; i < 32; i++) {
+					e[2 * i] = a[i] & 15;
+					e[2 * i + 1] = (a[i] >> 4) & 15;
+				}
+				int c = 0;
+				for (int i = 0; i < 63; i++) {
+					e[i] += c;
+					c = (e[i] + 8) >> 4;
+					e[i] -= c * 16;
+				}
+				e[63] += c;
+			}
+			/// c = b * 256^pos * B, reading every entry of the row
+			static void lookup(cached& c, int pos, int b) noexcept {
+				const base_table& t = table();
+				const uint32_t negative = (uint32_t)b >> 31;
+				const uint32_t magnitude = (uint32_t)(b ^ -(int32_t)negative) + negative;
+				identity(c);
+				for (uint32_t j = 0; j < 8; j++)
+					select(c, t.entries[pos][j], (((magnitude ^ (j + 1)) - 1) >> 31) & 1);
+				cached minus;
+				negate(minus, c);
+				select(c, minus, negative);
+			}
+			/// h = a * B in constant time, a is 32 little endian bytes below 2^255
+			static void multiply_base(point& h, const unsigned char* a) noexcept {
+				int e[64];
+				recode(e, a);
+				cached c;
+				identity(h);
+				for (int i = 1; i < 64; i += 2) {
+					lookup(c, i / 2, e[i]);
+					add(h, h, c);
+				}
+				for (int i = 0; i < 4; i++)
+					twice(h, h);
+				for (int i = 0; i < 64; i += 2) {
+					lookup(c, i / 2, e[i]);
+					add(h, h, c);
+				}
+				mbedtls_platform_zeroize(e, sizeof(e));
+			}
+
+			/// Group order L = 2^252 + 27742317777372353535851937790883648493
+			static const uint64_t* order() noexcept {
+				static const uint64_t l[4] = { 0x5812631a5cf5d3ed, 0x14def9dea2f79cd6, 0, 0x1000000000000000 };
+				return l;
+			}
+			static void clamp(unsigned char* h) noexcept {
+				h[0] &= 248;
+				h[31] &= 127;
+				h[31] |= 64;
+			}
+			static void load_wide(uint64_t* x, const unsigned char* s) noexcept {
+				for (int i = 0; i < 8; i++)
+					x[i] = load64(s + 8 * i);
+			}
+			static void store_scalar(unsigned char* s, const uint64_t* x) noexcept {
+				for (int i = 0; i < 4; i++)
+					store64(s + 8 * i, x[i]);
+			}
+			/// Whether a little endian scalar is below L, only used for public values
+			static bool is_reduced(const unsigned char* s) noexcept {
+				const uint64_t* l = order();
+				for (int i = 3; i >= 0; i--) {
+					const uint64_t v = load64(s + 8 * i);
+					if (v != l[i])
+						return v < l[i];
+				}
+				return false;
 			}
 			/**
-			 * Returns the algorithm name provided to the constructor
-			 * \return Algorithmname
+			 * r = x mod L for a 512 bit x, one bit at a time with a masked subtraction so the time
+			 * does not depend on x. The top 252 bits are below L already.
 			 */
-			std::string name() const {
-				return _impl->alg_name;
+			static void reduce(uint64_t* r, const uint64_t* x) noexcept {
+				const uint64_t* l = order();
+				uint64_t r0 = (x[4] >> 4) | (x[5] << 60), r1 = (x[5] >> 4) | (x[6] << 60), r2 = (x[6] >> 4) | (x[7] << 60), r3 = x[7] >> 4;
+				for (int i = 259; i >= 0; i--) {
+					r3 = (r3 << 1) | (r2 >> 63);
+					r2 = (r2 << 1) | (r1 >> 63);
+					r1 = (r1 << 1) | (r0 >> 63);
+					r0 = (r0 << 1) | ((x[i / 64] >> (i % 64)) & 1);
+					uint64_t t[4];
+					uint64_t borrow = 0;
+					const uint64_t in[4] = { r0, r1, r2, r3 };
+					for (int j = 0; j < 4; j++) {
+						const uint64_t diff = in[j] - l[j];
+						const uint64_t under = in[j] < l[j] ? 1 : 0;
+						t[j] = diff - borrow;
+						borrow = under | (diff < borrow ? 1 : 0);
+					}
+					// Keep r if it was below L
+					const uint64_t keep = 0 - borrow;
+					r0 = (r0 & keep) | (t[0] & ~keep);
+					r1 = (r1 & keep) | (t[1] & ~keep);
+					r2 = (r2 & keep) | (t[2] & ~keep);
+					r3 = (r3 & keep) | (t[3] & ~keep);
+				}
+				r[0] = r0;
+				r[1] = r1;
+				r[2] = r2;
+				r[3] = r3;
+			}
+			/// r = a * b + c mod L
+			static void multiply_add(uint64_t* r, const uint64_t* a, const uint64_t* b, const uint64_t* c) noexcept {
+				uint64_t x[8] = { c[0], c[1], c[2], c[3], 0, 0, 0, 0 };
+				for (int i = 0; i < 4; i++) {
+					uint64_t high = 0;
+					for (int j = 0; j < 4; j++) {
+						wide t = mul64(a[i], b[j]);
+						t += x[i + j];
+						t += high;
+						x[i + j] = low(t);
+						high = shift(t, 64);
+					}
+					// Earlier rows only reached x[i + 3]
+					x[i + 4] = high;
+				}
+				reduce(r, x);
+				mbedtls_platform_zeroize(x, sizeof(x));
+			}
+
+			/// SHA-512 of up to three concatenated parts
+			static bool hash(unsigned char* out, const unsigned char* a, size_t a_len, const unsigned char* b, size_t b_len, const unsigned char* c, size_t c_len) noexcept {
+				mbedtls_sha512_context ctx;
+				mbedtls_sha512_init(&ctx);
+				const bool ok = mbedtls_sha512_starts_ret(&ctx, 0) == 0
+					&& mbedtls_sha512_update_ret(&ctx, a, a_len) == 0
+					&& (b_len == 0 || mbedtls_sha512_update_ret(&ctx, b, b_len) == 0)
+					&& (c_len == 0 || mbedtls_sha512_update_ret(&ctx, c, c_len) == 0)
+					&& mbedtls_sha512_finish_ret(&ctx, out) == 0;
+				mbedtls_sha512_free(&ctx);
+				return ok;
+			}
+		};
+
+		/// Streams signature data into an algorithm, defined next to signature_checker
+		template<typename T, typename = void>
+		struct stream_checker;
+	}
+
+	/**
+	 * Ed25519 backend based on the bundled implementation in details::ed25519, used unless another one is given.
+	 * Backends are passed as the ed25519_traits parameter of algorithm::basic_ed25519, for example to use
+	 * libsodium or a hardware module instead. A backend defines the same static functions, keys are the
+	 * 32 byte values of RFC 8032 and signatures are 64 bytes.
+	 */
+	struct ed25519_traits {
+		/**
+		 * Compute the public key of a private key
+		 * \param private_key 32 byte private key
+		 * \param public_key Receives the 32 byte public key
+		 * \return false on failure
+		 */
+		static bool derive_public_key(const unsigned char* private_key, unsigned char* public_key) noexcept {
+			return details::ed25519::public_key(private_key, public_key);
+		}
+		/**
+		 * Sign data
+		 * \param private_key 32 byte private key
+		 * \param public_key Public key belonging to private_key
+		 * \param data Data to sign
+		 * \param size Length of data
+		 * \param signature Receives the 64 byte signature
+		 * \return false on failure
+		 */
+		static bool sign(const unsigned char* private_key, const unsigned char* public_key, const unsigned char* data, size_t size, unsigned char* signature) noexcept {
+			return details::ed25519::sign(private_key, public_key, data, size, signature);
+		}
+		/**
+		 * Check a signature
+		 * \param public_key 32 byte public key
+		 * \param data Signed data
+		 * \param size Length of data
+		 * \param signature 64 byte signature
+		 * \return true if the signature is valid
+		 */
+		static bool verify(const unsigned char* public_key, const unsigned char* data, size_t size, const unsigned char* signature) noexcept {
+			return details::ed25519::verify(public_key, data, size, signature);
+		}
+	};
+
+	namespace algorithm {
+		/**
+		 * Incremental hash of the data to sign or verify, for input that is too large to hold in one
+		 * string or arrives in several buffers. Get one from start() of an algorithm, pass the data to
+		 * update() and finish it with the sign() or verify() overload of the same algorithm.
+		 * A stream can be finished once, afterwards it is no longer accepted by any algorithm.
+		 */
+		class digest_stream {
+		public:
+			digest_stream(digest_stream&&) = default;
+			digest_stream& operator=(digest_stream&&) = default;
+			~digest_stream() {
+				mbedtls_platform_zeroize(state, sizeof(state));
+				mbedtls_platform_zeroize(block, sizeof(block));
+			}
+
+			/**
+			 * Hash the next part of the data
+			 * \param data Data to add
+			 * \param size Length of data
+			 * \return *this to allow chaining
+			 */
+			digest_stream& update(const char* data, size_t size) {
+				switch (kind) {
+				case mode::discard: break;
+				case mode::collect: collected.append(data, size); break;
+				case mode::native: absorb(data, size); break;
+				default:
+					if (!failed && mbedtls_md_update(&ctx->ctx, (const unsigned char*)data, size) != 0)
+						failed = true;
+				}
+				return *this;
 			}
+#if JWT_HAS_STRING_VIEW
+			/// Hash the next part of the data
+			digest_stream& update(std::string_view data) { return update(data.data(), data.size()); }
+#else
+			/// Hash the next part of the data
+			digest_stream& update(const std::string& data) { return update(data.data(), data.size()); }
+#endif
 		private:
-			int raw2bn(mbedtls_mpi *x, const unsigned char *data, size_t size)
-			{
-				if (data[0] >= 0x80)
-				{
-					std::string temp(1, 0x00);
-					temp.append((const char*)data, size);
-					return mbedtls_mpi_read_binary(x, (const unsigned char*)temp.data(), temp.size());
+			friend struct none;
+			friend struct hmacsha;
+			friend struct rsa;
+			friend struct ecdsa;
+			friend struct pss;
+			template<typename, typename>
+			friend struct details::stream_checker;
+
+			enum class mode {
+				/// Data is ignored, used by none
+				discard,
+				/// Data is kept for algorithms that can only sign or verify a whole string
+				collect,
+				/// Plain hash
+				digest,
+				/// HMAC inner hash continued from the key schedule
+				hmac,
+				/// HMAC-SHA-256 inner hash computed by details::sha256
+				native
+			};
+			struct context {
+				mbedtls_md_context_t ctx;
+				context() { mbedtls_md_init(&ctx); }
+				~context() { mbedtls_md_free(&ctx); }
+				context(const context&) = delete;
+				context& operator=(const context&) = delete;
+			};
+
+			/**
+			 * \param kind How data is hashed
+			 * \param owner Key of the algorithm finishing the stream, kept alive until then
+			 */
+			digest_stream(mode kind, std::shared_ptr<const void> owner)
+				: kind(kind), owner(std::move(owner))
+			{}
+			/// Set up the digest context, cloned from start for HMAC streams. Errors show when finishing.
+			void setup(const mbedtls_md_info_t* md_info, const mbedtls_md_context_t* start) {
+				ctx.reset(new context());
+				if (mbedtls_md_setup(&ctx->ctx, md_info, 0) != 0
+					|| (start != nullptr ? mbedtls_md_clone(&ctx->ctx, start) : mbedtls_md_starts(&ctx->ctx)) != 0)
+					failed = true;
+			}
+			/**
+			 * Take the stream over for finishing if it was started by the algorithm with this key
+			 * \return false if it belongs to another key, failed or was already finished
+			 */
+			bool claim(const void* key) noexcept {
+				if (owner.get() != key || failed)
+					return false;
+				owner.reset();
+				return true;
+			}
+			/**
+			 * Finish a plain or HMAC inner hash
+			 * \param hash Output buffer of at least MBEDTLS_MD_MAX_SIZE bytes
+			 * \return Length of the hash or 0 on failure
+			 */
+			size_t finish(unsigned char* hash) noexcept {
+				if (mbedtls_md_finish(&ctx->ctx, hash) != 0)
+					return 0;
+				return mbedtls_md_get_size(ctx->ctx.md_info);
+			}
+			/// Compress whole blocks, keeping the rest in block
+			void absorb(const char* data, size_t size) noexcept {
+				const unsigned char* in = (const unsigned char*)data;
+				if (pending != 0) {
+					const size_t n = std::min(size, sizeof(block) - pending);
+					std::memcpy(block + pending, in, n);
+					pending += n;
+					in += n;
+					size -= n;
+					if (pending < sizeof(block))
+						return;
+					details::sha256::compress(state, block, 1);
+					absorbed += sizeof(block);
+					pending = 0;
 				}
-				return mbedtls_mpi_read_binary(x, data, size);
+				details::sha256::compress(state, in, size / 64);
+				absorbed += size - size % 64;
+				std::memcpy(block, in + size - size % 64, size % 64);
+				pending = size % 64;
 			}
+
+			mode kind;
+			std::shared_ptr<const void> owner;
+			bool failed = false;
+			std::unique_ptr<context> ctx;
+			std::string collected;
+			/// State of native streams after absorbed bytes, followed by pending bytes in block
+			uint32_t state[8];
+			unsigned char block[64];
+			size_t pending = 0;
+			size_t absorbed = 0;
 		};
 
-#if 0
 		/**
-		 * Base class for PSS-RSA family of algorithms
+		 * "none" algorithm.
+		 * 
+		 * Returns and empty signature and checks if the given signature is empty.
 		 */
-		struct pss {
+		struct none {
+			/// Return an empty string
+			std::string sign(const std::string&) const {
+				return "";
+			}
+			/// Check if the given signature is empty. JWT's with "none" algorithm should not contain a signature.
+			void verify(const std::string&, const std::string& signature) const {
+				if (!signature.empty())
+					throw signature_verification_exception();
+			}
+			/// Check if the given signature is empty, setting ec to failure::invalid_signature if not
+			void verify(const std::string&, const std::string& signature, std::error_code& ec) const noexcept {
+				ec = signature.empty() ? std::error_code() : make_error_code(failure::invalid_signature);
+			}
+			/// Start a stream that ignores the data
+			digest_stream start() const {
+				return digest_stream(digest_stream::mode::discard, nullptr);
+			}
+			/// Return an empty string
+			std::string sign(digest_stream&) const {
+				return "";
+			}
+			/// Check if the given signature is empty
+			void verify(digest_stream&, const std::string& signature) const {
+				if (!signature.empty())
+					throw signature_verification_exception();
+			}
+			/// Check if the given signature is empty, setting ec to failure::invalid_signature if not
+			void verify(digest_stream&, const std::string& signature, std::error_code& ec) const noexcept {
+				ec = signature.empty() ? std::error_code() : make_error_code(failure::invalid_signature);
+			}
+			/// Get algorithm name
+			std::string name() const {
+				return "none";
+			}
+		};
+		/**
+		 * Base class for HMAC family of algorithms
+		 */
+		struct hmacsha {
 			/**
-			 * Construct new pss algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
+			 * Construct new hmac algorithm
+			 * \param key Key to use for HMAC
 			 * \param md Pointer to hash function
 			 * \param name Name of the algorithm
 			 */
-			pss(const std::string& public_key, const std::string& private_key, const std::string& public_key_password, const std::string& private_key_password, const EVP_MD*(*md)(), const std::string& name)
-				: md(md), alg_name(name)
+			hmacsha(std::string key, const mbedtls_md_type_t md_type, const std::string& name)
+				: md_type(md_type), alg_name(name), schedule(std::make_shared<const key_schedule>(key, md_type))
 			{
-				std::unique_ptr<BIO, decltype(&BIO_free_all)> pubkey_bio(BIO_new(BIO_s_mem()), BIO_free_all);
-				if ((size_t)BIO_write(pubkey_bio.get(), public_key.data(), public_key.size()) != public_key.size())
-					throw rsa_exception("failed to load public key: bio_write failed");
-				pkey.reset(PEM_read_bio_PUBKEY(pubkey_bio.get(), nullptr, nullptr, (void*)public_key_password.c_str()), EVP_PKEY_free);
-				if (!pkey)
-					throw rsa_exception("failed to load public key: PEM_read_bio_PUBKEY failed");
-
-				if (!private_key.empty()) {
-					std::unique_ptr<BIO, decltype(&BIO_free_all)> privkey_bio(BIO_new(BIO_s_mem()), BIO_free_all);
-					if ((size_t)BIO_write(privkey_bio.get(), private_key.data(), private_key.size()) != private_key.size())
-						throw rsa_exception("failed to load private key: bio_write failed");
-					RSA* privkey = PEM_read_bio_RSAPrivateKey(privkey_bio.get(), nullptr, nullptr, (void*)private_key_password.c_str());
-					if (privkey == nullptr)
-						throw rsa_exception("failed to load private key: PEM_read_bio_RSAPrivateKey failed");
-					if (EVP_PKEY_assign_RSA(pkey.get(), privkey) == 0) {
-						RSA_free(privkey);
-						throw rsa_exception("failed to load private key: EVP_PKEY_assign_RSA failed");
-					}
-				}
+				mbedtls_platform_zeroize(&key[0], key.size());
 			}
 			/**
 			 * Sign jwt data
 			 * \param data The data to sign
-			 * \return ECDSA signature for the given data
+			 * \return HMAC signature for the given data
 			 * \throws signature_generation_exception
 			 */
 			std::string sign(const std::string& data) const {
-				auto hash = this->generate_hash(data);
-
-				std::unique_ptr<RSA, decltype(&RSA_free)> key(EVP_PKEY_get1_RSA(pkey.get()), RSA_free);
-				const int size = RSA_size(key.get());
-
-				std::string padded(size, 0x00);
-				if (!RSA_padding_add_PKCS1_PSS_mgf1(key.get(), (unsigned char*)padded.data(), (const unsigned char*)hash.data(), md(), md(), -1))  
-					throw signature_generation_exception("failed to create signature: RSA_padding_add_PKCS1_PSS_mgf1 failed");
-
-				std::string res(size, 0x00);
-				if (RSA_private_encrypt(size, (const unsigned char*)padded.data(), (unsigned char*)res.data(), key.get(), RSA_NO_PADDING) < 0)
-					throw signature_generation_exception("failed to create signature: RSA_private_encrypt failed");
-				return res;
+				unsigned char mac[MBEDTLS_MD_MAX_SIZE];
+				if (schedule->compute(data, mac) != 0)
+					throw signature_generation_exception();
+				return std::string((const char*)mac, schedule->size);
 			}
 			/**
 			 * Check if signature is valid
@@ -501,1042 +1726,6390 @@ namespace jwt {
 			 * \throws signature_verification_exception If the provided signature does not match
 			 */
 			void verify(const std::string& data, const std::string& signature) const {
-				auto hash = this->generate_hash(data);
-
-				std::unique_ptr<RSA, decltype(&RSA_free)> key(EVP_PKEY_get1_RSA(pkey.get()), RSA_free);
-				const int size = RSA_size(key.get());
-				
-				std::string sig(size, 0x00);
-				if(!RSA_public_decrypt(signature.size(), (const unsigned char*)signature.data(), (unsigned char*)sig.data(), key.get(), RSA_NO_PADDING))
-					throw signature_verification_exception("Invalid signature");
-				
-				if(!RSA_verify_PKCS1_PSS_mgf1(key.get(), (const unsigned char*)hash.data(), md(), md(), (const unsigned char*)sig.data(), -1))
-					throw signature_verification_exception("Invalid signature");
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception();
 			}
 			/**
-			 * Returns the algorithm name provided to the constructor
-			 * \return Algorithmname
+			 * Check if signature is valid without throwing
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match, cleared otherwise
 			 */
-			std::string name() const {
-				return alg_name;
+			void verify(const std::string& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char mac[MBEDTLS_MD_MAX_SIZE];
+				ec = make_error_code(failure::invalid_signature);
+				// The length is public, a wrong one is rejected without computing the mac
+				if (signature.size() != schedule->size || schedule->compute(data, mac) != 0)
+					return;
+				if (equal(mac, signature, schedule->size))
+					ec.clear();
 			}
-		private:
 			/**
-			 * Hash the provided data using the hash function specified in constructor
-			 * \param data Data to hash
-			 * \return Hash of data
+			 * Start hashing data to sign or verify in pieces
+			 * \return Stream to finish with sign(digest_stream&) or verify(digest_stream&, ...) of this algorithm
 			 */
-			std::string generate_hash(const std::string& data) const {
-#ifdef OPENSSL10
-				std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_destroy)> ctx(EVP_MD_CTX_create(), &EVP_MD_CTX_destroy);
-#else
-				std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
-#endif
-				if(EVP_DigestInit(ctx.get(), md()) == 0)
-					throw signature_generation_exception("EVP_DigestInit failed");
-				if(EVP_DigestUpdate(ctx.get(), data.data(), data.size()) == 0)
-					throw signature_generation_exception("EVP_DigestUpdate failed");
-				unsigned int len = 0;
-				std::string res;
-				res.resize(EVP_MD_CTX_size(ctx.get()));
-				if(EVP_DigestFinal(ctx.get(), (unsigned char*)res.data(), &len) == 0)
-					throw signature_generation_exception("EVP_DigestFinal failed");
-				res.resize(len);
-				return res;
+			digest_stream start() const {
+				digest_stream stream(schedule->native ? digest_stream::mode::native : digest_stream::mode::hmac, schedule);
+				if (schedule->native)
+					std::memcpy(stream.state, schedule->inner_state, sizeof(stream.state));
+				else
+					stream.setup(schedule->md_info, &schedule->inner);
+				return stream;
 			}
-			
-			/// OpenSSL structure containing keys
-			std::shared_ptr<EVP_PKEY> pkey;
-			/// Hash generator function
-			const EVP_MD*(*md)();
-			/// Algorithmname
-			const std::string alg_name;
-		};
-#endif
-
-		/**
-		 * HS256 algorithm
-		 */
-		struct hs256 : public hmacsha {
 			/**
-			 * Construct new instance of algorithm
-			 * \param key HMAC signing key
+			 * Sign the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \return HMAC signature for the data
+			 * \throws signature_generation_exception If the stream belongs to another key, was finished already or hashing failed
 			 */
-			explicit hs256(std::string key)
-				: hmacsha(std::move(key), MBEDTLS_MD_SHA256, "HS256")
-			{}
-		};
-		/**
-		 * HS384 algorithm
-		 */
-		struct hs384 : public hmacsha {
+			std::string sign(digest_stream& data) const {
+				unsigned char mac[MBEDTLS_MD_MAX_SIZE];
+				if (!finish(data, mac))
+					throw signature_generation_exception();
+				return std::string((const char*)mac, schedule->size);
+			}
 			/**
-			 * Construct new instance of algorithm
-			 * \param key HMAC signing key
+			 * Check if signature is valid for the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
 			 */
-			explicit hs384(std::string key)
-				: hmacsha(std::move(key), MBEDTLS_MD_SHA384, "HS384")
-			{}
-		};
-		/**
-		 * HS512 algorithm
-		 */
-		struct hs512 : public hmacsha {
+			void verify(digest_stream& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception();
+			}
 			/**
-			 * Construct new instance of algorithm
-			 * \param key HMAC signing key
+			 * Check if signature is valid for the data passed to a stream without throwing
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match or the stream is not usable, cleared otherwise
 			 */
-			explicit hs512(std::string key)
-				: hmacsha(std::move(key), MBEDTLS_MD_SHA512, "HS512")
-			{}
-		};
-#if 0
-		/**
-		 * RS256 algorithm
-		 */
-		struct rs256 : public rsa {
+			void verify(digest_stream& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char mac[MBEDTLS_MD_MAX_SIZE];
+				ec = make_error_code(failure::invalid_signature);
+				if (finish(data, mac) && signature.size() == schedule->size && equal(mac, signature, schedule->size))
+					ec.clear();
+			}
 			/**
-			 * Construct new instance of algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
+			 * Check several signatures at once without throwing.
+			 * HS256 messages are hashed together by the multi buffer code where the CPU has it,
+			 * other hash functions are checked one by one.
+			 * \param algs Algorithm of each signature, they may use different keys
+			 * \param data Data of each signature
+			 * \param signatures Signatures provided by the jwts
+			 * \param count Number of signatures
+			 * \param ec Receives one result per signature, failure::invalid_signature if it does not match
 			 */
-			rs256(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: rsa(public_key, private_key, public_key_password, private_key_password, EVP_sha256, "RS256")
-			{}
-		};
-		/**
-		 * RS384 algorithm
-		 */
-		struct rs384 : public rsa {
+			static void verify_batch(const hmacsha* const* algs, const std::string* const* data, const std::string* const* signatures, size_t count, std::error_code* ec) noexcept {
+				const uint32_t* inner[details::sha256::lanes];
+				const uint32_t* outer[details::sha256::lanes];
+				const unsigned char* messages[details::sha256::lanes];
+				size_t lengths[details::sha256::lanes];
+				size_t index[details::sha256::lanes];
+				unsigned char macs[32 * details::sha256::lanes];
+				size_t n = 0;
+				for (size_t i = 0; i <= count; i++) {
+					if (i < count) {
+						const key_schedule& s = *algs[i]->schedule;
+						if (!s.native || signatures[i]->size() != s.size) {
+							algs[i]->verify(*data[i], *signatures[i], ec[i]);
+							continue;
+						}
+						inner[n] = s.inner_state;
+						outer[n] = s.outer_state;
+						messages[n] = (const unsigned char*)data[i]->data();
+						lengths[n] = data[i]->size();
+						index[n++] = i;
+					}
+					if (n == 0 || (n < details::sha256::lanes && i < count))
+						continue;
+					details::sha256::hmac(inner, outer, messages, lengths, n, macs);
+					for (size_t j = 0; j < n; j++) {
+						if (equal(macs + 32 * j, *signatures[index[j]], 32))
+							ec[index[j]].clear();
+						else
+							ec[index[j]] = make_error_code(failure::invalid_signature);
+					}
+					n = 0;
+				}
+			}
 			/**
-			 * Construct new instance of algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
+			 * Returns the algorithm name provided to the constructor
+			 * \return Algorithmname
 			 */
-			rs384(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: rsa(public_key, private_key, public_key_password, private_key_password, EVP_sha384, "RS384")
-			{}
+			std::string name() const {
+				return alg_name;
+			}
+		private:
+			struct key_schedule;
+		public:
+			/**
+			 * Inner hash state after absorbing a fixed prefix of the data to sign.
+			 * Immutable once created, so one state can be shared between threads.
+			 */
+			class prefix_state {
+				friend struct hmacsha;
+				struct context {
+					mbedtls_md_context_t ctx;
+					context() { mbedtls_md_init(&ctx); }
+					~context() { mbedtls_md_free(&ctx); }
+					context(const context&) = delete;
+					context& operator=(const context&) = delete;
+				};
+				std::shared_ptr<const key_schedule> schedule;
+				std::shared_ptr<const context> inner;
+				std::string prefix;
+				/// SHA-256 state after the whole blocks of the prefix, used instead of inner if the schedule is native
+				uint32_t native_state[8];
+				size_t native_absorbed = 0;
+			};
+			/**
+			 * Hash a prefix shared by many tokens once
+			 * \param prefix Start of the data that will be signed
+			 * \return State to pass to sign(const prefix_state&, const std::string&)
+			 * \throws signature_generation_exception
+			 */
+			prefix_state prepare(const std::string& prefix) const {
+				prefix_state state;
+				state.schedule = schedule;
+				state.prefix = prefix;
+				if (schedule->native) {
+					state.native_absorbed = prefix.size() - prefix.size() % 64;
+					std::memcpy(state.native_state, schedule->inner_state, sizeof(state.native_state));
+					details::sha256::compress(state.native_state, (const unsigned char*)prefix.data(), prefix.size() / 64);
+					return state;
+				}
+				auto c = std::make_shared<prefix_state::context>();
+				if (mbedtls_md_setup(&c->ctx, schedule->md_info, 0) != 0
+					|| mbedtls_md_clone(&c->ctx, &schedule->inner) != 0
+					|| mbedtls_md_update(&c->ctx, (const unsigned char*)prefix.data(), prefix.size()) != 0)
+					throw signature_generation_exception();
+				state.inner = std::move(c);
+				return state;
+			}
+			/**
+			 * Sign jwt data starting with a prepared prefix, only the rest of the data is hashed
+			 * \param state State returned by prepare() of this algorithm
+			 * \param data The data to sign, including the prefix
+			 * \return HMAC signature for the given data
+			 * \throws signature_generation_exception If the state belongs to another key or data does not start with its prefix
+			 */
+			std::string sign(const prefix_state& state, const std::string& data) const {
+				if (state.schedule != schedule || data.compare(0, state.prefix.size(), state.prefix) != 0)
+					throw signature_generation_exception();
+				unsigned char mac[MBEDTLS_MD_MAX_SIZE];
+				if (schedule->native) {
+					const size_t offset = state.native_absorbed;
+					details::sha256::hmac(state.native_state, schedule->outer_state, (const unsigned char*)data.data() + offset, data.size() - offset, mac, offset);
+					return std::string((const char*)mac, schedule->size);
+				}
+				const size_t offset = state.prefix.size();
+				if (schedule->compute(state.inner->ctx, (const unsigned char*)data.data() + offset, data.size() - offset, mac) != 0)
+					throw signature_generation_exception();
+				return std::string((const char*)mac, schedule->size);
+			}
+		private:
+			/// Constant time compare of a mac and a signature of the same length
+			static bool equal(const unsigned char* mac, const std::string& signature, size_t size) noexcept {
+				unsigned char diff = 0;
+				for (size_t i = 0; i < size; i++)
+					diff |= mac[i] ^ (unsigned char)signature[i];
+				return diff == 0;
+			}
+			/// Compute the mac of a stream started by this algorithm, which can not be used afterwards
+			bool finish(digest_stream& data, unsigned char* mac) const noexcept {
+				if (!data.claim(schedule.get()))
+					return false;
+				if (data.kind == digest_stream::mode::native) {
+					details::sha256::hmac(data.state, schedule->outer_state, data.block, data.pending, mac, data.absorbed);
+					return true;
+				}
+				mbedtls_md_context_t* ctx = &data.ctx->ctx;
+				return data.finish(mac) != 0
+					&& mbedtls_md_clone(ctx, &schedule->outer) == 0
+					&& mbedtls_md_update(ctx, mac, schedule->size) == 0
+					&& mbedtls_md_finish(ctx, mac) == 0;
+			}
+
+			/**
+			 * Digest states after absorbing the key xor ipad and key xor opad blocks (RFC 2104).
+			 * Derived once per key and never modified afterwards, so it is shared between copies and threads.
+			 * Each operation clones the states into a thread local context, which avoids the setup
+			 * allocation and re-hashing the key on every call.
+			 * SHA-256 keeps the raw states as well and is computed by details::sha256 instead.
+			 */
+			struct key_schedule {
+				const mbedtls_md_info_t* md_info;
+				/// Length of the mac
+				size_t size;
+				mbedtls_md_context_t inner;
+				mbedtls_md_context_t outer;
+				/// Whether inner_state and outer_state are used instead of mbedtls
+				bool native = false;
+				uint32_t inner_state[8];
+				uint32_t outer_state[8];
+
+				key_schedule(const std::string& key, mbedtls_md_type_t md_type)
+					: md_info(mbedtls_md_info_from_type(md_type)), size(0)
+				{
+					mbedtls_md_init(&inner);
+					mbedtls_md_init(&outer);
+					const size_t block_size = get_block_size(md_type);
+					if (md_info == nullptr || block_size == 0)
+						throw std::invalid_argument("unsupported hash function");
+					size = mbedtls_md_get_size(md_info);
+
+					unsigned char sum[MBEDTLS_MD_MAX_SIZE];
+					const unsigned char* k = (const unsigned char*)key.data();
+					size_t key_len = key.size();
+					if (key_len > block_size) {
+						mbedtls_md(md_info, k, key_len, sum);
+						k = sum;
+						key_len = size;
+					}
+					unsigned char ipad[128];
+					unsigned char opad[128];
+					std::memset(ipad, 0x36, block_size);
+					std::memset(opad, 0x5C, block_size);
+					for (size_t i = 0; i < key_len; i++) {
+						ipad[i] ^= k[i];
+						opad[i] ^= k[i];
+					}
+					const bool ok = mbedtls_md_setup(&inner, md_info, 0) == 0
+						&& mbedtls_md_setup(&outer, md_info, 0) == 0
+						&& mbedtls_md_starts(&inner) == 0
+						&& mbedtls_md_update(&inner, ipad, block_size) == 0
+						&& mbedtls_md_starts(&outer) == 0
+						&& mbedtls_md_update(&outer, opad, block_size) == 0;
+					if (ok && md_type == MBEDTLS_MD_SHA256) {
+						details::sha256::init(inner_state);
+						details::sha256::compress(inner_state, ipad, 1);
+						details::sha256::init(outer_state);
+						details::sha256::compress(outer_state, opad, 1);
+						native = true;
+					}
+					mbedtls_platform_zeroize(sum, sizeof(sum));
+					mbedtls_platform_zeroize(ipad, sizeof(ipad));
+					mbedtls_platform_zeroize(opad, sizeof(opad));
+					if (!ok) {
+						mbedtls_md_free(&inner);
+						mbedtls_md_free(&outer);
+						throw std::runtime_error("failed to set up hmac");
+					}
+				}
+				~key_schedule() {
+					mbedtls_md_free(&inner);
+					mbedtls_md_free(&outer);
+					mbedtls_platform_zeroize(inner_state, sizeof(inner_state));
+					mbedtls_platform_zeroize(outer_state, sizeof(outer_state));
+				}
+				key_schedule(const key_schedule&) = delete;
+				key_schedule& operator=(const key_schedule&) = delete;
+
+				/**
+				 * Compute the mac of data
+				 * \param data Data to authenticate
+				 * \param mac Output buffer of at least size bytes
+				 * \return 0 on success, an mbedtls error code otherwise
+				 */
+				int compute(const std::string& data, unsigned char* mac) const {
+					if (native) {
+						details::sha256::hmac(inner_state, outer_state, (const unsigned char*)data.data(), data.size(), mac);
+						return 0;
+					}
+					return compute(inner, (const unsigned char*)data.data(), data.size(), mac);
+				}
+				/**
+				 * Compute the mac of data, continuing from an inner state that already absorbed part of it
+				 * \param start Inner state to continue from
+				 * \param data Remaining data to authenticate
+				 * \param len Length of data
+				 * \param mac Output buffer of at least size bytes
+				 * \return 0 on success, an mbedtls error code otherwise
+				 */
+				int compute(const mbedtls_md_context_t& start, const unsigned char* data, size_t len, unsigned char* mac) const {
+					mbedtls_md_context_t* ctx = thread_context(md_info);
+					if (ctx == nullptr)
+						return -1;
+					int rc;
+					if ((rc = mbedtls_md_clone(ctx, &start)) != 0
+						|| (rc = mbedtls_md_update(ctx, data, len)) != 0
+						|| (rc = mbedtls_md_finish(ctx, mac)) != 0
+						|| (rc = mbedtls_md_clone(ctx, &outer)) != 0
+						|| (rc = mbedtls_md_update(ctx, mac, size)) != 0
+						|| (rc = mbedtls_md_finish(ctx, mac)) != 0)
+						return rc;
+					return 0;
+				}
+
+				static size_t get_block_size(mbedtls_md_type_t md_type) {
+					switch (md_type) {
+					case MBEDTLS_MD_MD5:
+					case MBEDTLS_MD_SHA1:
+					case MBEDTLS_MD_SHA224:
+					case MBEDTLS_MD_SHA256:
+					case MBEDTLS_MD_RIPEMD160:
+						return 64;
+					case MBEDTLS_MD_SHA384:
+					case MBEDTLS_MD_SHA512:
+						return 128;
+					default:
+						return 0;
+					}
+				}
+
+				/**
+				 * Get this thread's working context for a hash function, set up on first use
+				 */
+				static mbedtls_md_context_t* thread_context(const mbedtls_md_info_t* md_info) {
+					struct context {
+						mbedtls_md_context_t ctx;
+						context() { mbedtls_md_init(&ctx); }
+						~context() { mbedtls_md_free(&ctx); }
+						context(const context&) = delete;
+						context& operator=(const context&) = delete;
+					};
+					thread_local std::vector<std::pair<const mbedtls_md_info_t*, std::unique_ptr<context>>> contexts;
+					for (auto& e : contexts) {
+						if (e.first == md_info)
+							return &e.second->ctx;
+					}
+					std::unique_ptr<context> c(new context());
+					if (mbedtls_md_setup(&c->ctx, md_info, 0) != 0)
+						return nullptr;
+					contexts.emplace_back(md_info, std::move(c));
+					return &contexts.back().second->ctx;
+				}
+			};
+
+			/// HMAC hash generator
+			const mbedtls_md_type_t md_type;
+			/// Algorithmname
+			const std::string alg_name;
+			/// Precomputed HMAC state
+			std::shared_ptr<const key_schedule> schedule;
 		};
 		/**
-		 * RS512 algorithm
+		 * Parse a PEM, DER or JWK (RFC 7517) encoded key.
+		 * JWKs are limited to public RSA and EC keys.
+		 * \param ctx Initialized context receiving the key
+		 * \param password Password of a private key, nullptr to parse a public key
+		 * \return 0 on success, an mbedtls error code otherwise
 		 */
-		struct rs512 : public rsa {
+		inline int parse_key(mbedtls_pk_context* ctx, const std::string& key, const std::string* password) {
+			const size_t start = key.find_first_not_of(" \t\r\n");
+			if (start != std::string::npos && key[start] == '{') {
+				picojson::value val;
+				if (password != nullptr || !picojson::parse(val, key).empty() || !val.is<picojson::object>())
+					return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+				const picojson::object& obj = val.get<picojson::object>();
+				auto member = [&obj](const char* name, std::string& out) {
+					auto it = obj.find(name);
+					return it != obj.end() && it->second.is<std::string>()
+						&& base::try_decode_into<alphabet::base64url_unpadded>(it->second.get<std::string>(), out) && !out.empty();
+				};
+				auto kty = obj.find("kty");
+				if (kty == obj.end() || !kty->second.is<std::string>())
+					return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+				std::string a, b;
+				if (kty->second.get<std::string>() == "RSA") {
+					if (!member("n", a) || !member("e", b))
+						return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+					int rc = mbedtls_pk_setup(ctx, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA));
+					if (rc == 0)
+						rc = mbedtls_rsa_import_raw(mbedtls_pk_rsa(*ctx), (const unsigned char*)a.data(), a.size(), nullptr, 0, nullptr, 0, nullptr, 0, (const unsigned char*)b.data(), b.size());
+					if (rc == 0)
+						rc = mbedtls_rsa_complete(mbedtls_pk_rsa(*ctx));
+					if (rc == 0)
+						rc = mbedtls_rsa_check_pubkey(mbedtls_pk_rsa(*ctx));
+					return rc;
+				}
+				if (kty->second.get<std::string>() == "EC") {
+					auto crv = obj.find("crv");
+					const std::string curve = crv != obj.end() && crv->second.is<std::string>() ? crv->second.get<std::string>() : "";
+					const mbedtls_ecp_group_id id = curve == "P-256" ? MBEDTLS_ECP_DP_SECP256R1 : curve == "P-384" ? MBEDTLS_ECP_DP_SECP384R1 : curve == "P-521" ? MBEDTLS_ECP_DP_SECP521R1 : MBEDTLS_ECP_DP_NONE;
+					if (id == MBEDTLS_ECP_DP_NONE || !member("x", a) || !member("y", b))
+						return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+					int rc = mbedtls_pk_setup(ctx, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY));
+					mbedtls_ecp_keypair* kp = rc == 0 ? mbedtls_pk_ec(*ctx) : nullptr;
+					if (rc == 0)
+						rc = mbedtls_ecp_group_load(&kp->grp, id);
+					if (rc == 0 && (a.size() != (kp->grp.pbits + 7) / 8 || b.size() != a.size()))
+						rc = MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+					if (rc == 0)
+						rc = mbedtls_mpi_read_binary(&kp->Q.X, (const unsigned char*)a.data(), a.size());
+					if (rc == 0)
+						rc = mbedtls_mpi_read_binary(&kp->Q.Y, (const unsigned char*)b.data(), b.size());
+					if (rc == 0)
+						rc = mbedtls_mpi_lset(&kp->Q.Z, 1);
+					if (rc == 0)
+						rc = mbedtls_ecp_check_pubkey(&kp->grp, &kp->Q);
+					return rc;
+				}
+				return MBEDTLS_ERR_PK_UNKNOWN_PK_ALG;
+			}
+			// mbedtls expects the terminating null to be part of PEM input
+			const size_t len = key.size() + (key.find("-----BEGIN") != std::string::npos ? 1 : 0);
+			if (password == nullptr)
+				return mbedtls_pk_parse_public_key(ctx, (const unsigned char*)key.c_str(), len);
+			return mbedtls_pk_parse_key(ctx, (const unsigned char*)key.c_str(), len,
+				password->empty() ? nullptr : (const unsigned char*)password->data(), password->size());
+		}
+
+		/**
+		 * Parse an Ed25519 key (RFC 8410, RFC 8037)
+		 * \param key Key in PEM, DER or JWK format or its 32 raw bytes
+		 * \param is_private Whether key is a private key (PKCS#8, JWK with d) or a public key (SubjectPublicKeyInfo, JWK with x)
+		 * \param raw Receives the 32 byte key
+		 * \return false if the key is invalid
+		 */
+		inline bool parse_ed25519_key(const std::string& key, bool is_private, unsigned char* raw) {
+			if (key.size() == 32) {
+				std::memcpy(raw, key.data(), 32);
+				return true;
+			}
+			std::string der;
+			const size_t start = key.find_first_not_of(" \t\r\n");
+			const size_t begin = key.find("-----BEGIN");
+			bool ok;
+			if (start != std::string::npos && key[start] == '{') {
+				picojson::value val;
+				if (!picojson::parse(val, key).empty() || !val.is<picojson::object>())
+					return false;
+				const picojson::object& obj = val.get<picojson::object>();
+				auto member = [&obj](const char* name) -> const picojson::value* {
+					auto it = obj.find(name);
+					return it != obj.end() && it->second.is<std::string>() ? &it->second : nullptr;
+				};
+				const picojson::value* kty = member("kty");
+				const picojson::value* crv = member("crv");
+				const picojson::value* value = member(is_private ? "d" : "x");
+				ok = kty && crv && value && kty->get<std::string>() == "OKP" && crv->get<std::string>() == "Ed25519"
+					&& base::try_decode_into<alphabet::base64url_unpadded>(value->get<std::string>(), der) && der.size() == 32;
+				if (ok)
+					std::memcpy(raw, der.data(), 32);
+			}
+			else {
+				if (begin != std::string::npos) {
+					const size_t body = key.find('\n', begin);
+					const size_t end = key.find("-----END", begin);
+					if (body == std::string::npos || end == std::string::npos || end < body)
+						return false;
+					std::string text;
+					for (size_t i = body; i < end; i++) {
+						if (key[i] != ' ' && key[i] != '\t' && key[i] != '\r' && key[i] != '\n')
+							text += key[i];
+					}
+					if (!base::try_decode_into<alphabet::base64>(text, der))
+						return false;
+				}
+				else
+					der = key;
+				// Fixed prefixes with the id-Ed25519 OID 1.3.101.112
+				static const unsigned char spki[] = { 0x30, 0x2a, 0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70, 0x03, 0x21, 0x00 };
+				static const unsigned char pkcs8[] = { 0x30, 0x2e, 0x02, 0x01, 0x00, 0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70, 0x04, 0x22, 0x04, 0x20 };
+				const unsigned char* prefix = is_private ? pkcs8 : spki;
+				const size_t prefix_len = is_private ? sizeof(pkcs8) : sizeof(spki);
+				ok = der.size() == prefix_len + 32 && std::memcmp(der.data(), prefix, prefix_len) == 0;
+				if (ok)
+					std::memcpy(raw, der.data() + prefix_len, 32);
+			}
+			if (!der.empty())
+				mbedtls_platform_zeroize(&der[0], der.size());
+			return ok;
+		}
+
+		/**
+		 * Base class for RSA family of algorithms
+		 */
+		struct rsa {
 			/**
-			 * Construct new instance of algorithm
-			 * \param public_key RSA public key in PEM format
+			 * Key material shared by all copies of an RSA or PSS algorithm instance.
+			 * The public key is not modified after construction, so any number of threads can verify
+			 * concurrently. Private key operations update the blinding values of the context they run on,
+			 * so every signer borrows a context of its own from a pool.
+			 */
+			struct impl {
+				/// Copy of the private key owned by a single signer at a time
+				struct private_context {
+					mbedtls_rsa_context rsa_ctx;
+					private_context(int padding, mbedtls_md_type_t md_type) { mbedtls_rsa_init(&rsa_ctx, padding, md_type); }
+					~private_context() { mbedtls_rsa_free(&rsa_ctx); }
+					private_context(const private_context&) = delete;
+					private_context& operator=(const private_context&) = delete;
+				};
+
+				mbedtls_md_type_t md_type;
+				const mbedtls_md_info_t* md_info;
+				/// MBEDTLS_RSA_PKCS_V15 or MBEDTLS_RSA_PKCS_V21
+				int padding;
+				/// Parsed private key, empty if only verification is possible
+				mbedtls_pk_context private_key;
+				/// Modulus
+				mbedtls_mpi N;
+				/// Public exponent
+				mbedtls_mpi E;
+				/// Montgomery constant for N, computed once so verification only reads it
+				mbedtls_mpi RN;
+				/// Length of the modulus and of every signature in bytes
+				size_t key_size;
+				/// Length of the modulus in bits
+				size_t key_bits;
+
+				/// Algorithmname
+				const std::string alg_name;
+
+				impl(const std::string& public_key, const std::string& private_key, const std::string& private_key_password, mbedtls_md_type_t md_type, int padding, const std::string& name)
+					: md_type(md_type), md_info(mbedtls_md_info_from_type(md_type)), padding(padding), key_size(0), key_bits(0), alg_name(name)
+				{
+					mbedtls_pk_init(&this->private_key);
+					mbedtls_mpi_init(&N);
+					mbedtls_mpi_init(&E);
+					mbedtls_mpi_init(&RN);
+					if (md_info == nullptr || digest_info_prefix(md_type, nullptr) == 0) {
+						release();
+						throw rsa_exception("unsupported hash function");
+					}
+
+					mbedtls_pk_context pub;
+					mbedtls_pk_init(&pub);
+					if (parse_key(&pub, public_key, nullptr) != 0 || !mbedtls_pk_can_do(&pub, MBEDTLS_PK_RSA)) {
+						mbedtls_pk_free(&pub);
+						release();
+						throw rsa_exception("failed to load public key");
+					}
+					if (!private_key.empty()) {
+						if (parse_key(&this->private_key, private_key, &private_key_password) != 0 || !mbedtls_pk_can_do(&this->private_key, MBEDTLS_PK_RSA)) {
+							mbedtls_pk_free(&pub);
+							release();
+							throw rsa_exception("failed to load private key");
+						}
+						if (mbedtls_pk_check_pair(&pub, &this->private_key) != 0) {
+							mbedtls_pk_free(&pub);
+							release();
+							throw rsa_exception("failed to load private key: does not match public key");
+						}
+					}
+					int rc = mbedtls_rsa_export(mbedtls_pk_rsa(pub), &N, nullptr, nullptr, nullptr, &E);
+					mbedtls_pk_free(&pub);
+
+					// The first exponentiation fills in RN. Do it now instead of racing on it later.
+					mbedtls_mpi one;
+					mbedtls_mpi_init(&one);
+					if (rc == 0)
+						rc = mbedtls_mpi_lset(&one, 1);
+					if (rc == 0)
+						rc = mbedtls_mpi_exp_mod(&one, &one, &E, &N, &RN);
+					mbedtls_mpi_free(&one);
+					if (rc != 0) {
+						release();
+						throw rsa_exception("failed to load public key: invalid key");
+					}
+					key_bits = mbedtls_mpi_bitlen(&N);
+					key_size = mbedtls_mpi_size(&N);
+				}
+
+				~impl() {
+					release();
+				}
+
+				impl(const impl&) = delete;
+				impl& operator=(const impl&) = delete;
+
+				/**
+				 * Get the key object for these parameters from key_cache, parsing the keys if no algorithm uses them yet
+				 */
+				static std::shared_ptr<impl> load(const std::string& public_key, const std::string& private_key, const std::string& private_key_password, mbedtls_md_type_t md_type, int padding, const std::string& name) {
+					key_cache::id_builder id;
+					id.add("rsa").add(md_type).add(padding).add(name).add(public_key).add(private_key).add(private_key_password);
+					return key_cache::instance().get<impl>(id.finish(), [&]() {
+						return std::make_shared<impl>(public_key, private_key, private_key_password, md_type, padding, name);
+					});
+				}
+
+				/**
+				 * Hash data with the hash function of this algorithm
+				 * \param hash Output buffer of at least MBEDTLS_MD_MAX_SIZE bytes
+				 * \return Length of the hash or 0 on failure
+				 */
+				size_t digest(const std::string& data, unsigned char* hash) const {
+					if (mbedtls_md(md_info, (const unsigned char*)data.data(), data.size(), hash) != 0)
+						return 0;
+					return mbedtls_md_get_size(md_info);
+				}
+
+				/**
+				 * RSA public key operation on the shared key
+				 * \param out Output buffer of key_size bytes
+				 * \return true on success
+				 */
+				bool public_op(const std::string& signature, unsigned char* out) const {
+					if (signature.size() != key_size)
+						return false;
+					mbedtls_mpi T;
+					mbedtls_mpi_init(&T);
+					int rc = mbedtls_mpi_read_binary(&T, (const unsigned char*)signature.data(), signature.size());
+					if (rc == 0 && mbedtls_mpi_cmp_mpi(&T, &N) >= 0)
+						rc = -1;
+					// RN is set, so mbedtls_mpi_exp_mod only reads it
+					if (rc == 0)
+						rc = mbedtls_mpi_exp_mod(&T, &T, &E, &N, const_cast<mbedtls_mpi*>(&RN));
+					if (rc == 0)
+						rc = mbedtls_mpi_write_binary(&T, out, key_size);
+					mbedtls_mpi_free(&T);
+					return rc == 0;
+				}
+
+				/**
+				 * Check an EMSA-PKCS1-v1_5 encoded message (RFC 8017 9.2) against a hash
+				 */
+				bool check_pkcs1_v15(const unsigned char* em, const unsigned char* hash, size_t hash_len) const {
+					const unsigned char* prefix;
+					const size_t prefix_len = digest_info_prefix(md_type, &prefix);
+					const size_t t_len = prefix_len + hash_len;
+					if (key_size < t_len + 11)
+						return false;
+					const size_t ps_end = key_size - t_len - 1;
+					unsigned char diff = em[0] | (em[1] ^ 0x01) | em[ps_end];
+					for (size_t i = 2; i < ps_end; i++)
+						diff |= em[i] ^ 0xff;
+					for (size_t i = 0; i < prefix_len; i++)
+						diff |= em[ps_end + 1 + i] ^ prefix[i];
+					for (size_t i = 0; i < hash_len; i++)
+						diff |= em[ps_end + 1 + prefix_len + i] ^ hash[i];
+					return diff == 0;
+				}
+
+				/**
+				 * Check an EMSA-PSS encoded message (RFC 8017 9.1.2) against a hash.
+				 * MGF1 uses the same hash function and the salt is as long as the hash, as RFC 7518 requires.
+				 */
+				bool check_pss(const unsigned char* em_full, const unsigned char* hash, size_t hash_len) const {
+					const size_t em_bits = key_bits - 1;
+					const size_t em_len = (em_bits + 7) / 8;
+					const unsigned char* em = em_full + (key_size - em_len);
+					if (key_size != em_len && em_full[0] != 0)
+						return false;
+					const size_t salt_len = hash_len;
+					if (em_len < hash_len + salt_len + 2 || em[em_len - 1] != 0xbc)
+						return false;
+					const size_t db_len = em_len - hash_len - 1;
+					const unsigned char* h = em + db_len;
+					const unsigned char top_mask = (unsigned char)(0xff >> (8 * em_len - em_bits));
+					if ((em[0] & ~top_mask) != 0)
+						return false;
+
+					unsigned char db[MBEDTLS_MPI_MAX_SIZE];
+					unsigned char block[MBEDTLS_MD_MAX_SIZE + 4];
+					unsigned char mask[MBEDTLS_MD_MAX_SIZE];
+					memcpy(block, h, hash_len);
+					for (size_t done = 0, counter = 0; done < db_len; counter++) {
+						block[hash_len] = (unsigned char)(counter >> 24);
+						block[hash_len + 1] = (unsigned char)(counter >> 16);
+						block[hash_len + 2] = (unsigned char)(counter >> 8);
+						block[hash_len + 3] = (unsigned char)counter;
+						if (mbedtls_md(md_info, block, hash_len + 4, mask) != 0)
+							return false;
+						for (size_t i = 0; i < hash_len && done < db_len; i++, done++)
+							db[done] = em[done] ^ mask[i];
+					}
+					db[0] &= top_mask;
+
+					const size_t ps_len = db_len - salt_len - 1;
+					unsigned char diff = db[ps_len] ^ 0x01;
+					for (size_t i = 0; i < ps_len; i++)
+						diff |= db[i];
+					if (diff != 0)
+						return false;
+
+					unsigned char m[8 + 2 * MBEDTLS_MD_MAX_SIZE];
+					memset(m, 0, 8);
+					memcpy(m + 8, hash, hash_len);
+					memcpy(m + 8 + hash_len, db + db_len - salt_len, salt_len);
+					if (mbedtls_md(md_info, m, 8 + hash_len + salt_len, mask) != 0)
+						return false;
+					diff = 0;
+					for (size_t i = 0; i < hash_len; i++)
+						diff |= h[i] ^ mask[i];
+					return diff == 0;
+				}
+
+				/**
+				 * Borrow a private key context, creating one if all are in use
+				 * \throws signature_generation_exception If no private key was provided
+				 */
+				std::unique_ptr<private_context> acquire() {
+					if (mbedtls_pk_get_type(&private_key) == MBEDTLS_PK_NONE)
+						throw signature_generation_exception("failed to create signature: no private key");
+					{
+						std::lock_guard<std::mutex> lock(pool_mutex);
+						if (!pool.empty()) {
+							std::unique_ptr<private_context> ctx = std::move(pool.back());
+							pool.pop_back();
+							return ctx;
+						}
+					}
+					std::unique_ptr<private_context> ctx(new private_context(padding, md_type));
+					if (mbedtls_rsa_copy(&ctx->rsa_ctx, mbedtls_pk_rsa(private_key)) != 0)
+						throw signature_generation_exception("failed to create signature: could not copy key");
+					mbedtls_rsa_set_padding(&ctx->rsa_ctx, padding, md_type);
+					return ctx;
+				}
+
+				/// Return a context borrowed with acquire
+				void give_back(std::unique_ptr<private_context> ctx) {
+					std::lock_guard<std::mutex> lock(pool_mutex);
+					pool.push_back(std::move(ctx));
+				}
+
+			private:
+				std::mutex pool_mutex;
+				std::vector<std::unique_ptr<private_context>> pool;
+
+				void release() {
+					mbedtls_pk_free(&private_key);
+					mbedtls_mpi_free(&N);
+					mbedtls_mpi_free(&E);
+					mbedtls_mpi_free(&RN);
+				}
+
+				/**
+				 * DER encoded DigestInfo header for a hash function (RFC 8017 9.2)
+				 * \return Length of the header, 0 if the hash function is not supported
+				 */
+				static size_t digest_info_prefix(mbedtls_md_type_t md_type, const unsigned char** prefix) {
+					static const unsigned char sha256[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 };
+					static const unsigned char sha384[] = { 0x30, 0x41, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02, 0x05, 0x00, 0x04, 0x30 };
+					static const unsigned char sha512[] = { 0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04, 0x40 };
+					const unsigned char* res;
+					switch (md_type) {
+					case MBEDTLS_MD_SHA256: res = sha256; break;
+					case MBEDTLS_MD_SHA384: res = sha384; break;
+					case MBEDTLS_MD_SHA512: res = sha512; break;
+					default: return 0;
+					}
+					if (prefix != nullptr)
+						*prefix = res;
+					return sizeof(sha256);
+				}
+			};
+
+			/**
+			 * Construct new rsa algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
 			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 * \param md_type Hash function
+			 * \param name Name of the algorithm
 			 */
-			rs512(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: rsa(public_key, private_key, public_key_password, private_key_password, EVP_sha512, "RS512")
-			{}
+			rsa(const std::string& public_key, const std::string& private_key, const std::string& /*public_key_password*/, const std::string& private_key_password, const mbedtls_md_type_t md_type, const std::string& name)
+				: _impl(impl::load(public_key, private_key, private_key_password, md_type, MBEDTLS_RSA_PKCS_V15, name))
+			{
+			}
+			/**
+			 * Sign jwt data
+			 * \param data The data to sign
+			 * \return RSA signature for the given data
+			 * \throws signature_generation_exception
+			 */
+			std::string sign(const std::string& data) const {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				return sign_hash(hash, _impl->digest(data, hash));
+			}
+			/**
+			 * Check if signature is valid
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(const std::string& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid without throwing
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match, cleared otherwise
+			 */
+			void verify(const std::string& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				// The length check in public_op comes too late to skip hashing
+				verify_hash(hash, signature.size() == _impl->key_size ? _impl->digest(data, hash) : 0, signature, ec);
+			}
+			/**
+			 * Start hashing data to sign or verify in pieces
+			 * \return Stream to finish with sign(digest_stream&) or verify(digest_stream&, ...) of this algorithm
+			 */
+			digest_stream start() const {
+				digest_stream stream(digest_stream::mode::digest, _impl);
+				stream.setup(_impl->md_info, nullptr);
+				return stream;
+			}
+			/**
+			 * Sign the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \return RSA signature for the data
+			 * \throws signature_generation_exception If the stream belongs to another key, was finished already or signing failed
+			 */
+			std::string sign(digest_stream& data) const {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				return sign_hash(hash, data.claim(_impl.get()) ? data.finish(hash) : 0);
+			}
+			/**
+			 * Check if signature is valid for the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(digest_stream& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid for the data passed to a stream without throwing
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match or the stream is not usable, cleared otherwise
+			 */
+			void verify(digest_stream& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				verify_hash(hash, data.claim(_impl.get()) ? data.finish(hash) : 0, signature, ec);
+			}
+			/**
+			 * Returns the algorithm name provided to the constructor
+			 * \return Algorithmname
+			 */
+			std::string name() const {
+				return _impl->alg_name;
+			}
+		private:
+			/// Sign a hash of the data, hash_len 0 means hashing failed
+			std::string sign_hash(const unsigned char* hash, size_t hash_len) const {
+				if (hash_len == 0)
+					throw signature_generation_exception("failed to create signature: could not hash data");
+				std::string res(_impl->key_size, '\0');
+				std::unique_ptr<impl::private_context> ctx = _impl->acquire();
+				random& rnd = random::thread_instance();
+				int rc = mbedtls_rsa_pkcs1_sign(&ctx->rsa_ctx, rnd.static_random, rnd.random_context(), MBEDTLS_RSA_PRIVATE, _impl->md_type, (unsigned int)hash_len, hash, (unsigned char*)&res[0]);
+				_impl->give_back(std::move(ctx));
+				if (rc != 0)
+					throw signature_generation_exception();
+				return res;
+			}
+			/// Check a signature against a hash of the data, hash_len 0 means hashing failed
+			void verify_hash(const unsigned char* hash, size_t hash_len, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char em[MBEDTLS_MPI_MAX_SIZE];
+				if (hash_len == 0 || !_impl->public_op(signature, em) || !_impl->check_pkcs1_v15(em, hash, hash_len))
+					ec = make_error_code(failure::invalid_signature);
+				else
+					ec.clear();
+			}
+
+			std::shared_ptr<impl> _impl;
 		};
-#endif
 		/**
-		 * ES256 algorithm
+		 * Base class for ECDSA family of algorithms
 		 */
-		struct es256 : public ecdsa {
-#if 0
+		struct ecdsa {
 			/**
-			 * Construct new instance of algorithm
-			 * \param public_key ECDSA public key in PEM format
-			 * \param private_key ECDSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
+			 * Key material shared by all copies of an algorithm instance.
+			 * It is not modified after construction, so copies can sign and verify concurrently.
 			 */
-			es256(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: ecdsa(public_key, private_key, public_key_password, private_key_password, EVP_sha256, "ES256")
-			{}
-#endif
-			es256(const mbedtls_ecp_keypair *keypair)
-				: ecdsa(keypair, MBEDTLS_MD_SHA256, "ES256")
-			{}
-		};
+			struct impl {
+				mbedtls_md_type_t md_type;
+				mbedtls_ecdsa_context ecdsa_ctx;
+				/// Length of r and s in the signature
+				size_t key_size;
+				/// Copy of the curve with the public key as its base point, so mbedtls caches a comb table for Q
+				mbedtls_ecp_group q_grp;
+				/// Whether q_grp is set up and verify uses it
+				bool precomputed;
+
+				/// Algorithmname
+				const std::string alg_name;
+
+				impl(const mbedtls_ecp_keypair *keypair, const mbedtls_md_type_t md_type, const std::string& name, bool precompute)
+					: md_type(md_type), key_size(0), precomputed(false), alg_name(name)
+				{
+					mbedtls_ecdsa_init(&ecdsa_ctx);
+					mbedtls_ecp_group_init(&q_grp);
+					if (mbedtls_ecdsa_from_keypair(&ecdsa_ctx, keypair) != 0) {
+						release();
+						throw ecdsa_exception("failed to load key");
+					}
+					setup(precompute);
+				}
+
+				impl(const std::string& public_key, const std::string& private_key, const std::string& private_key_password, const mbedtls_md_type_t md_type, const std::string& name, bool precompute)
+					: md_type(md_type), key_size(0), precomputed(false), alg_name(name)
+				{
+					mbedtls_ecdsa_init(&ecdsa_ctx);
+					mbedtls_ecp_group_init(&q_grp);
+					mbedtls_pk_context pub;
+					mbedtls_pk_context priv;
+					mbedtls_pk_init(&pub);
+					mbedtls_pk_init(&priv);
+					const char* error = nullptr;
+					if (parse_key(&pub, public_key, nullptr) != 0 || !mbedtls_pk_can_do(&pub, MBEDTLS_PK_ECKEY))
+						error = "failed to load public key";
+					else if (!private_key.empty() && (parse_key(&priv, private_key, &private_key_password) != 0 || !mbedtls_pk_can_do(&priv, MBEDTLS_PK_ECKEY)))
+						error = "failed to load private key";
+					else if (!private_key.empty() && mbedtls_pk_check_pair(&pub, &priv) != 0)
+						error = "failed to load private key: does not match public key";
+					else if (mbedtls_ecdsa_from_keypair(&ecdsa_ctx, mbedtls_pk_ec(private_key.empty() ? pub : priv)) != 0)
+						error = "failed to load key";
+					mbedtls_pk_free(&pub);
+					mbedtls_pk_free(&priv);
+					if (error != nullptr) {
+						release();
+						throw ecdsa_exception(error);
+					}
+					setup(precompute);
+				}
+
+				~impl() {
+					release();
+				}
+
+				impl(const impl&) = delete;
+				impl& operator=(const impl&) = delete;
+
+				/**
+				 * Get the key object for these parameters from key_cache, parsing the keys if no algorithm uses them yet
+				 */
+				static std::shared_ptr<impl> load(const std::string& public_key, const std::string& private_key, const std::string& private_key_password, const mbedtls_md_type_t md_type, const std::string& name, bool precompute) {
+					key_cache::id_builder id;
+					id.add("ecdsa").add(md_type).add(name).add(precompute ? 1 : 0).add(public_key).add(private_key).add(private_key_password);
+					return key_cache::instance().get<impl>(id.finish(), [&]() {
+						return std::make_shared<impl>(public_key, private_key, private_key_password, md_type, name, precompute);
+					});
+				}
+
+				/**
+				 * ECDSA verification (SEC1 4.1.4) computing u2*Q with the cached table in q_grp
+				 * \return 0 if the signature is valid, an mbedtls error code otherwise
+				 */
+				int verify_precomputed(const unsigned char* hash, size_t hash_len, const mbedtls_mpi* r, const mbedtls_mpi* s) {
+					mbedtls_ecp_group& grp = ecdsa_ctx.grp;
+					if (mbedtls_mpi_cmp_int(r, 1) < 0 || mbedtls_mpi_cmp_mpi(r, &grp.N) >= 0
+						|| mbedtls_mpi_cmp_int(s, 1) < 0 || mbedtls_mpi_cmp_mpi(s, &grp.N) >= 0)
+						return MBEDTLS_ERR_ECP_VERIFY_FAILED;
+
+					mbedtls_mpi e, s_inv, u1, u2, one;
+					mbedtls_ecp_point R, R1, R2;
+					mbedtls_mpi_init(&e);
+					mbedtls_mpi_init(&s_inv);
+					mbedtls_mpi_init(&u1);
+					mbedtls_mpi_init(&u2);
+					mbedtls_mpi_init(&one);
+					mbedtls_ecp_point_init(&R);
+					mbedtls_ecp_point_init(&R1);
+					mbedtls_ecp_point_init(&R2);
+
+					random& rnd = random::thread_instance();
+					int rc = read_hash(&e, grp, hash, hash_len);
+					if (rc == 0)
+						rc = mbedtls_mpi_inv_mod(&s_inv, s, &grp.N);
+					if (rc == 0)
+						rc = mbedtls_mpi_mul_mpi(&u1, &e, &s_inv);
+					if (rc == 0)
+						rc = mbedtls_mpi_mod_mpi(&u1, &u1, &grp.N);
+					if (rc == 0)
+						rc = mbedtls_mpi_mul_mpi(&u2, r, &s_inv);
+					if (rc == 0)
+						rc = mbedtls_mpi_mod_mpi(&u2, &u2, &grp.N);
+					if (rc == 0)
+						rc = mbedtls_ecp_mul(&q_grp, &R2, &u2, &q_grp.G, rnd.static_random, rnd.random_context());
+					if (rc == 0 && mbedtls_mpi_cmp_int(&u1, 0) == 0) {
+						rc = mbedtls_ecp_copy(&R, &R2);
+					}
+					else if (rc == 0) {
+						rc = mbedtls_ecp_mul(&grp, &R1, &u1, &grp.G, rnd.static_random, rnd.random_context());
+						if (rc == 0)
+							rc = mbedtls_mpi_lset(&one, 1);
+						if (rc == 0)
+							rc = mbedtls_ecp_muladd(&grp, &R, &one, &R1, &one, &R2);
+					}
+					if (rc == 0 && mbedtls_ecp_is_zero(&R))
+						rc = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+					if (rc == 0)
+						rc = mbedtls_mpi_mod_mpi(&R.X, &R.X, &grp.N);
+					if (rc == 0 && mbedtls_mpi_cmp_mpi(&R.X, r) != 0)
+						rc = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+
+					mbedtls_mpi_free(&e);
+					mbedtls_mpi_free(&s_inv);
+					mbedtls_mpi_free(&u1);
+					mbedtls_mpi_free(&u2);
+					mbedtls_mpi_free(&one);
+					mbedtls_ecp_point_free(&R);
+					mbedtls_ecp_point_free(&R1);
+					mbedtls_ecp_point_free(&R2);
+					return rc;
+				}
+
+				/**
+				 * ECDSA signing (SEC1 4.1.3) with a nonce computed ahead of time, s = k^-1 * (e + r * d)
+				 * \param k_inv Inverse of the nonce mod N
+				 * \param r (k * G).x mod N
+				 * \return 0 on success, an mbedtls error code otherwise
+				 */
+				int sign_with_nonce(const unsigned char* hash, size_t hash_len, const mbedtls_mpi* k_inv, const mbedtls_mpi* r, mbedtls_mpi* s) {
+					const mbedtls_ecp_group& grp = ecdsa_ctx.grp;
+					mbedtls_mpi e;
+					mbedtls_mpi_init(&e);
+					int rc = read_hash(&e, grp, hash, hash_len);
+					if (rc == 0)
+						rc = mbedtls_mpi_mul_mpi(s, r, &ecdsa_ctx.d);
+					if (rc == 0)
+						rc = mbedtls_mpi_add_mpi(s, s, &e);
+					if (rc == 0)
+						rc = mbedtls_mpi_mul_mpi(s, s, k_inv);
+					if (rc == 0)
+						rc = mbedtls_mpi_mod_mpi(s, s, &grp.N);
+					if (rc == 0 && mbedtls_mpi_cmp_int(s, 0) == 0)
+						rc = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+					mbedtls_mpi_free(&e);
+					return rc;
+				}
+
+			private:
+				/// Leftmost nbits of the hash, reduced mod N
+				static int read_hash(mbedtls_mpi* e, const mbedtls_ecp_group& grp, const unsigned char* hash, size_t hash_len) {
+					const size_t n_size = (grp.nbits + 7) / 8;
+					const size_t use_size = hash_len > n_size ? n_size : hash_len;
+					int rc = mbedtls_mpi_read_binary(e, hash, use_size);
+					if (rc == 0 && use_size * 8 > grp.nbits)
+						rc = mbedtls_mpi_shift_r(e, use_size * 8 - grp.nbits);
+					if (rc == 0 && mbedtls_mpi_cmp_mpi(e, &grp.N) >= 0)
+						rc = mbedtls_mpi_sub_mpi(e, e, &grp.N);
+					return rc;
+				}
+
+				/// Build the comb tables for the key in ecdsa_ctx, releases and throws on failure
+				void setup(bool precompute) {
+					key_size = (ecdsa_ctx.grp.pbits + 7) / 8;
+
+					// Older mbedtls versions build the comb table for G on the first multiplication
+					// and store it in the group. Do that now instead of racing on it later.
+					if (build_comb_table(&ecdsa_ctx.grp) != 0) {
+						release();
+						throw ecdsa_exception("failed to load key: invalid curve");
+					}
+
+					if (precompute) {
+						// mbedtls keeps the comb table of whatever point is the group's base point.
+						// Load a fresh copy of the curve and make Q its base point. A loaded group references
+						// static data for G and possibly for its table, so drop those references instead of freeing them.
+						int rc = mbedtls_ecp_group_load(&q_grp, ecdsa_ctx.grp.id);
+						if (rc == 0) {
+							q_grp.T = nullptr;
+							q_grp.T_size = 0;
+							mbedtls_ecp_point_init(&q_grp.G);
+							rc = mbedtls_ecp_copy(&q_grp.G, &ecdsa_ctx.Q);
+						}
+						if (rc == 0)
+							rc = build_comb_table(&q_grp);
+						if (rc != 0) {
+							release();
+							throw ecdsa_exception("failed to load key: invalid public key");
+						}
+						precomputed = true;
+					}
+				}
+
+				void release() {
+					mbedtls_ecdsa_free(&ecdsa_ctx);
+					// mbedtls_ecp_group_free leaves the curve parameters alone for groups loaded from static
+					// data (h == 1), but q_grp.G was allocated by us
+					if (q_grp.h == 1)
+						mbedtls_ecp_point_free(&q_grp.G);
+					mbedtls_ecp_group_free(&q_grp);
+				}
+
+				/// Multiply the base point once so the group caches its comb table
+				static int build_comb_table(mbedtls_ecp_group* grp) {
+					mbedtls_ecp_point R;
+					mbedtls_mpi one;
+					mbedtls_ecp_point_init(&R);
+					mbedtls_mpi_init(&one);
+					random& rnd = random::thread_instance();
+					int rc = mbedtls_mpi_lset(&one, 1);
+					if (rc == 0)
+						rc = mbedtls_ecp_mul(grp, &R, &one, &grp->G, rnd.static_random, rnd.random_context());
+					mbedtls_ecp_point_free(&R);
+					mbedtls_mpi_free(&one);
+					return rc;
+				}
+			};
+
+			/**
+			 * Signing nonces computed ahead of time by a background thread.
+			 * An entry is k^-1 mod N and r = (k * G).x mod N for a fresh random k, so signing with it
+			 * only takes the multiplications for s. Entries wait in a lock free queue, each is handed out
+			 * once and freed after use. Whatever is left is wiped when the pool is destroyed.
+			 * k comes from an HMAC_DRBG seeded by the mbedtls entropy sources, with the private key
+			 * and the time as personalization so a weak entropy source alone does not make k predictable.
+			 */
+			class nonce_pool {
+			public:
+				struct nonce {
+					mbedtls_mpi k_inv;
+					mbedtls_mpi r;
+					nonce() {
+						mbedtls_mpi_init(&k_inv);
+						mbedtls_mpi_init(&r);
+					}
+					~nonce() {
+						mbedtls_mpi_free(&k_inv);
+						mbedtls_mpi_free(&r);
+					}
+					nonce(const nonce&) = delete;
+					nonce& operator=(const nonce&) = delete;
+				};
+
+				/**
+				 * Start filling a pool for a key
+				 * \param key Key the nonces are for, it must contain the private key
+				 * \param capacity Number of nonces kept ready, rounded up to a power of two
+				 * \throws ecdsa_exception If the random generator cannot be seeded
+				 */
+				nonce_pool(std::shared_ptr<impl> key, size_t capacity)
+					: key(std::move(key))
+				{
+					size_t size = 2;
+					while (size < capacity)
+						size *= 2;
+					mask = size - 1;
+					slots.reset(new slot[size]);
+					for (size_t i = 0; i < size; i++)
+						slots[i].sequence.store(i, std::memory_order_relaxed);
+
+					mbedtls_entropy_init(&entropy);
+					mbedtls_hmac_drbg_init(&drbg);
+					unsigned char personalization[MBEDTLS_ECP_MAX_BYTES + sizeof(int64_t)];
+					const size_t d_size = mbedtls_mpi_size(&this->key->ecdsa_ctx.d);
+					int rc = mbedtls_mpi_write_binary(&this->key->ecdsa_ctx.d, personalization, d_size);
+					const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+					std::memcpy(personalization + d_size, &now, sizeof(now));
+					if (rc == 0)
+						rc = mbedtls_hmac_drbg_seed(&drbg, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), mbedtls_entropy_func, &entropy, personalization, d_size + sizeof(now));
+					mbedtls_platform_zeroize(personalization, sizeof(personalization));
+					if (rc != 0) {
+						mbedtls_hmac_drbg_free(&drbg);
+						mbedtls_entropy_free(&entropy);
+						throw ecdsa_exception("failed to seed nonce generator");
+					}
+					try {
+						worker = std::thread(&nonce_pool::fill, this);
+					}
+					catch (...) {
+						mbedtls_hmac_drbg_free(&drbg);
+						mbedtls_entropy_free(&entropy);
+						throw;
+					}
+				}
+				~nonce_pool() {
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						stopping = true;
+					}
+					wake.notify_one();
+					worker.join();
+					while (nonce* n = pop())
+						delete n;
+					mbedtls_hmac_drbg_free(&drbg);
+					mbedtls_entropy_free(&entropy);
+				}
+				nonce_pool(const nonce_pool&) = delete;
+				nonce_pool& operator=(const nonce_pool&) = delete;
+
+				/// Take a nonce, nullptr if the pool is empty. Wakes the background thread once half of the pool is used.
+				std::unique_ptr<nonce> take() {
+					std::unique_ptr<nonce> n(pop());
+					if (idle.load(std::memory_order_acquire) && size() <= mask / 2) {
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							idle.store(false, std::memory_order_relaxed);
+						}
+						wake.notify_one();
+					}
+					return n;
+				}
+				/// Number of nonces ready
+				size_t size() const noexcept {
+					const size_t head = next_pop.load(std::memory_order_acquire);
+					const size_t tail = next_push.load(std::memory_order_acquire);
+					return tail > head ? tail - head : 0;
+				}
+				/// Key the nonces are for
+				const impl* owner() const noexcept {
+					return key.get();
+				}
+
+			private:
+				/// Bounded queue cell, sequence tells whether it is ready for the push or the pop at a position
+				struct slot {
+					std::atomic<size_t> sequence;
+					nonce* value;
+				};
+
+				bool push(nonce* n) {
+					size_t pos = next_push.load(std::memory_order_relaxed);
+					for (;;) {
+						slot& s = slots[pos & mask];
+						const size_t seq = s.sequence.load(std::memory_order_acquire);
+						if (seq == pos) {
+							if (next_push.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+								break;
+						}
+						else if (seq < pos)
+							return false;
+						else
+							pos = next_push.load(std::memory_order_relaxed);
+					}
+					slot& s = slots[pos & mask];
+					s.value = n;
+					s.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+				nonce* pop() {
+					size_t pos = next_pop.load(std::memory_order_relaxed);
+					for (;;) {
+						slot& s = slots[pos & mask];
+						const size_t seq = s.sequence.load(std::memory_order_acquire);
+						if (seq == pos + 1) {
+							if (next_pop.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+								break;
+						}
+						else if (seq < pos + 1)
+							return nullptr;
+						else
+							pos = next_pop.load(std::memory_order_relaxed);
+					}
+					slot& s = slots[pos & mask];
+					nonce* n = s.value;
+					s.sequence.store(pos + mask + 1, std::memory_order_release);
+					return n;
+				}
+
+				/// Background thread, refills the pool when take() finds it half empty and tops it up when idle
+				void fill() {
+					std::unique_lock<std::mutex> lock(mutex);
+					while (!stopping) {
+						lock.unlock();
+						while (size() <= mask) {
+							std::unique_ptr<nonce> n(new nonce());
+							// A failure leaves the pool as it is, sign then computes its nonce inline
+							if (generate(*n) != 0 || !push(n.get()))
+								break;
+							n.release();
+							std::lock_guard<std::mutex> check(mutex);
+							if (stopping)
+								break;
+						}
+						lock.lock();
+						idle.store(true, std::memory_order_release);
+						// The timeout tops the pool up even if a wake up from take() was missed
+						wake.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+							return stopping || !idle.load(std::memory_order_relaxed) || size() <= mask / 2;
+						});
+					}
+				}
+
+				/// Random scalar in [1, N - 1]
+				int random_scalar(mbedtls_mpi* x) {
+					const mbedtls_ecp_group& grp = key->ecdsa_ctx.grp;
+					const size_t n_size = (grp.nbits + 7) / 8;
+					unsigned char buf[MBEDTLS_ECP_MAX_BYTES];
+					int rc;
+					for (int tries = 0; tries < 32; tries++) {
+						if ((rc = mbedtls_hmac_drbg_random(&drbg, buf, n_size)) != 0)
+							break;
+						if (grp.nbits % 8 != 0)
+							buf[0] &= (unsigned char)((1u << (grp.nbits % 8)) - 1);
+						if ((rc = mbedtls_mpi_read_binary(x, buf, n_size)) != 0)
+							break;
+						if (mbedtls_mpi_cmp_int(x, 1) >= 0 && mbedtls_mpi_cmp_mpi(x, &grp.N) < 0)
+							break;
+						rc = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+					}
+					mbedtls_platform_zeroize(buf, sizeof(buf));
+					return rc;
+				}
+
+				/// Compute r and k^-1, the inversion is blinded by a random t as (k * t)^-1 * t
+				int generate(nonce& n) {
+					mbedtls_ecp_group& grp = key->ecdsa_ctx.grp;
+					mbedtls_mpi k;
+					mbedtls_mpi t;
+					mbedtls_ecp_point R;
+					mbedtls_mpi_init(&k);
+					mbedtls_mpi_init(&t);
+					mbedtls_ecp_point_init(&R);
+					int rc;
+					do {
+						rc = random_scalar(&k);
+						if (rc == 0)
+							rc = mbedtls_ecp_mul(&grp, &R, &k, &grp.G, mbedtls_hmac_drbg_random, &drbg);
+						if (rc == 0)
+							rc = mbedtls_mpi_mod_mpi(&n.r, &R.X, &grp.N);
+					} while (rc == 0 && mbedtls_mpi_cmp_int(&n.r, 0) == 0);
+					if (rc == 0)
+						rc = random_scalar(&t);
+					if (rc == 0)
+						rc = mbedtls_mpi_mul_mpi(&k, &k, &t);
+					if (rc == 0)
+						rc = mbedtls_mpi_mod_mpi(&k, &k, &grp.N);
+					if (rc == 0)
+						rc = mbedtls_mpi_inv_mod(&n.k_inv, &k, &grp.N);
+					if (rc == 0)
+						rc = mbedtls_mpi_mul_mpi(&n.k_inv, &n.k_inv, &t);
+					if (rc == 0)
+						rc = mbedtls_mpi_mod_mpi(&n.k_inv, &n.k_inv, &grp.N);
+					mbedtls_mpi_free(&k);
+					mbedtls_mpi_free(&t);
+					mbedtls_ecp_point_free(&R);
+					return rc;
+				}
+
+				std::shared_ptr<impl> key;
+				std::unique_ptr<slot[]> slots;
+				size_t mask;
+				std::atomic<size_t> next_push{ 0 };
+				std::atomic<size_t> next_pop{ 0 };
+				/// Only used by the background thread
+				mbedtls_entropy_context entropy;
+				mbedtls_hmac_drbg_context drbg;
+				std::mutex mutex;
+				std::condition_variable wake;
+				bool stopping = false;
+				/// Whether the background thread waits for take() to wake it
+				std::atomic<bool> idle{ false };
+				std::thread worker;
+			};
+
+			std::shared_ptr<impl> _impl;
+			/// Nonces for sign, nullptr unless with_nonce_pool was called
+			std::shared_ptr<nonce_pool> nonces;
+
+			/**
+			 * Construct new ecdsa algorithm
+			 * \param keypair Key to use, only the public part is needed for verification
+			 * \param md_type Hash function
+			 * \param name Name of the algorithm
+			 * \param precompute_public_key Keep a precomputed table for the public key, trading memory for faster verification
+			 */
+			ecdsa(const mbedtls_ecp_keypair *keypair, const mbedtls_md_type_t md_type, const std::string& name, bool precompute_public_key = false) : 
+				_impl(new impl(keypair, md_type, name, precompute_public_key))
+			{
+			}
+			/**
+			 * Construct new ecdsa algorithm.
+			 * Keys are parsed once and shared with every other algorithm constructed from the same keys, see key_cache.
+			 * \param public_key ECDSA public key in PEM, DER or JWK format
+			 * \param private_key ECDSA private key in PEM or DER format or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 * \param md_type Hash function
+			 * \param name Name of the algorithm
+			 * \param precompute_public_key Keep a precomputed table for the public key, trading memory for faster verification
+			 */
+			ecdsa(const std::string& public_key, const std::string& private_key, const std::string& /*public_key_password*/, const std::string& private_key_password, const mbedtls_md_type_t md_type, const std::string& name, bool precompute_public_key = false)
+				: _impl(impl::load(public_key, private_key, private_key_password, md_type, name, precompute_public_key))
+			{
+			}
+
+			/**
+			 * Precompute signing nonces on a background thread, see nonce_pool.
+			 * sign() then takes a random nonce from the pool instead of computing k * G while the caller
+			 * waits. It falls back to the deterministic nonce of RFC 6979 whenever the pool is empty.
+			 * The pool belongs to the current key, copies made afterwards share it and it is stopped
+			 * and wiped once the last of them is gone or gets another key assigned.
+			 * \param capacity Number of nonces kept ready, rounded up to a power of two
+			 * \return *this to allow chaining
+			 * \throws ecdsa_exception If there is no private key
+			 */
+			ecdsa& with_nonce_pool(size_t capacity = 64) {
+				if (mbedtls_mpi_cmp_int(&_impl->ecdsa_ctx.d, 0) == 0)
+					throw ecdsa_exception("nonce pool needs a private key");
+				nonces = std::make_shared<nonce_pool>(_impl, capacity);
+				return *this;
+			}
+			/// Number of precomputed nonces ready for sign(), 0 without a nonce pool
+			size_t pooled_nonces() const noexcept {
+				return nonces ? nonces->size() : 0;
+			}
+
+			/**
+			 * Sign jwt data
+			 * The nonce is derived deterministically from the key and hash (RFC 6979), so signing
+			 * needs no shared random state and copies can sign in parallel.
+			 * With a nonce pool a precomputed random nonce is used instead while there is one.
+			 * \param data The data to sign
+			 * \return ECDSA signature for the given data
+			 * \throws signature_generation_exception
+			 */
+			std::string sign(const std::string& data) const {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				const mbedtls_md_info_t* md_info = mbedtls_md_info_from_type(_impl->md_type);
+				if (mbedtls_md(md_info, (const unsigned char*)data.data(), data.size(), hash) != 0)
+					throw signature_generation_exception();
+				return sign_hash(hash, mbedtls_md_get_size(md_info));
+			}
+			/**
+			 * Check if signature is valid
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(const std::string& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid without throwing
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match, cleared otherwise
+			 */
+			void verify(const std::string& data, const std::string& signature, std::error_code& ec) const noexcept {
+				ec = make_error_code(failure::invalid_signature);
+				if (signature.size() != _impl->key_size * 2)
+					return;
+				const mbedtls_md_info_t* md_info = mbedtls_md_info_from_type(_impl->md_type);
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				if (mbedtls_md(md_info, (const unsigned char*)data.data(), data.size(), hash) != 0)
+					return;
+				verify_hash(hash, mbedtls_md_get_size(md_info), signature, ec);
+			}
+			/**
+			 * Start hashing data to sign or verify in pieces
+			 * \return Stream to finish with sign(digest_stream&) or verify(digest_stream&, ...) of this algorithm
+			 */
+			digest_stream start() const {
+				digest_stream stream(digest_stream::mode::digest, _impl);
+				stream.setup(mbedtls_md_info_from_type(_impl->md_type), nullptr);
+				return stream;
+			}
+			/**
+			 * Sign the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \return ECDSA signature for the data
+			 * \throws signature_generation_exception If the stream belongs to another key, was finished already or signing failed
+			 */
+			std::string sign(digest_stream& data) const {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				const size_t hash_len = data.claim(_impl.get()) ? data.finish(hash) : 0;
+				if (hash_len == 0)
+					throw signature_generation_exception();
+				return sign_hash(hash, hash_len);
+			}
+			/**
+			 * Check if signature is valid for the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(digest_stream& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid for the data passed to a stream without throwing
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match or the stream is not usable, cleared otherwise
+			 */
+			void verify(digest_stream& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				ec = make_error_code(failure::invalid_signature);
+				const size_t hash_len = data.claim(_impl.get()) ? data.finish(hash) : 0;
+				if (hash_len != 0)
+					verify_hash(hash, hash_len, signature, ec);
+			}
+			/**
+			 * Returns the algorithm name provided to the constructor
+			 * \return Algorithmname
+			 */
+			std::string name() const {
+				return _impl->alg_name;
+			}
+		private:
+			/// Sign a hash of the data
+			std::string sign_hash(const unsigned char* hash, size_t hash_len) const {
+				mbedtls_mpi r;
+				mbedtls_mpi s;
+				mbedtls_mpi_init(&r);
+				mbedtls_mpi_init(&s);
+				std::unique_ptr<nonce_pool::nonce> nonce;
+				if (nonces && nonces->owner() == _impl.get())
+					nonce = nonces->take();
+				int rc = -1;
+				if (nonce) {
+					rc = _impl->sign_with_nonce(hash, hash_len, &nonce->k_inv, &nonce->r, &s);
+					if (rc == 0)
+						rc = mbedtls_mpi_copy(&r, &nonce->r);
+					// Used exactly once, even if signing failed
+					nonce.reset();
+				}
+				if (rc != 0) {
+#if MBEDTLS_VERSION_NUMBER >= 0x02140000
+					// Blinding only, the per thread generator keeps this free of shared state
+					random& rnd = random::thread_instance();
+					rc = mbedtls_ecdsa_sign_det_ext(&_impl->ecdsa_ctx.grp, &r, &s, &_impl->ecdsa_ctx.d, hash, hash_len, _impl->md_type, rnd.static_random, rnd.random_context());
+#else
+					rc = mbedtls_ecdsa_sign_det(&_impl->ecdsa_ctx.grp, &r, &s, &_impl->ecdsa_ctx.d, hash, hash_len, _impl->md_type);
+#endif
+				}
+				std::string sig(_impl->key_size * 2, '\0');
+				if (rc == 0)
+					rc = mbedtls_mpi_write_binary(&r, (unsigned char*)&sig[0], _impl->key_size);
+				if (rc == 0)
+					rc = mbedtls_mpi_write_binary(&s, (unsigned char*)&sig[_impl->key_size], _impl->key_size);
+
+				mbedtls_mpi_free(&r);
+				mbedtls_mpi_free(&s);
+
+				if (rc != 0)
+					throw signature_generation_exception();
+				return sig;
+			}
+			/// Check a signature against a hash of the data
+			void verify_hash(const unsigned char* hash, size_t hash_len, const std::string& signature, std::error_code& ec) const noexcept {
+				ec = make_error_code(failure::invalid_signature);
+				if (signature.size() != _impl->key_size * 2)
+					return;
+				int ret_read_sign;
+				mbedtls_mpi r;
+				mbedtls_mpi s;
+
+				mbedtls_mpi_init(&r);
+				mbedtls_mpi_init(&s);
+				const unsigned char* raw = (const unsigned char*)signature.data();
+				ret_read_sign = mbedtls_mpi_read_binary(&r, raw, _impl->key_size);
+				if (ret_read_sign == 0)
+					ret_read_sign = mbedtls_mpi_read_binary(&s, raw + _impl->key_size, _impl->key_size);
+
+				if (ret_read_sign == 0 && _impl->precomputed)
+					ret_read_sign = _impl->verify_precomputed(hash, hash_len, &r, &s);
+				else if (ret_read_sign == 0)
+					ret_read_sign = mbedtls_ecdsa_verify(&_impl->ecdsa_ctx.grp, hash, hash_len, &_impl->ecdsa_ctx.Q, &r, &s);
+
+				mbedtls_mpi_free(&r);
+				mbedtls_mpi_free(&s);
+
+				if (ret_read_sign == 0)
+					ec.clear();
+			}
+		};
+
+		/**
+		 * Base class for PSS-RSA family of algorithms
+		 */
+		struct pss {
+			/**
+			 * Construct new pss algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 * \param md_type Hash function
+			 * \param name Name of the algorithm
+			 */
+			pss(const std::string& public_key, const std::string& private_key, const std::string& /*public_key_password*/, const std::string& private_key_password, const mbedtls_md_type_t md_type, const std::string& name)
+				: _impl(rsa::impl::load(public_key, private_key, private_key_password, md_type, MBEDTLS_RSA_PKCS_V21, name))
+			{
+			}
+			/**
+			 * Sign jwt data
+			 * \param data The data to sign
+			 * \return PSS signature for the given data
+			 * \throws signature_generation_exception
+			 */
+			std::string sign(const std::string& data) const {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				return sign_hash(hash, _impl->digest(data, hash));
+			}
+			/**
+			 * Check if signature is valid
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(const std::string& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid without throwing
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match, cleared otherwise
+			 */
+			void verify(const std::string& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				// The length check in public_op comes too late to skip hashing
+				verify_hash(hash, signature.size() == _impl->key_size ? _impl->digest(data, hash) : 0, signature, ec);
+			}
+			/**
+			 * Start hashing data to sign or verify in pieces
+			 * \return Stream to finish with sign(digest_stream&) or verify(digest_stream&, ...) of this algorithm
+			 */
+			digest_stream start() const {
+				digest_stream stream(digest_stream::mode::digest, _impl);
+				stream.setup(_impl->md_info, nullptr);
+				return stream;
+			}
+			/**
+			 * Sign the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \return PSS signature for the data
+			 * \throws signature_generation_exception If the stream belongs to another key, was finished already or signing failed
+			 */
+			std::string sign(digest_stream& data) const {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				return sign_hash(hash, data.claim(_impl.get()) ? data.finish(hash) : 0);
+			}
+			/**
+			 * Check if signature is valid for the data passed to a stream
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(digest_stream& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid for the data passed to a stream without throwing
+			 * \param data Stream returned by start() of this algorithm
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match or the stream is not usable, cleared otherwise
+			 */
+			void verify(digest_stream& data, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+				verify_hash(hash, data.claim(_impl.get()) ? data.finish(hash) : 0, signature, ec);
+			}
+			/**
+			 * Returns the algorithm name provided to the constructor
+			 * \return Algorithmname
+			 */
+			std::string name() const {
+				return _impl->alg_name;
+			}
+		private:
+			/// Sign a hash of the data, hash_len 0 means hashing failed
+			std::string sign_hash(const unsigned char* hash, size_t hash_len) const {
+				if (hash_len == 0)
+					throw signature_generation_exception("failed to create signature: could not hash data");
+				std::string res(_impl->key_size, '\0');
+				std::unique_ptr<rsa::impl::private_context> ctx = _impl->acquire();
+				random& rnd = random::thread_instance();
+				// mbedtls uses a salt as long as the hash, MGF1 uses the hash set on the context
+				int rc = mbedtls_rsa_rsassa_pss_sign(&ctx->rsa_ctx, rnd.static_random, rnd.random_context(), MBEDTLS_RSA_PRIVATE, _impl->md_type, (unsigned int)hash_len, hash, (unsigned char*)&res[0]);
+				_impl->give_back(std::move(ctx));
+				if (rc != 0)
+					throw signature_generation_exception();
+				return res;
+			}
+			/// Check a signature against a hash of the data, hash_len 0 means hashing failed
+			void verify_hash(const unsigned char* hash, size_t hash_len, const std::string& signature, std::error_code& ec) const noexcept {
+				unsigned char em[MBEDTLS_MPI_MAX_SIZE];
+				if (hash_len == 0 || !_impl->public_op(signature, em) || !_impl->check_pss(em, hash, hash_len))
+					ec = make_error_code(failure::invalid_signature);
+				else
+					ec.clear();
+			}
+
+			std::shared_ptr<rsa::impl> _impl;
+		};
+
+		/**
+		 * EdDSA with Ed25519 (RFC 8037), signs and verifies several times faster than ECDSA or RSA.
+		 * Signatures are deterministic and need no random state, so copies can sign and verify concurrently.
+		 * \tparam ed25519_traits Implementation of the curve, see jwt::ed25519_traits
+		 */
+		template<typename ed25519_traits>
+		struct basic_ed25519 {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key Ed25519 public key in PEM, DER or JWK format, its 32 raw bytes or empty string to derive it from private_key
+			 * \param private_key Ed25519 private key in PEM, DER or JWK format, its 32 raw bytes or empty string if not available. If empty, signing will always fail.
+			 * \throws eddsa_exception If a key is invalid or the keys do not match
+			 */
+			explicit basic_ed25519(const std::string& public_key, const std::string& private_key = "")
+				: _impl(std::make_shared<const impl>(public_key, private_key))
+			{}
+
+			/**
+			 * Sign jwt data
+			 * \param data The data to sign
+			 * \return 64 byte Ed25519 signature for the given data
+			 * \throws signature_generation_exception
+			 */
+			std::string sign(const std::string& data) const {
+				if (!_impl->has_private_key)
+					throw signature_generation_exception("failed to create signature: no private key");
+				std::string res(64, '\0');
+				if (!ed25519_traits::sign(_impl->private_key, _impl->public_key, (const unsigned char*)data.data(), data.size(), (unsigned char*)&res[0]))
+					throw signature_generation_exception();
+				return res;
+			}
+			/**
+			 * Check if signature is valid
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \throws signature_verification_exception If the provided signature does not match
+			 */
+			void verify(const std::string& data, const std::string& signature) const {
+				std::error_code ec;
+				verify(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception("Invalid signature");
+			}
+			/**
+			 * Check if signature is valid without throwing
+			 * \param data The data to check signature against
+			 * \param signature Signature provided by the jwt
+			 * \param ec Set to failure::invalid_signature if the signature does not match, cleared otherwise
+			 */
+			void verify(const std::string& data, const std::string& signature, std::error_code& ec) const noexcept {
+				if (signature.size() == 64 && ed25519_traits::verify(_impl->public_key, (const unsigned char*)data.data(), data.size(), (const unsigned char*)signature.data()))
+					ec.clear();
+				else
+					ec = make_error_code(failure::invalid_signature);
+			}
+			/**
+			 * Returns the algorithm name
+			 * \return EdDSA
+			 */
+			std::string name() const {
+				return "EdDSA";
+			}
+		private:
+			/// Keys shared by all copies of an algorithm instance
+			struct impl {
+				unsigned char public_key[32];
+				unsigned char private_key[32];
+				bool has_private_key;
+
+				impl(const std::string& public_key, const std::string& private_key)
+					: has_private_key(!private_key.empty())
+				{
+					std::memset(this->private_key, 0, sizeof(this->private_key));
+					if (!has_private_key) {
+						if (!parse_ed25519_key(public_key, false, this->public_key))
+							throw eddsa_exception("failed to load public key");
+						return;
+					}
+					unsigned char derived[32];
+					const char* error = nullptr;
+					if (!parse_ed25519_key(private_key, true, this->private_key) || !ed25519_traits::derive_public_key(this->private_key, derived))
+						error = "failed to load private key";
+					else if (public_key.empty())
+						std::memcpy(this->public_key, derived, sizeof(derived));
+					else if (!parse_ed25519_key(public_key, false, this->public_key))
+						error = "failed to load public key";
+					else if (std::memcmp(this->public_key, derived, sizeof(derived)) != 0)
+						error = "failed to load private key: does not match public key";
+					if (error != nullptr) {
+						mbedtls_platform_zeroize(this->private_key, sizeof(this->private_key));
+						throw eddsa_exception(error);
+					}
+				}
+				~impl() {
+					mbedtls_platform_zeroize(private_key, sizeof(private_key));
+				}
+				impl(const impl&) = delete;
+				impl& operator=(const impl&) = delete;
+			};
+
+			std::shared_ptr<const impl> _impl;
+		};
+
+		/**
+		 * HS256 algorithm
+		 */
+		struct hs256 : public hmacsha {
+			/**
+			 * Construct new instance of algorithm
+			 * \param key HMAC signing key
+			 */
+			explicit hs256(std::string key)
+				: hmacsha(std::move(key), MBEDTLS_MD_SHA256, "HS256")
+			{}
+		};
+		/**
+		 * HS384 algorithm
+		 */
+		struct hs384 : public hmacsha {
+			/**
+			 * Construct new instance of algorithm
+			 * \param key HMAC signing key
+			 */
+			explicit hs384(std::string key)
+				: hmacsha(std::move(key), MBEDTLS_MD_SHA384, "HS384")
+			{}
+		};
+		/**
+		 * HS512 algorithm
+		 */
+		struct hs512 : public hmacsha {
+			/**
+			 * Construct new instance of algorithm
+			 * \param key HMAC signing key
+			 */
+			explicit hs512(std::string key)
+				: hmacsha(std::move(key), MBEDTLS_MD_SHA512, "HS512")
+			{}
+		};
+		/**
+		 * RS256 algorithm
+		 */
+		struct rs256 : public rsa {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 */
+			rs256(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
+				: rsa(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA256, "RS256")
+			{}
+		};
+		/**
+		 * RS384 algorithm
+		 */
+		struct rs384 : public rsa {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 */
+			rs384(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
+				: rsa(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA384, "RS384")
+			{}
+		};
+		/**
+		 * RS512 algorithm
+		 */
+		struct rs512 : public rsa {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 */
+			rs512(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
+				: rsa(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA512, "RS512")
+			{}
+		};
+		/**
+		 * ES256 algorithm
+		 */
+		struct es256 : public ecdsa {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key ECDSA public key in PEM, DER or JWK format
+			 * \param private_key ECDSA private key in PEM or DER format or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 * \param precompute_public_key Keep a precomputed table for the public key to speed up verification
+			 */
+			es256(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "", bool precompute_public_key = false)
+				: ecdsa(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA256, "ES256", precompute_public_key)
+			{}
+			/**
+			 * Construct new instance of algorithm
+			 * \param keypair ECDSA key, only the public part is needed for verification
+			 * \param precompute_public_key Keep a precomputed table for the public key to speed up verification
+			 */
+			es256(const mbedtls_ecp_keypair *keypair, bool precompute_public_key = false)
+				: ecdsa(keypair, MBEDTLS_MD_SHA256, "ES256", precompute_public_key)
+			{}
+
+			/**
+			 * Precompute signing nonces on a background thread, see ecdsa::with_nonce_pool
+			 * \param capacity Number of nonces kept ready, rounded up to a power of two
+			 * \return *this to allow chaining
+			 * \throws ecdsa_exception If there is no private key
+			 */
+			es256& with_nonce_pool(size_t capacity = 64) {
+				ecdsa::with_nonce_pool(capacity);
+				return *this;
+			}
+		};
+		/**
+		 * ES384 algorithm
+		 */
+		struct es384 : public ecdsa {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key ECDSA public key in PEM, DER or JWK format
+			 * \param private_key ECDSA private key in PEM or DER format or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 * \param precompute_public_key Keep a precomputed table for the public key to speed up verification
+			 */
+			es384(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "", bool precompute_public_key = false)
+				: ecdsa(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA384, "ES384", precompute_public_key)
+			{}
+			/**
+			 * Construct new instance of algorithm
+			 * \param keypair ECDSA key, only the public part is needed for verification
+			 * \param precompute_public_key Keep a precomputed table for the public key to speed up verification
+			 */
+			es384(const mbedtls_ecp_keypair *keypair, bool precompute_public_key = false)
+				: ecdsa(keypair, MBEDTLS_MD_SHA384, "ES384", precompute_public_key)
+			{}
+
+			/**
+			 * Precompute signing nonces on a background thread, see ecdsa::with_nonce_pool
+			 * \param capacity Number of nonces kept ready, rounded up to a power of two
+			 * \return *this to allow chaining
+			 * \throws ecdsa_exception If there is no private key
+			 */
+			es384& with_nonce_pool(size_t capacity = 64) {
+				ecdsa::with_nonce_pool(capacity);
+				return *this;
+			}
+		};
+		/**
+		 * ES512 algorithm
+		 */
+		struct es512 : public ecdsa {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key ECDSA public key in PEM, DER or JWK format
+			 * \param private_key ECDSA private key in PEM or DER format or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 * \param precompute_public_key Keep a precomputed table for the public key to speed up verification
+			 */
+			es512(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "", bool precompute_public_key = false)
+				: ecdsa(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA512, "ES512", precompute_public_key)
+			{}
+			/**
+			 * Construct new instance of algorithm
+			 * \param keypair ECDSA key, only the public part is needed for verification
+			 * \param precompute_public_key Keep a precomputed table for the public key to speed up verification
+			 */
+			es512(const mbedtls_ecp_keypair *keypair, bool precompute_public_key = false)
+				: ecdsa(keypair, MBEDTLS_MD_SHA512, "ES512", precompute_public_key)
+			{}
+
+			/**
+			 * Precompute signing nonces on a background thread, see ecdsa::with_nonce_pool
+			 * \param capacity Number of nonces kept ready, rounded up to a power of two
+			 * \return *this to allow chaining
+			 * \throws ecdsa_exception If there is no private key
+			 */
+			es512& with_nonce_pool(size_t capacity = 64) {
+				ecdsa::with_nonce_pool(capacity);
+				return *this;
+			}
+		};
+
+		/**
+		 * PS256 algorithm
+		 */
+		struct ps256 : public pss {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 */
+			ps256(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
+				: pss(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA256, "PS256")
+			{}
+		};
+		/**
+		 * PS384 algorithm
+		 */
+		struct ps384 : public pss {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 */
+			ps384(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
+				: pss(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA384, "PS384")
+			{}
+		};
+		/**
+		 * PS512 algorithm
+		 */
+		struct ps512 : public pss {
+			/**
+			 * Construct new instance of algorithm
+			 * \param public_key RSA public key in PEM, DER or JWK format
+			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
+			 * \param public_key_password Unused, public keys are never encrypted
+			 * \param private_key_password Password to decrypt private key pem.
+			 */
+			ps512(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
+				: pss(public_key, private_key, public_key_password, private_key_password, MBEDTLS_MD_SHA512, "PS512")
+			{}
+		};
+		/**
+		 * EdDSA algorithm with the bundled Ed25519 implementation
+		 */
+		typedef basic_ed25519<jwt::ed25519_traits> ed25519;
+	}
+
+	/**
+	 * Algorithms known by name, used to dispatch on the alg header without string lookups
+	 */
+	enum class algorithm_id {
+		none,
+		hs256,
+		hs384,
+		hs512,
+		rs256,
+		rs384,
+		rs512,
+		es256,
+		es384,
+		es512,
+		ps256,
+		ps384,
+		ps512,
+		eddsa,
+		/// Any other name
+		unknown
+	};
+
+	/**
+	 * Parse an alg header value
+	 * \param alg Algorithm name
+	 * \return Id of the algorithm or algorithm_id::unknown
+	 */
+	inline algorithm_id parse_algorithm_id(const std::string& alg) noexcept {
+		if (alg.size() == 4)
+			return alg == "none" ? algorithm_id::none : algorithm_id::unknown;
+		if (alg == "EdDSA")
+			return algorithm_id::eddsa;
+		if (alg.size() != 5)
+			return algorithm_id::unknown;
+		const char* s = alg.data();
+		int bits;
+		if (s[2] == '2' && s[3] == '5' && s[4] == '6') bits = 0;
+		else if (s[2] == '3' && s[3] == '8' && s[4] == '4') bits = 1;
+		else if (s[2] == '5' && s[3] == '1' && s[4] == '2') bits = 2;
+		else return algorithm_id::unknown;
+		algorithm_id family;
+		if (s[0] == 'H' && s[1] == 'S') family = algorithm_id::hs256;
+		else if (s[0] == 'R' && s[1] == 'S') family = algorithm_id::rs256;
+		else if (s[0] == 'E' && s[1] == 'S') family = algorithm_id::es256;
+		else if (s[0] == 'P' && s[1] == 'S') family = algorithm_id::ps256;
+		else return algorithm_id::unknown;
+		return static_cast<algorithm_id>(static_cast<int>(family) + bits);
+	}
+
+	namespace details {
+		/// Id of an algorithm type whose name is fixed, algorithm_id::unknown if it has to be asked by name()
+		template<typename T> struct algorithm_id_of : std::integral_constant<algorithm_id, algorithm_id::unknown> {};
+		template<> struct algorithm_id_of<algorithm::none> : std::integral_constant<algorithm_id, algorithm_id::none> {};
+		template<> struct algorithm_id_of<algorithm::hs256> : std::integral_constant<algorithm_id, algorithm_id::hs256> {};
+		template<> struct algorithm_id_of<algorithm::hs384> : std::integral_constant<algorithm_id, algorithm_id::hs384> {};
+		template<> struct algorithm_id_of<algorithm::hs512> : std::integral_constant<algorithm_id, algorithm_id::hs512> {};
+		template<> struct algorithm_id_of<algorithm::rs256> : std::integral_constant<algorithm_id, algorithm_id::rs256> {};
+		template<> struct algorithm_id_of<algorithm::rs384> : std::integral_constant<algorithm_id, algorithm_id::rs384> {};
+		template<> struct algorithm_id_of<algorithm::rs512> : std::integral_constant<algorithm_id, algorithm_id::rs512> {};
+		template<> struct algorithm_id_of<algorithm::es256> : std::integral_constant<algorithm_id, algorithm_id::es256> {};
+		template<> struct algorithm_id_of<algorithm::es384> : std::integral_constant<algorithm_id, algorithm_id::es384> {};
+		template<> struct algorithm_id_of<algorithm::es512> : std::integral_constant<algorithm_id, algorithm_id::es512> {};
+		template<> struct algorithm_id_of<algorithm::ps256> : std::integral_constant<algorithm_id, algorithm_id::ps256> {};
+		template<> struct algorithm_id_of<algorithm::ps384> : std::integral_constant<algorithm_id, algorithm_id::ps384> {};
+		template<> struct algorithm_id_of<algorithm::ps512> : std::integral_constant<algorithm_id, algorithm_id::ps512> {};
+		template<> struct algorithm_id_of<algorithm::ed25519> : std::integral_constant<algorithm_id, algorithm_id::eddsa> {};
+
+		/// The HMAC algorithm an algorithm object is, nullptr for any other type, checked in batches by algorithm::hmacsha::verify_batch
+		template<typename T> const algorithm::hmacsha* hmac_of(const T&) noexcept { return nullptr; }
+		inline const algorithm::hmacsha* hmac_of(const algorithm::hmacsha& alg) noexcept { return &alg; }
+		inline const algorithm::hmacsha* hmac_of(const algorithm::hs256& alg) noexcept { return &alg; }
+		inline const algorithm::hmacsha* hmac_of(const algorithm::hs384& alg) noexcept { return &alg; }
+		inline const algorithm::hmacsha* hmac_of(const algorithm::hs512& alg) noexcept { return &alg; }
+
+		/// Position of T in Ts, sizeof...(Ts) if it is not there
+		template<typename T, typename... Ts> struct type_index;
+		template<typename T> struct type_index<T> : std::integral_constant<size_t, 0> {};
+		template<typename T, typename... Ts> struct type_index<T, T, Ts...> : std::integral_constant<size_t, 0> {};
+		template<typename T, typename U, typename... Ts> struct type_index<T, U, Ts...> : std::integral_constant<size_t, 1 + type_index<T, Ts...>::value> {};
+	}
+
+	namespace json {
+		/// Type of a json value
+		enum class type {
+			null,
+			boolean,
+			number,
+			string,
+			array,
+			object,
+			int64
+		};
+	}
+
+	/**
+	 * JSON backend based on the bundled picojson, used unless another one is given.
+	 * Backends are passed as the json_traits parameter of basic_claim, basic_header, basic_payload,
+	 * basic_decoded_jwt and basic_builder. A backend defines the same types and static functions:
+	 * value_type has to be constructible from string_type, integer_type and array_type, and array_type
+	 * from a range of std::string. The accessors throw std::bad_cast if the value has a different type.
+	 */
+	struct picojson_traits {
+		typedef picojson::value value_type;
+		typedef picojson::object object_type;
+		typedef picojson::array array_type;
+		typedef std::string string_type;
+		typedef double number_type;
+		typedef int64_t integer_type;
+		typedef bool boolean_type;
+
+		static json::type get_type(const value_type& val) {
+			if (val.is<picojson::null>()) return json::type::null;
+			else if (val.is<bool>()) return json::type::boolean;
+			else if (val.is<int64_t>()) return json::type::int64;
+			else if (val.is<double>()) return json::type::number;
+			else if (val.is<std::string>()) return json::type::string;
+			else if (val.is<picojson::array>()) return json::type::array;
+			else if (val.is<picojson::object>()) return json::type::object;
+			else throw std::logic_error("internal error");
+		}
+		static const string_type& as_string(const value_type& val) {
+			if (!val.is<std::string>())
+				throw std::bad_cast();
+			return val.get<std::string>();
+		}
+		static const array_type& as_array(const value_type& val) {
+			if (!val.is<picojson::array>())
+				throw std::bad_cast();
+			return val.get<picojson::array>();
+		}
+		static integer_type as_int(const value_type& val) {
+			if (!val.is<int64_t>())
+				throw std::bad_cast();
+			return val.get<int64_t>();
+		}
+		static boolean_type as_bool(const value_type& val) {
+			if (!val.is<bool>())
+				throw std::bad_cast();
+			return val.get<bool>();
+		}
+		static number_type as_number(const value_type& val) {
+			if (!val.is<double>())
+				throw std::bad_cast();
+			return val.get<double>();
+		}
+		/**
+		 * Parse a single json value
+		 * \return false if the text is not valid json
+		 */
+		static bool parse(value_type& val, const char* first, const char* last) {
+			std::string err;
+			picojson::parse(val, first, last, &err);
+			return err.empty();
+		}
+		/// Write the json text of a value to an output iterator
+		template<typename OutputIterator>
+		static void serialize(const value_type& val, OutputIterator out) {
+			val.serialize(out);
+		}
+	};
+
+	template<typename json_traits>
+	class basic_builder;
+
+	/**
+	 * Convenience wrapper for JSON value
+	 */
+	template<typename json_traits>
+	class basic_claim {
+		typename json_traits::value_type val;
+		template<typename>
+		friend class basic_builder;
+	public:
+		typedef json_traits traits_type;
+		typedef json::type type;
+
+		basic_claim()
+			: val()
+		{}
+#if JWT_CLAIM_EXPLICIT
+		explicit basic_claim(typename json_traits::string_type s)
+			: val(std::move(s))
+		{}
+		explicit basic_claim(const date& s)
+			: val(typename json_traits::integer_type(std::chrono::system_clock::to_time_t(s)))
+		{}
+		explicit basic_claim(const std::set<std::string>& s)
+			: val(typename json_traits::array_type(s.cbegin(), s.cend()))
+		{}
+		explicit basic_claim(const typename json_traits::value_type& val)
+			: val(val)
+		{}
+		explicit basic_claim(typename json_traits::value_type&& val)
+			: val(std::move(val))
+		{}
+#else
+		basic_claim(typename json_traits::string_type s)
+			: val(std::move(s))
+		{}
+		basic_claim(const date& s)
+			: val(typename json_traits::integer_type(std::chrono::system_clock::to_time_t(s)))
+		{}
+		basic_claim(const std::set<std::string>& s)
+			: val(typename json_traits::array_type(s.cbegin(), s.cend()))
+		{}
+		basic_claim(const typename json_traits::value_type& val)
+			: val(val)
+		{}
+		basic_claim(typename json_traits::value_type&& val)
+			: val(std::move(val))
+		{}
+#endif
+
+		/**
+		 * Get wrapped json object
+		 * \return Copy of the wrapped json object
+		 */
+		typename json_traits::value_type to_json() const {
+			return val;
+		}
+		/**
+		 * Get wrapped json object without copying it
+		 * \return Wrapped json object, valid as long as the claim
+		 */
+		const typename json_traits::value_type& as_json() const noexcept {
+			return val;
+		}
+
+		/**
+		 * Get type of contained object
+		 * \return Type
+		 * \throws std::logic_error An internal error occured
+		 */
+		type get_type() const {
+			return json_traits::get_type(val);
+		}
+
+		/**
+		 * Get the contained object as a string
+		 * \return content as string
+		 * \throws std::bad_cast Content was not a string
+		 */
+		const typename json_traits::string_type& as_string() const {
+			return json_traits::as_string(val);
+		}
+		/**
+		 * Get the contained object as a date
+		 * \return content as date
+		 * \throws std::bad_cast Content was not a date
+		 */
+		date as_date() const {
+			return std::chrono::system_clock::from_time_t(as_int());
+		}
+		/**
+		 * Get the contained object as an array
+		 * \return content as array
+		 * \throws std::bad_cast Content was not an array
+		 */
+		const typename json_traits::array_type& as_array() const {
+			return json_traits::as_array(val);
+		}
+		/**
+		 * Get the contained object as a set of strings
+		 * \return content as set of strings
+		 * \throws std::bad_cast Content was not a set
+		 */
+		std::set<std::string> as_set() const {
+			std::set<std::string> res;
+			for(auto& e : as_array()) {
+				if(json_traits::get_type(e) != type::string)
+					throw std::bad_cast();
+				res.insert(json_traits::as_string(e));
+			}
+			return res;
+		}
+		/**
+		 * Get the contained object as an integer
+		 * \return content as int
+		 * \throws std::bad_cast Content was not an int
+		 */
+		typename json_traits::integer_type as_int() const {
+			return json_traits::as_int(val);
+		}
+		/**
+		 * Get the contained object as a bool
+		 * \return content as bool
+		 * \throws std::bad_cast Content was not a bool
+		 */
+		typename json_traits::boolean_type as_bool() const {
+			return json_traits::as_bool(val);
+		}
+		/**
+		 * Get the contained object as a number
+		 * \return content as double
+		 * \throws std::bad_cast Content was not a number
+		 */
+		typename json_traits::number_type as_number() const {
+			return json_traits::as_number(val);
+		}
+	};
+
+	typedef basic_claim<picojson_traits> claim;
+
+	/**
+	 * How payload claims are materialized when decoding a token
+	 */
+	enum class claim_parsing {
+		/// Parse all claims while decoding
+		eager,
+		/// Only tokenize the payload while decoding and parse each claim on first access
+		lazy
+	};
+
+	/**
+	 * How a detached payload is signed, see builder::sign_detached
+	 */
+	enum class payload_encoding {
+		/// The signature covers the payload in base64url, as for attached payloads
+		base64url,
+		/// The signature covers the payload as is (RFC 7797), marked by the header b64 false
+		unencoded
+	};
+
+	/**
+	 * Stages timed by an observer
+	 */
+	enum class stage {
+		/// Splitting the token and decoding its base64url parts
+		base64_decode,
+		/// Parsing the header and payload json, in lazy mode only the payload tokenization
+		json_parse,
+		/// Key and algorithm lookup and the signature check, including the token cache
+		signature,
+		/// Checking exp, iat, nbf and the configured claims
+		claims
+	};
+
+	/**
+	 * Observer that ignores everything, the default for decoding and verification.
+	 * Custom observers provide the same members, deriving from null_observer and hiding only the
+	 * interesting ones is enough. Any observer other than null_observer enables stage timing,
+	 * which reads std::chrono::steady_clock twice per stage.
+	 * Batch verification calls the observer from all pool threads at once.
+	 */
+	struct null_observer {
+		/// Sizes of the base64url encoded header, payload and signature
+		void on_token(size_t /*header_size*/, size_t /*payload_size*/, size_t /*signature_size*/) {}
+		/// Algorithm named by a token about to be verified
+		void on_algorithm(const std::string& /*alg*/) {}
+		/// Time spent in a stage, only reported for stages that completed
+		void on_stage(stage /*s*/, std::chrono::nanoseconds /*elapsed*/) {}
+		/// Decoding or verification failed
+		void on_failure(failure /*reason*/) {}
+	};
+
+	namespace details {
+		template<typename Observer>
+		struct observer_enabled : std::true_type {};
+		template<>
+		struct observer_enabled<null_observer> : std::false_type {};
+
+		inline null_observer& no_observer() {
+			static null_observer instance;
+			return instance;
+		}
+
+		/// Times one stage, the clock is never read for null_observer
+		template<typename Observer>
+		class stage_timer {
+			Observer& observer;
+			const stage current;
+			const std::chrono::steady_clock::time_point start;
+		public:
+			stage_timer(Observer& observer, stage current)
+				: observer(observer), current(current),
+				start(observer_enabled<Observer>::value ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+			{}
+			void done() {
+				if (observer_enabled<Observer>::value)
+					observer.on_stage(current, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start));
+			}
+		};
+
+		/**
+		 * Report a token that can not be decoded
+		 * \param ec Receives the reason if not nullptr, otherwise the matching exception is thrown
+		 */
+		template<typename Observer>
+		void reject_token(Observer& observer, failure reason, std::error_code* ec) {
+			observer.on_failure(reason);
+			if (ec != nullptr) {
+				*ec = reason;
+				return;
+			}
+			if (reason == failure::malformed_token)
+				throw std::invalid_argument("invalid token supplied");
+			throw std::runtime_error(reason == failure::invalid_base64 ? "Invalid input" : "Invalid json");
+		}
+	}
+
+	namespace details {
+#if JWT_HAS_MEMORY_RESOURCE
+		/// Storage owned by a decoded token, allocated from the memory resource it was decoded with
+		typedef std::pmr::string buffer;
+#else
+		typedef std::string buffer;
+#endif
+#if JWT_HAS_STRING_VIEW
+		/// Type claim names are looked up by, a view so that literals need no temporary string
+		typedef std::string_view name_ref;
+#else
+		typedef const std::string& name_ref;
+#endif
+
+		/**
+		 * Claims of a json object, kept in a vector sorted by name.
+		 * Tokens carry few claims, so a binary search over contiguous entries is cheaper than hashing.
+		 */
+		template<typename json_traits>
+		class claim_map {
+		public:
+			typedef std::pair<std::string, basic_claim<json_traits>> value_type;
+#if JWT_HAS_MEMORY_RESOURCE
+			typedef std::pmr::polymorphic_allocator<value_type> allocator_type;
+			typedef std::pmr::vector<value_type> storage_type;
+#else
+			typedef std::allocator<value_type> allocator_type;
+			typedef std::vector<value_type> storage_type;
+#endif
+			typedef typename storage_type::const_iterator const_iterator;
+			typedef const_iterator iterator;
+
+			claim_map() {}
+			explicit claim_map(const allocator_type& alloc)
+				: entries(alloc)
+			{}
+
+			allocator_type get_allocator() const { return entries.get_allocator(); }
+			const_iterator begin() const noexcept { return entries.begin(); }
+			const_iterator end() const noexcept { return entries.end(); }
+			size_t size() const noexcept { return entries.size(); }
+			bool empty() const noexcept { return entries.empty(); }
+			void clear() noexcept { entries.clear(); }
+
+			const_iterator find(name_ref name) const noexcept {
+				auto it = lower_bound(entries.begin(), entries.end(), name);
+				return it != entries.end() && it->first == name ? it : entries.end();
+			}
+			size_t count(name_ref name) const noexcept { return find(name) == entries.end() ? 0 : 1; }
+			/**
+			 * \throws std::out_of_range If the claim is not present
+			 */
+			const basic_claim<json_traits>& at(name_ref name) const {
+				auto it = find(name);
+				if (it == entries.end())
+					throw std::out_of_range("claim not found");
+				return it->second;
+			}
+			/// Get a claim, inserting an empty one if it is not present
+			basic_claim<json_traits>& operator[](name_ref name) {
+				// Room for the claims of a typical token, so parsing one does not grow the vector repeatedly
+				if (entries.capacity() == 0)
+					entries.reserve(8);
+				auto it = lower_bound(entries.begin(), entries.end(), name);
+				if (it == entries.end() || it->first != name)
+					it = entries.emplace(it, std::string(name.data(), name.size()), basic_claim<json_traits>());
+				return it->second;
+			}
+		private:
+			storage_type entries;
+
+			/// Orders by length first, which settles most comparisons between claim names
+			template<typename Iterator>
+			static Iterator lower_bound(Iterator first, Iterator last, name_ref name) noexcept {
+				return std::lower_bound(first, last, name, [](const value_type& e, name_ref n) {
+					return e.first.size() != n.size() ? e.first.size() < n.size() : std::memcmp(e.first.data(), n.data(), n.size()) < 0;
+				});
+			}
+		};
+
+		/**
+		 * Pointer based json scanner that validates values without building them.
+		 * Accepts the same input as picojson, except that nesting is limited to max_depth.
+		 */
+		class json_scanner {
+			const char* cur;
+			const char* end;
+
+			static bool is_number_char(char c) {
+				return (c >= '0' && c <= '9') || c == '+' || c == '-' || c == 'e' || c == 'E' || c == '.';
+			}
+			bool match(const char* literal, size_t len) {
+				if (size_t(end - cur) < len || std::memcmp(cur, literal, len) != 0)
+					return false;
+				cur += len;
+				return true;
+			}
+			bool skip_number() {
+				const char* first = cur;
+				while (cur != end && is_number_char(*cur))
+					cur++;
+				int64_t ignored;
+				if (parse_int(first, cur, ignored))
+					return true;
+				// Same checks as picojson for everything but plain integers
+				const std::string num(first, cur);
+				char* endp;
+				errno = 0;
+				const intmax_t ival = strtoimax(num.c_str(), &endp, 10);
+				if (errno == 0 && ival >= std::numeric_limits<int64_t>::min() && ival <= std::numeric_limits<int64_t>::max() && endp == num.c_str() + num.size())
+					return true;
+				strtod(num.c_str(), &endp);
+				return !num.empty() && endp == num.c_str() + num.size();
+			}
+			/// Read four hex digits of a \u escape, -1 if they are not
+			int parse_quadhex() {
+				if (end - cur < 4)
+					return -1;
+				int res = 0;
+				for (int i = 0; i < 4; i++, cur++) {
+					int hex;
+					if (*cur >= '0' && *cur <= '9')
+						hex = *cur - '0';
+					else if (*cur >= 'A' && *cur <= 'F')
+						hex = *cur - 'A' + 10;
+					else if (*cur >= 'a' && *cur <= 'f')
+						hex = *cur - 'a' + 10;
+					else
+						return -1;
+					res = res * 16 + hex;
+				}
+				return res;
+			}
+			/// Validate the rest of a string whose opening quote was consumed, with the checks of picojson but without copying it
+			bool skip_string() {
+				for (;;) {
+					while (cur != end && *cur != '"' && *cur != '\\') {
+						if ((unsigned char)*cur < ' ')
+							return false;
+						cur++;
+					}
+					if (cur == end)
+						return false;
+					if (*cur++ == '"')
+						return true;
+					if (cur == end)
+						return false;
+					switch (*cur++) {
+					case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+						break;
+					case 'u': {
+						const int first = parse_quadhex();
+						if (first < 0)
+							return false;
+						// A surrogate pair, the second half on its own is invalid
+						if (first >= 0xd800 && first <= 0xdfff) {
+							if (first >= 0xdc00 || !match("\\u", 2))
+								return false;
+							const int second = parse_quadhex();
+							if (second < 0xdc00 || second > 0xdfff)
+								return false;
+						}
+						break;
+					}
+					default:
+						return false;
+					}
+				}
+			}
+			bool skip_array(size_t depth) {
+				if (expect(']'))
+					return true;
+				do {
+					if (!skip_value(depth))
+						return false;
+				} while (expect(','));
+				return expect(']');
+			}
+			bool skip_object(size_t depth) {
+				if (expect('}'))
+					return true;
+				do {
+					if (!expect('"') || !skip_string() || !expect(':') || !skip_value(depth))
+						return false;
+				} while (expect(','));
+				return expect('}');
+			}
+		public:
+			/// Deepest nesting of arrays and objects accepted
+			static constexpr size_t max_depth = 100;
+
+			json_scanner(const char* first, const char* last) : cur(first), end(last) {}
+
+			const char* position() const noexcept { return cur; }
+
+			void skip_ws() {
+				while (cur != end && (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r'))
+					cur++;
+			}
+			/// Skip whitespace and consume c if it comes next
+			bool expect(char c) {
+				skip_ws();
+				if (cur == end || *cur != c)
+					return false;
+				cur++;
+				return true;
+			}
+			/**
+			 * Read the rest of a string whose opening quote was consumed
+			 * \param out Receives the unescaped string
+			 */
+			bool parse_string(std::string& out) {
+				const char* first = cur;
+				while (cur != end && *cur != '"' && *cur != '\\') {
+					if ((unsigned char)*cur < ' ')
+						return false;
+					cur++;
+				}
+				if (cur == end)
+					return false;
+				if (*cur == '"') {
+					out.assign(first, cur++);
+					return true;
+				}
+				// Escapes are rare in claims, leave them to picojson
+				picojson::input<const char*> in(first, end);
+				out.clear();
+				if (!picojson::_parse_string(out, in))
+					return false;
+				cur = in.cur();
+				return true;
+			}
+			/// Skip whitespace and one value
+			bool skip_value(size_t depth = 0) {
+				skip_ws();
+				if (cur == end)
+					return false;
+				switch (*cur++) {
+				case 'n': return match("ull", 3);
+				case 't': return match("rue", 3);
+				case 'f': return match("alse", 4);
+				case '"': return skip_string();
+				case '[': return depth < max_depth && skip_array(depth + 1);
+				case '{': return depth < max_depth && skip_object(depth + 1);
+				default:
+					cur--;
+					if ((*cur >= '0' && *cur <= '9') || *cur == '-')
+						return skip_number();
+					return false;
+				}
+			}
+
+			/**
+			 * Parse a plain integer of up to 18 digits, which always fits into int64_t
+			 * \return false if the text is something else, which is not necessarily invalid
+			 */
+			static bool parse_int(const char* first, const char* last, int64_t& out) {
+				const bool negative = first != last && *first == '-';
+				if (negative)
+					first++;
+				if (first == last || last - first > 18)
+					return false;
+				int64_t v = 0;
+				for (; first != last; first++) {
+					if (*first < '0' || *first > '9')
+						return false;
+					v = v * 10 + (*first - '0');
+				}
+				out = negative ? -v : v;
+				return true;
+			}
+		};
+
+		/**
+		 * Create a claim from the json text of a valid value.
+		 * Strings without escapes and plain integers, which most registered claims are, are built
+		 * directly. Other values are parsed by the json backend.
+		 * \return false if the json backend rejected the value
+		 */
+		template<typename json_traits>
+		bool try_make_claim(const char* first, const char* last, basic_claim<json_traits>& out) {
+			typedef typename json_traits::value_type value_type;
+			int64_t i;
+			if (last - first >= 2 && *first == '"' && std::memchr(first + 1, '\\', last - first - 2) == nullptr)
+				out = basic_claim<json_traits>(value_type(typename json_traits::string_type(first + 1, last - 1)));
+			else if (json_scanner::parse_int(first, last, i))
+				out = basic_claim<json_traits>(value_type(typename json_traits::integer_type(i)));
+			else {
+				value_type val;
+				if (!json_traits::parse(val, first, last))
+					return false;
+				out = basic_claim<json_traits>(std::move(val));
+			}
+			return true;
+		}
+		/**
+		 * Create a claim from the json text of a valid value
+		 * \throws std::runtime_error Invalid json
+		 */
+		template<typename json_traits>
+		basic_claim<json_traits> make_claim(const char* first, const char* last) {
+			basic_claim<json_traits> res;
+			if (!try_make_claim<json_traits>(first, last, res))
+				throw std::runtime_error("Invalid json");
+			return res;
+		}
+
+		/**
+		 * Visit the members of a json object without building it
+		 * \param fn Called with the name and the text of each member's value, returns false to stop
+		 * \return false if the object is not valid json or fn stopped the scan
+		 */
+		template<typename Fn>
+		bool scan_object(const char* first, const char* last, Fn fn) {
+			json_scanner in(first, last);
+			if (!in.expect('{'))
+				return false;
+			if (in.expect('}'))
+				return true;
+			std::string name;
+			do {
+				if (!in.expect('"') || !in.parse_string(name) || !in.expect(':'))
+					return false;
+				in.skip_ws();
+				const char* value = in.position();
+				if (!in.skip_value() || !fn(name, value, in.position()))
+					return false;
+			} while (in.expect(','));
+			return in.expect('}');
+		}
+
+		/**
+		 * Parse a json object into a map of claims
+		 * \param first Start of the json text
+		 * \param last End of the json text
+		 * \param res map receiving the claims
+		 * \return false if the text is not a valid json object
+		 */
+		template<typename json_traits>
+		bool parse_claims(const char* first, const char* last, claim_map<json_traits>& res) {
+			return scan_object(first, last, [&res](const std::string& name, const char* value_first, const char* value_last) {
+				// The last duplicate wins, like picojson does
+				return try_make_claim<json_traits>(value_first, value_last, res[name]);
+			});
+		}
+
+		/**
+		 * Index over the members of a json object that are only parsed into claims on first access.
+		 * The object is tokenized once on construction, nested values are validated but not stored.
+		 * Materializing a claim is thread safe, so instances can be shared between copies of a token.
+		 */
+		template<typename json_traits>
+		class lazy_claims {
+			struct entry {
+				std::string name;
+				size_t first = 0;
+				size_t last = 0;
+				mutable std::once_flag once;
+				mutable basic_claim<json_traits> value;
+			};
+#if JWT_HAS_MEMORY_RESOURCE
+			typedef std::pmr::vector<entry> entry_list;
+#else
+			typedef std::vector<entry> entry_list;
+#endif
+			/// Unparsed json object
+			const buffer json;
+			/// Members in document order, sized once since entries can not be moved
+			entry_list entries;
+			size_t count = 0;
+			/// Whether the text was a valid json object
+			bool ok = false;
+			/// All claims, only filled by all()
+			mutable std::once_flag all_once;
+			mutable claim_map<json_traits> all_claims;
+
+			const entry* find(name_ref name) const noexcept {
+				// Search backwards so the last duplicate wins, like picojson does
+				for (size_t i = count; i-- > 0;) {
+					if (entries[i].name == name)
+						return &entries[i];
+				}
+				return nullptr;
+			}
+		public:
+			/**
+			 * Tokenize a json object, check valid() afterwards
+			 * \param first Start of the json text
+			 * \param last End of the json text
+			 * \param alloc Allocator for the copy of the text and the index
+			 */
+			lazy_claims(const char* first, const char* last, const buffer::allocator_type& alloc = buffer::allocator_type())
+				: json(first, last, alloc), entries(alloc), all_claims(alloc)
+			{
+				struct span { std::string name; size_t first; size_t last; };
+#if JWT_HAS_MEMORY_RESOURCE
+				std::pmr::vector<span> spans(alloc);
+#else
+				std::vector<span> spans;
+#endif
+				// Enough for typical tokens, so the spans are not reallocated while scanning
+				spans.reserve(16);
+				const char* begin = json.data();
+				ok = scan_object(begin, begin + json.size(), [&](const std::string& name, const char* value_first, const char* value_last) {
+					spans.push_back({ name, size_t(value_first - begin), size_t(value_last - begin) });
+					return true;
+				});
+				if (!ok)
+					return;
+
+				count = spans.size();
+				entry_list(count, alloc).swap(entries);
+				for (size_t i = 0; i < count; i++) {
+					entries[i].name = std::move(spans[i].name);
+					entries[i].first = spans[i].first;
+					entries[i].last = spans[i].last;
+				}
+			}
+
+			/// Whether tokenizing succeeded, invalid objects have no claims
+			bool valid() const noexcept { return ok; }
+			/**
+			 * Check if a claim is present, without parsing it
+			 * \return true if claim was present, false otherwise
+			 */
+			bool has(name_ref name) const noexcept { return find(name) != nullptr; }
+			/**
+			 * Get a claim, parsing it on first access
+			 * \return Requested claim
+			 * \throws std::runtime_error If claim was not present or is not valid json
+			 */
+			const basic_claim<json_traits>& get(name_ref name) const {
+				const entry* e = find(name);
+				if (e == nullptr)
+					throw std::runtime_error("claim not found");
+				std::call_once(e->once, [this, e]() {
+					e->value = make_claim<json_traits>(json.data() + e->first, json.data() + e->last);
+				});
+				return e->value;
+			}
+			/**
+			 * Parse all claims, once
+			 * \return map of claims
+			 */
+			const claim_map<json_traits>& all() const {
+				std::call_once(all_once, [this]() {
+					for (size_t i = 0; i < count; i++)
+						all_claims[entries[i].name] = get(entries[i].name);
+				});
+				return all_claims;
+			}
+		};
+	}
+
+	/**
+	 * Base class that represents a token payload.
+	 * Contains Convenience accessors for common claims.
+	 */
+	template<typename json_traits>
+	class basic_payload {
+	protected:
+		details::claim_map<json_traits> payload_claims;
+		/// Unparsed payload claims, only set if the token was decoded with claim_parsing::lazy
+		std::shared_ptr<const details::lazy_claims<json_traits>> lazy_payload_claims;
+
+		basic_payload() {}
+		/// \param alloc Allocator for the claims, used by tokens decoded with a memory resource
+		explicit basic_payload(const typename details::claim_map<json_traits>::allocator_type& alloc)
+			: payload_claims(alloc)
+		{}
+
+		/**
+		 * Fill the claims from a decoded payload
+		 * \param first Start of the payload json
+		 * \param last End of the payload json
+		 * \param mode Whether to parse the claims now or on first access
+		 * \return false if the payload is not a valid json object
+		 */
+		bool set_payload_json(const char* first, const char* last, claim_parsing mode) {
+			if (mode == claim_parsing::lazy) {
+				const typename details::claim_map<json_traits>::allocator_type alloc = payload_claims.get_allocator();
+				lazy_payload_claims = std::allocate_shared<details::lazy_claims<json_traits>>(alloc, first, last, alloc);
+				return lazy_payload_claims->valid();
+			}
+			return details::parse_claims<json_traits>(first, last, payload_claims);
+		}
+	public:
+		/**
+		 * Check if issuer is present ("iss")
+		 * \return true if present, false otherwise
+		 */
+		bool has_issuer() const noexcept { return has_payload_claim("iss"); }
+		/**
+		 * Check if subject is present ("sub")
+		 * \return true if present, false otherwise
+		 */
+		bool has_subject() const noexcept { return has_payload_claim("sub"); }
+		/**
+		 * Check if audience is present ("aud")
+		 * \return true if present, false otherwise
+		 */
+		bool has_audience() const noexcept { return has_payload_claim("aud"); }
+		/**
+		 * Check if expires is present ("exp")
+		 * \return true if present, false otherwise
+		 */
+		bool has_expires_at() const noexcept { return has_payload_claim("exp"); }
+		/**
+		 * Check if not before is present ("nbf")
+		 * \return true if present, false otherwise
+		 */
+		bool has_not_before() const noexcept { return has_payload_claim("nbf"); }
+		/**
+		 * Check if issued at is present ("iat")
+		 * \return true if present, false otherwise
+		 */
+		bool has_issued_at() const noexcept { return has_payload_claim("iat"); }
+		/**
+		 * Check if token id is present ("jti")
+		 * \return true if present, false otherwise
+		 */
+		bool has_id() const noexcept { return has_payload_claim("jti"); }
+		/**
+		 * Get issuer claim
+		 * \return issuer as string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_issuer() const { return get_payload_claim("iss").as_string(); }
+		/**
+		 * Get subject claim
+		 * \return subject as string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_subject() const { return get_payload_claim("sub").as_string(); }
+		/**
+		 * Get audience claim
+		 * \return audience as a set of strings
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a set (Should not happen in a valid token)
+		 */
+		std::set<std::string> get_audience() const { 
+			const auto& aud = get_payload_claim("aud");
+			if(aud.get_type() == json::type::string) return { aud.as_string()};
+			else return aud.as_set();
+		}
+		/**
+		 * Get expires claim
+		 * \return expires as a date in utc
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a date (Should not happen in a valid token)
+		 */
+		const date get_expires_at() const { return get_payload_claim("exp").as_date(); }
+		/**
+		 * Get not valid before claim
+		 * \return nbf date in utc
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a date (Should not happen in a valid token)
+		 */
+		const date get_not_before() const { return get_payload_claim("nbf").as_date(); }
+		/**
+		 * Get issued at claim
+		 * \return issued at as date in utc
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a date (Should not happen in a valid token)
+		 */
+		const date get_issued_at() const { return get_payload_claim("iat").as_date(); }
+		/**
+		 * Get id claim
+		 * \return id as string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_id() const { return get_payload_claim("jti").as_string(); }
+		/**
+		 * Check if a payload claim is present
+		 * \return true if claim was present, false otherwise
+		 */
+		bool has_payload_claim(details::name_ref name) const noexcept {
+			if (lazy_payload_claims)
+				return lazy_payload_claims->has(name);
+			return payload_claims.count(name) != 0;
+		}
+		/**
+		 * Get payload claim
+		 * \return Requested claim
+		 * \throws std::runtime_error If claim was not present
+		 */
+		const basic_claim<json_traits>& get_payload_claim(details::name_ref name) const {
+			if (lazy_payload_claims)
+				return lazy_payload_claims->get(name);
+			auto it = payload_claims.find(name);
+			if (it == payload_claims.end())
+				throw std::runtime_error("claim not found");
+			return it->second;
+		}
+		/**
+		 * Get all payload claims.
+		 * Lazily decoded tokens parse all of their claims on the first call.
+		 * \return map of claims, valid as long as the token
+		 */
+		const details::claim_map<json_traits>& get_payload_claims() const {
+			if (lazy_payload_claims)
+				return lazy_payload_claims->all();
+			return payload_claims;
+		}
+	};
+
+	/**
+	 * Base class that represents a token header.
+	 * Contains Convenience accessors for common claims.
+	 */
+	template<typename json_traits>
+	class basic_header {
+	protected:
+		details::claim_map<json_traits> header_claims;
+
+		basic_header() {}
+		/// \param alloc Allocator for the claims, used by tokens decoded with a memory resource
+		explicit basic_header(const typename details::claim_map<json_traits>::allocator_type& alloc)
+			: header_claims(alloc)
+		{}
+	public:
+		/**
+		 * Check if algortihm is present ("alg")
+		 * \return true if present, false otherwise
+		 */
+		bool has_algorithm() const noexcept { return has_header_claim("alg"); }
+		/**
+		 * Check if type is present ("typ")
+		 * \return true if present, false otherwise
+		 */
+		bool has_type() const noexcept { return has_header_claim("typ"); }
+		/**
+		 * Check if content type is present ("cty")
+		 * \return true if present, false otherwise
+		 */
+		bool has_content_type() const noexcept { return has_header_claim("cty"); }
+		/**
+		 * Check if key id is present ("kid")
+		 * \return true if present, false otherwise
+		 */
+		bool has_key_id() const noexcept { return has_header_claim("kid"); }
+		/**
+		 * Get algorithm claim
+		 * \return algorithm as string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_algorithm() const { return get_header_claim("alg").as_string(); }
+		/**
+		 * Get type claim
+		 * \return type as a string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_type() const { return get_header_claim("typ").as_string(); }
+		/**
+		 * Get content type claim
+		 * \return content type as string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_content_type() const { return get_header_claim("cty").as_string(); }
+		/**
+		 * Get key id claim
+		 * \return key id as string
+		 * \throws std::runtime_error If claim was not present
+		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 */
+		const typename json_traits::string_type& get_key_id() const { return get_header_claim("kid").as_string(); }
+		/**
+		 * Check if a header claim is present
+		 * \return true if claim was present, false otherwise
+		 */
+		bool has_header_claim(details::name_ref name) const noexcept { return header_claims.count(name) != 0; }
+		/**
+		 * Get header claim
+		 * \return Requested claim
+		 * \throws std::runtime_error If claim was not present
+		 */
+		const basic_claim<json_traits>& get_header_claim(details::name_ref name) const {
+			auto it = header_claims.find(name);
+			if (it == header_claims.end())
+				throw std::runtime_error("claim not found");
+			return it->second;
+		}
+		/**
+		 * Get all header claims
+		 * \return map of claims, valid as long as the token
+		 */
+		const details::claim_map<json_traits>& get_header_claims() const {
+			return header_claims;
+		}
+	};
+
+	/**
+	 * Class containing all information about a decoded token
+	 */
+	template<typename json_traits>
+	class basic_decoded_jwt : public basic_header<json_traits>, public basic_payload<json_traits> {
+	public:
+		typedef json_traits traits_type;
+	protected:
+		/// Unmodifed token, as passed to constructor. Not const, so decoded tokens can be moved.
+		std::string token;
+		/// Header part decoded from base64
+		std::string header;
+		/// Unmodified header part in base64
+		std::string header_base64;
+		/// Payload part decoded from base64
+		std::string payload;
+		/// Unmodified payload part in base64
+		std::string payload_base64;
+		/// Signature part decoded from base64
+		std::string signature;
+		/// Unmodified signature part in base64
+		std::string signature_base64;
+	public:
+		/**
+		 * Constructor 
+		 * Parses a given token
+		 * \param token The token to parse
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		explicit basic_decoded_jwt(const std::string& token, claim_parsing mode = claim_parsing::eager)
+			: basic_decoded_jwt(token, mode, typename details::claim_map<json_traits>::allocator_type(), details::no_observer(), nullptr)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token, taking over its storage instead of copying it
+		 * \param token The token to parse
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		explicit basic_decoded_jwt(std::string&& token, claim_parsing mode = claim_parsing::eager)
+			: basic_decoded_jwt(std::move(token), mode, typename details::claim_map<json_traits>::allocator_type(), details::no_observer(), nullptr)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token and reports sizes, stage timings and failures to an observer
+		 * \param token The token to parse
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param observer Observer to report to, see null_observer
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		template<typename Observer>
+		basic_decoded_jwt(const std::string& token, claim_parsing mode, Observer& observer)
+			: basic_decoded_jwt(token, mode, typename details::claim_map<json_traits>::allocator_type(), observer, nullptr)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token without throwing if it is invalid
+		 * \param token The token to parse
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param ec Receives the reason if the token is invalid, the object must not be used then
+		 * \throws std::bad_alloc
+		 */
+		basic_decoded_jwt(const std::string& token, claim_parsing mode, std::error_code& ec)
+			: basic_decoded_jwt(token, mode, typename details::claim_map<json_traits>::allocator_type(), details::no_observer(), &ec)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token without throwing if it is invalid, taking over its storage instead of copying it
+		 * \param token The token to parse
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param ec Receives the reason if the token is invalid, the object must not be used then
+		 * \throws std::bad_alloc
+		 */
+		basic_decoded_jwt(std::string&& token, claim_parsing mode, std::error_code& ec)
+			: basic_decoded_jwt(std::move(token), mode, typename details::claim_map<json_traits>::allocator_type(), details::no_observer(), &ec)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token without throwing if it is invalid, reporting to an observer
+		 * \param token The token to parse
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param observer Observer to report to, see null_observer
+		 * \param ec Receives the reason if the token is invalid, the object must not be used then
+		 * \throws std::bad_alloc
+		 */
+		template<typename Observer>
+		basic_decoded_jwt(const std::string& token, claim_parsing mode, Observer& observer, std::error_code& ec)
+			: basic_decoded_jwt(token, mode, typename details::claim_map<json_traits>::allocator_type(), observer, &ec)
+		{}
+#if JWT_HAS_MEMORY_RESOURCE
+		/**
+		 * Constructor
+		 * Parses a given token, allocating the claims from a memory resource.
+		 * The token parts are returned as std::string and stay on the default heap, use decoded_jwt_view
+		 * to keep all of the decoded storage in the resource.
+		 * \param token The token to parse
+		 * \param resource Memory resource for the claims, must outlive this object
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		basic_decoded_jwt(const std::string& token, std::pmr::memory_resource* resource, claim_parsing mode = claim_parsing::eager)
+			: basic_decoded_jwt(token, mode, typename details::claim_map<json_traits>::allocator_type(resource), details::no_observer(), nullptr)
+		{}
+#endif
+	private:
+		/// \param input Token, copied or moved into token
+		template<typename String, typename Observer>
+		basic_decoded_jwt(String&& input, claim_parsing mode, const typename details::claim_map<json_traits>::allocator_type& alloc, Observer& observer, std::error_code* ec)
+			: basic_header<json_traits>(alloc), basic_payload<json_traits>(alloc), token(std::forward<String>(input))
+		{
+			if (ec != nullptr)
+				ec->clear();
+			details::stage_timer<Observer> decode_timer(observer, stage::base64_decode);
+			auto hdr_end = token.find('.');
+			auto payload_end = hdr_end == std::string::npos ? std::string::npos : token.find('.', hdr_end + 1);
+			if (payload_end == std::string::npos) {
+				details::reject_token(observer, failure::malformed_token, ec);
+				return;
+			}
+			header_base64 = token.substr(0, hdr_end);
+			payload_base64 = token.substr(hdr_end + 1, payload_end - hdr_end - 1);
+			signature_base64 = token.substr(payload_end + 1);
+			observer.on_token(header_base64.size(), payload_base64.size(), signature_base64.size());
+
+			if (!base::try_decode_into<alphabet::base64url_unpadded>(header_base64, header)
+				|| !base::try_decode_into<alphabet::base64url_unpadded>(payload_base64, payload)
+				|| !base::try_decode_into<alphabet::base64url_unpadded>(signature_base64, signature)) {
+				details::reject_token(observer, failure::invalid_base64, ec);
+				return;
+			}
+			decode_timer.done();
+
+			details::stage_timer<Observer> parse_timer(observer, stage::json_parse);
+			if (!details::parse_claims<json_traits>(header.data(), header.data() + header.size(), this->header_claims)
+				|| !this->set_payload_json(payload.data(), payload.data() + payload.size(), mode)) {
+				details::reject_token(observer, failure::invalid_json, ec);
+				return;
+			}
+			parse_timer.done();
+		}
+	public:
+
+		/**
+		 * Get token string, as passed to constructor
+		 * \return token as passed to constructor
+		 */
+		const std::string& get_token() const { return token; }
+		/**
+		 * Get header part as json string
+		 * \return header part after base64 decoding
+		 */
+		const std::string& get_header() const { return header; }
+		/**
+		 * Get payload part as json string
+		 * \return payload part after base64 decoding
+		 */
+		const std::string& get_payload() const { return payload; }
+		/**
+		 * Get signature part as json string
+		 * \return signature part after base64 decoding
+		 */
+		const std::string& get_signature() const { return signature; }
+		/**
+		 * Get header part as base64 string
+		 * \return header part before base64 decoding
+		 */
+		const std::string& get_header_base64() const { return header_base64; }
+		/**
+		 * Get payload part as base64 string
+		 * \return payload part before base64 decoding
+		 */
+		const std::string& get_payload_base64() const { return payload_base64; }
+		/**
+		 * Get signature part as base64 string
+		 * \return signature part before base64 decoding
+		 */
+		const std::string& get_signature_base64() const { return signature_base64; }
+
+	};
+
+#if JWT_HAS_STRING_VIEW
+	/**
+	 * Decoded token that references the caller's buffer instead of copying it.
+	 * The base64 parts are views into the token passed to the constructor, which must outlive this object.
+	 * Header, payload and signature are decoded into a single internal buffer.
+	 */
+	template<typename json_traits>
+	class basic_decoded_jwt_view : public basic_header<json_traits>, public basic_payload<json_traits> {
+	public:
+		typedef json_traits traits_type;
+	protected:
+		/// Unmodifed token, as passed to constructor
+		std::string_view token;
+		/// Unmodified header part in base64
+		std::string_view header_base64;
+		/// Unmodified payload part in base64
+		std::string_view payload_base64;
+		/// Unmodified signature part in base64
+		std::string_view signature_base64;
+		/// Decoded header, payload and signature, back to back
+		details::buffer decoded;
+		/// Length of the decoded header
+		size_t header_size = 0;
+		/// Length of the decoded payload
+		size_t payload_size = 0;
+	public:
+		/**
+		 * Constructor 
+		 * Parses a given token
+		 * \param token The token to parse, must outlive this object
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		explicit basic_decoded_jwt_view(std::string_view token, claim_parsing mode = claim_parsing::eager)
+			: basic_decoded_jwt_view(token, mode, typename details::claim_map<json_traits>::allocator_type(), details::no_observer(), nullptr)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token and reports sizes, stage timings and failures to an observer
+		 * \param token The token to parse, must outlive this object
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param observer Observer to report to, see null_observer
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		template<typename Observer>
+		basic_decoded_jwt_view(std::string_view token, claim_parsing mode, Observer& observer)
+			: basic_decoded_jwt_view(token, mode, typename details::claim_map<json_traits>::allocator_type(), observer, nullptr)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token without throwing if it is invalid
+		 * \param token The token to parse, must outlive this object
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param ec Receives the reason if the token is invalid, the object must not be used then
+		 * \throws std::bad_alloc
+		 */
+		basic_decoded_jwt_view(std::string_view token, claim_parsing mode, std::error_code& ec)
+			: basic_decoded_jwt_view(token, mode, typename details::claim_map<json_traits>::allocator_type(), details::no_observer(), &ec)
+		{}
+		/**
+		 * Constructor
+		 * Parses a given token without throwing if it is invalid, reporting to an observer
+		 * \param token The token to parse, must outlive this object
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \param observer Observer to report to, see null_observer
+		 * \param ec Receives the reason if the token is invalid, the object must not be used then
+		 * \throws std::bad_alloc
+		 */
+		template<typename Observer>
+		basic_decoded_jwt_view(std::string_view token, claim_parsing mode, Observer& observer, std::error_code& ec)
+			: basic_decoded_jwt_view(token, mode, typename details::claim_map<json_traits>::allocator_type(), observer, &ec)
+		{}
+#if JWT_HAS_MEMORY_RESOURCE
+		/**
+		 * Constructor
+		 * Parses a given token, allocating the decoded parts and the claims from a memory resource.
+		 * Nested json values inside claims are still allocated by picojson on the default heap.
+		 * \param token The token to parse, must outlive this object
+		 * \param resource Memory resource for the decoded storage, must outlive this object
+		 * \param mode Whether to parse the payload claims now or on first access
+		 * \throws std::invalid_argument Token is not in correct format
+		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 */
+		basic_decoded_jwt_view(std::string_view token, std::pmr::memory_resource* resource, claim_parsing mode = claim_parsing::eager)
+			: basic_decoded_jwt_view(token, mode, typename details::claim_map<json_traits>::allocator_type(resource), details::no_observer(), nullptr)
+		{}
+#endif
+	private:
+		template<typename Observer>
+		basic_decoded_jwt_view(std::string_view token, claim_parsing mode, const typename details::claim_map<json_traits>::allocator_type& alloc, Observer& observer, std::error_code* ec)
+			: basic_header<json_traits>(alloc), basic_payload<json_traits>(alloc), token(token), decoded(alloc)
+		{
+			if (ec != nullptr)
+				ec->clear();
+			details::stage_timer<Observer> decode_timer(observer, stage::base64_decode);
+			auto hdr_end = token.find('.');
+			auto payload_end = hdr_end == std::string_view::npos ? std::string_view::npos : token.find('.', hdr_end + 1);
+			if (payload_end == std::string_view::npos) {
+				details::reject_token(observer, failure::malformed_token, ec);
+				return;
+			}
+			header_base64 = token.substr(0, hdr_end);
+			payload_base64 = token.substr(hdr_end + 1, payload_end - hdr_end - 1);
+			signature_base64 = token.substr(payload_end + 1);
+			observer.on_token(header_base64.size(), payload_base64.size(), signature_base64.size());
+
+			decoded.resize(base::max_decoded_size(header_base64.size())
+				+ base::max_decoded_size(payload_base64.size())
+				+ base::max_decoded_size(signature_base64.size()));
+			char* out = &decoded[0];
+			size_t signature_size = 0;
+			if (!base::try_decode_into<alphabet::base64url_unpadded>(header_base64.data(), header_base64.size(), out, header_size)
+				|| !base::try_decode_into<alphabet::base64url_unpadded>(payload_base64.data(), payload_base64.size(), out + header_size, payload_size)
+				|| !base::try_decode_into<alphabet::base64url_unpadded>(signature_base64.data(), signature_base64.size(), out + header_size + payload_size, signature_size)) {
+				header_size = payload_size = 0;
+				decoded.clear();
+				details::reject_token(observer, failure::invalid_base64, ec);
+				return;
+			}
+			decoded.resize(header_size + payload_size + signature_size);
+			decode_timer.done();
+
+			details::stage_timer<Observer> parse_timer(observer, stage::json_parse);
+			if (!details::parse_claims<json_traits>(decoded.data(), decoded.data() + header_size, this->header_claims)
+				|| !this->set_payload_json(decoded.data() + header_size, decoded.data() + header_size + payload_size, mode)) {
+				details::reject_token(observer, failure::invalid_json, ec);
+				return;
+			}
+			parse_timer.done();
+		}
+	public:
+
+		/**
+		 * Get token string, as passed to constructor
+		 * \return token as passed to constructor
+		 */
+		std::string_view get_token() const { return token; }
+		/**
+		 * Get header part as json string
+		 * \return header part after base64 decoding
+		 */
+		std::string_view get_header() const { return std::string_view(decoded).substr(0, header_size); }
+		/**
+		 * Get payload part as json string
+		 * \return payload part after base64 decoding
+		 */
+		std::string_view get_payload() const { return std::string_view(decoded).substr(header_size, payload_size); }
+		/**
+		 * Get signature part as json string
+		 * \return signature part after base64 decoding
+		 */
+		std::string_view get_signature() const { return std::string_view(decoded).substr(header_size + payload_size); }
+		/**
+		 * Get header part as base64 string
+		 * \return header part before base64 decoding
+		 */
+		std::string_view get_header_base64() const { return header_base64; }
+		/**
+		 * Get payload part as base64 string
+		 * \return payload part before base64 decoding
+		 */
+		std::string_view get_payload_base64() const { return payload_base64; }
+		/**
+		 * Get signature part as base64 string
+		 * \return signature part before base64 decoding
+		 */
+		std::string_view get_signature_base64() const { return signature_base64; }
+	};
+#endif
+
+	typedef basic_payload<picojson_traits> payload;
+	typedef basic_header<picojson_traits> header;
+	typedef basic_decoded_jwt<picojson_traits> decoded_jwt;
+#if JWT_HAS_STRING_VIEW
+	typedef basic_decoded_jwt_view<picojson_traits> decoded_jwt_view;
+#endif
+
+	template<typename T, typename json_traits = picojson_traits>
+	class prepared_builder;
+	template<typename T>
+	class detached_signer;
+
+	namespace details {
+		template<typename T>
+		struct make_void { typedef void type; };
+
+		/// Signs data that starts with a fixed prefix, generic algorithms simply sign all of it
+		template<typename T, typename = void>
+		struct prefix_signer {
+			prefix_signer(const T&, const std::string&) {}
+			std::string sign(const T& algo, const std::string& data) const { return algo.sign(data); }
+		};
+		/// Algorithms providing a prefix_state only hash the part after the prefix
+		template<typename T>
+		struct prefix_signer<T, typename make_void<typename T::prefix_state>::type> {
+			typename T::prefix_state state;
+			prefix_signer(const T& algo, const std::string& prefix) : state(algo.prepare(prefix)) {}
+			std::string sign(const T& algo, const std::string& data) const { return algo.sign(state, data); }
+		};
+
+		/// Checks a signature without throwing, algorithms lacking an error_code overload are wrapped
+		template<typename T, typename = void>
+		struct signature_checker {
+			static void verify(T& algo, const std::string& data, const std::string& sig, std::error_code& ec) {
+				try {
+					algo.verify(data, sig);
+					ec.clear();
+				}
+				catch (const signature_verification_exception&) {
+					ec = make_error_code(failure::invalid_signature);
+				}
+			}
+		};
+		template<typename T>
+		struct signature_checker<T, typename make_void<decltype(std::declval<T&>().verify(std::declval<const std::string&>(), std::declval<const std::string&>(), std::declval<std::error_code&>()))>::type> {
+			static void verify(T& algo, const std::string& data, const std::string& sig, std::error_code& ec) {
+				algo.verify(data, sig, ec);
+			}
+		};
+
+		/// Algorithms without start() get the streamed data collected and sign or verify it as one string
+		template<typename T, typename>
+		struct stream_checker {
+			static algorithm::digest_stream start(const T&) {
+				return algorithm::digest_stream(algorithm::digest_stream::mode::collect, nullptr);
+			}
+			static std::string sign(const T& algo, algorithm::digest_stream& data) {
+				return algo.sign(data.collected);
+			}
+			static void verify(T& algo, algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) {
+				signature_checker<T>::verify(algo, data.collected, sig, ec);
+			}
+		};
+		template<typename T>
+		struct stream_checker<T, typename make_void<decltype(std::declval<const T&>().start())>::type> {
+			static algorithm::digest_stream start(const T& algo) {
+				return algo.start();
+			}
+			static std::string sign(const T& algo, algorithm::digest_stream& data) {
+				return algo.sign(data);
+			}
+			static void verify(T& algo, algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) {
+				algo.verify(data, sig, ec);
+			}
+		};
+
+		/**
+		 * Signing input of a token with a detached payload (RFC 7515 appendix F): the encoded header, a dot
+		 * and the payload, which is base64url encoded in small blocks on its way into the stream unless it
+		 * is unencoded (RFC 7797). Not movable, the encoder refers to the scratch string.
+		 */
+		class detached_input {
+		public:
+			detached_input(algorithm::digest_stream stream, const std::string& header_base64, payload_encoding encoding)
+				: stream(std::move(stream)), encoder(scratch), encode(encoding == payload_encoding::base64url)
+			{
+				this->stream.update(header_base64).update(".", 1);
+			}
+			detached_input(const detached_input&) = delete;
+			detached_input& operator=(const detached_input&) = delete;
+
+			void update(const char* data, size_t size) {
+				if (!encode) {
+					stream.update(data, size);
+					return;
+				}
+				// Bounds the scratch string to a few kilobytes however large the input
+				while (size > 0) {
+					const size_t n = std::min<size_t>(size, 3 * 1024);
+					encoder.write(data, n);
+					stream.update(scratch);
+					scratch.clear();
+					data += n;
+					size -= n;
+				}
+			}
+			/// Add the rest of the encoded payload, call once after all of it was passed to update
+			algorithm::digest_stream& finish() {
+				if (encode) {
+					encoder.finish();
+					stream.update(scratch);
+					scratch.clear();
+				}
+				return stream;
+			}
+		private:
+			algorithm::digest_stream stream;
+			std::string scratch;
+			base::encoder<alphabet::base64url_unpadded> encoder;
+			bool encode;
+		};
+
+		/// Header of a token with a detached payload, which has no payload claims
+		template<typename json_traits>
+		class detached_header : public basic_header<json_traits> {
+		public:
+			/// \return false if the header is not a JSON object
+			bool parse(const std::string& json) {
+				return parse_claims<json_traits>(json.data(), json.data() + json.size(), this->header_claims);
+			}
+			/**
+			 * Read the b64 header (RFC 7797)
+			 * \return false if b64 is not a boolean or not listed in crit, or crit lists anything else
+			 */
+			bool payload_encoding_of(payload_encoding& encoding) const {
+				encoding = payload_encoding::base64url;
+				bool critical = false;
+				if (this->has_header_claim("crit")) {
+					const basic_claim<json_traits>& crit = this->get_header_claim("crit");
+					if (crit.get_type() != json::type::array)
+						return false;
+					for (const auto& name : crit.as_array()) {
+						// b64 is the only extension understood here (RFC 7515 4.1.11)
+						if (json_traits::get_type(name) != json::type::string || json_traits::as_string(name) != "b64")
+							return false;
+						critical = true;
+					}
+					if (!critical)
+						return false;
+				}
+				if (!this->has_header_claim("b64"))
+					return !critical;
+				const basic_claim<json_traits>& b64 = this->get_header_claim("b64");
+				if (b64.get_type() != json::type::boolean || !critical)
+					return false;
+				if (!b64.as_bool())
+					encoding = payload_encoding::unencoded;
+				return true;
+			}
+		};
+	}
+
+	/**
+	 * Builder class to build and sign a new token
+	 * Use jwt::create() to get an instance of this class.
+	 */
+	template<typename json_traits>
+	class basic_builder {
+		/// Ordered, so tokens are serialized with sorted keys
+		std::map<std::string, basic_claim<json_traits>> header_claims;
+		std::map<std::string, basic_claim<json_traits>> payload_claims;
+
+		template<typename, typename>
+		friend class prepared_builder;
+	public:
+		/**
+		 * Constructor for an empty token, jwt::create() returns one using the default json backend
+		 */
+		basic_builder() {}
+		/**
+		 * Set a header claim.
+		 * \param id Name of the claim
+		 * \param c Claim to add
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_header_claim(const std::string& id, basic_claim<json_traits> c) { header_claims[id] = std::move(c); return *this; }
+		/**
+		 * Set a payload claim.
+		 * \param id Name of the claim
+		 * \param c Claim to add
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_payload_claim(const std::string& id, basic_claim<json_traits> c) { payload_claims[id] = std::move(c); return *this; }
+		/**
+		 * Set algorithm claim
+		 * You normally don't need to do this, as the algorithm is automatically set if you don't change it.
+		 * \param str Name of algorithm
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_algorithm(const std::string& str) { return set_header_claim("alg", basic_claim<json_traits>(str)); }
+		/**
+		 * Set type claim
+		 * \param str Type to set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_type(const std::string& str) { return set_header_claim("typ", basic_claim<json_traits>(str)); }
+		/**
+		 * Set content type claim
+		 * \param str Type to set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_content_type(const std::string& str) { return set_header_claim("cty", basic_claim<json_traits>(str)); }
+		/**
+		 * Set key id claim
+		 * \param str Key id to set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_key_id(const std::string& str) { return set_header_claim("kid", basic_claim<json_traits>(str)); }
+		/**
+		 * Set issuer claim
+		 * \param str Issuer to set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_issuer(const std::string& str) { return set_payload_claim("iss", basic_claim<json_traits>(str)); }
+		/**
+		 * Set subject claim
+		 * \param str Subject to set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_subject(const std::string& str) { return set_payload_claim("sub", basic_claim<json_traits>(str)); }
+		/**
+		 * Set audience claim
+		 * \param l Audience set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_audience(const std::set<std::string>& l) { return set_payload_claim("aud", basic_claim<json_traits>(l)); }
+		/**
+		 * Set audience claim
+		 * \param aud Single audience
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_audience(const std::string& aud) { return set_payload_claim("aud", basic_claim<json_traits>(aud)); }
+		/**
+		 * Set expires at claim
+		 * \param d Expires time
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_expires_at(const date& d) { return set_payload_claim("exp", basic_claim<json_traits>(d)); }
+		/**
+		 * Set not before claim
+		 * \param d First valid time
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_not_before(const date& d) { return set_payload_claim("nbf", basic_claim<json_traits>(d)); }
+		/**
+		 * Set issued at claim
+		 * \param d Issued at time, should be current time
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_issued_at(const date& d) { return set_payload_claim("iat", basic_claim<json_traits>(d)); }
+		/**
+		 * Set id claim
+		 * \param str ID to set
+		 * \return *this to allow for method chaining
+		 */
+		basic_builder& set_id(const std::string& str) { return set_payload_claim("jti", basic_claim<json_traits>(str)); }
+
+		/**
+		 * Sign token and return result
+		 * \param algo Instance of an algorithm to sign the token with
+		 * \return Final token as a string
+		 */
+		template<typename T>
+		std::string sign(const T& algo) {
+			std::string token;
+			sign_into(algo, token);
+			return token;
+		}
+		/**
+		 * Sign token and write it into out.
+		 * The claims are serialized straight through a base64url encoder, so reusing out for several tokens
+		 * avoids allocations once it is large enough.
+		 * \param algo Instance of an algorithm to sign the token with
+		 * \param out String receiving the token, its previous contents are replaced
+		 */
+		template<typename T>
+		void sign_into(const T& algo, std::string& out) {
+			this->set_algorithm(algo.name());
+
+			out.clear();
+			write_segment(header_claims, out);
+			out += '.';
+			write_segment(payload_claims, out);
+
+			const std::string signature = algo.sign(out);
+			out += '.';
+			base::append_encoded<alphabet::base64url_unpadded>(signature.data(), signature.size(), out);
+		}
+		/**
+		 * Sign token and write it to an output iterator
+		 * \param algo Instance of an algorithm to sign the token with
+		 * \param out Iterator receiving the characters of the token
+		 * \return Iterator past the last character written
+		 */
+		template<typename T, typename OutputIterator>
+		OutputIterator sign_into(const T& algo, OutputIterator out) {
+			thread_local std::string buffer;
+			sign_into(algo, buffer);
+			return std::copy(buffer.begin(), buffer.end(), out);
+		}
+		/**
+		 * Prepare a template for issuing many tokens that share the current claims.
+		 * The header and the payload claims set so far are encoded once, tokens signed from the template
+		 * only serialize the claims set on it. Algorithms providing prepare() (currently HMAC) also keep
+		 * the hash state after the shared prefix, so it is not hashed again for every token.
+		 * \param algo Instance of an algorithm to sign the tokens with
+		 * \return Template holding a copy of algo
+		 */
+		template<typename T>
+		prepared_builder<T, json_traits> prepare(const T& algo) {
+			this->set_algorithm(algo.name());
+			return prepared_builder<T, json_traits>(*this, algo);
+		}
+		/**
+		 * Start signing a token with a detached payload (RFC 7515 appendix F), which is passed to the
+		 * returned signer in pieces and never has to be held in memory as a whole. Payload claims are not used.
+		 * With payload_encoding::unencoded the header gets b64 false and crit ["b64"] and the payload is
+		 * signed as is (RFC 7797), otherwise it is signed in base64url like an attached payload and
+		 * b64 and crit left from an earlier unencoded signature are removed.
+		 * \param algo Instance of an algorithm to sign the token with
+		 * \param encoding How the payload is signed
+		 * \return Signer holding a copy of algo
+		 */
+		template<typename T>
+		detached_signer<T> sign_detached(const T& algo, payload_encoding encoding = payload_encoding::base64url) {
+			this->set_algorithm(algo.name());
+			if (encoding == payload_encoding::unencoded) {
+				static const char no[] = "false";
+				typename json_traits::value_type b64;
+				json_traits::parse(b64, no, no + sizeof(no) - 1);
+				set_header_claim("b64", basic_claim<json_traits>(std::move(b64)));
+				set_header_claim("crit", basic_claim<json_traits>(std::set<std::string>{ "b64" }));
+			}
+			else if (header_claims.erase("b64") != 0)
+				header_claims.erase("crit");
+			std::string header;
+			write_segment(header_claims, header);
+			return detached_signer<T>(algo, std::move(header), encoding);
+		}
+	private:
+		/// Append the base64url encoded JSON object of claims to out
+		static void write_segment(const std::map<std::string, basic_claim<json_traits>>& claims, std::string& out) {
+			base::encoder<alphabet::base64url_unpadded> enc(out);
+			enc.put('{');
+			write_claims(claims, true, enc);
+			enc.put('}');
+			enc.finish();
+		}
+		/// Serialize claims as comma separated members of a JSON object
+		template<typename Writer>
+		static void write_claims(const std::map<std::string, basic_claim<json_traits>>& claims, bool first, Writer& w) {
+			for (auto& e : claims) {
+				if (!first)
+					w.put(',');
+				first = false;
+				// Names are plain strings, escaped the same way whatever the backend
+				picojson::serialize_str(e.first, w.begin());
+				w.put(':');
+				json_traits::serialize(e.second.val, w.begin());
+			}
+		}
+	};
+
+	/**
+	 * Template for issuing tokens that share their header and part of their payload.
+	 * Get one from builder::prepare, set the claims that change per token and sign. Copies are cheap since
+	 * the encoded prefix is shared, for concurrent issuance give every thread its own copy.
+	 */
+	template<typename T, typename json_traits>
+	class prepared_builder {
+		struct shared {
+			T algo;
+			/// Encoded header, '.' and the static payload claims up to the last complete base64 block
+			std::string prefix;
+			/// Serialized static payload left over after the last complete block, at most 2 chars
+			std::string pending;
+			/// Whether the static claims are followed by a ',' before dynamic claims
+			bool has_static;
+			/// Names of the static payload claims, the claims themselves are only needed while preparing
+			std::set<std::string> static_names;
+			details::prefix_signer<T> signer;
+
+			shared(const basic_builder<json_traits>& b, const T& a, std::string p, std::string rest)
+				: algo(a), prefix(std::move(p)), pending(std::move(rest)), has_static(!b.payload_claims.empty()),
+				signer(algo, prefix)
+			{
+				for (auto& e : b.payload_claims)
+					static_names.insert(static_names.end(), e.first);
+			}
+		};
+		/// Collects serialized JSON in a string, used to find the encodable part of the static payload
+		struct string_writer {
+			std::string& out;
+			std::back_insert_iterator<std::string> begin() { return std::back_inserter(out); }
+			void put(char c) { out += c; }
+		};
+		std::shared_ptr<const shared> tmpl;
+		std::map<std::string, basic_claim<json_traits>> payload_claims;
+
+		friend class basic_builder<json_traits>;
+		prepared_builder(const basic_builder<json_traits>& b, const T& algo) {
+			std::string token;
+			basic_builder<json_traits>::write_segment(b.header_claims, token);
+			token += '.';
+
+			std::string json = "{";
+			string_writer w{json};
+			basic_builder<json_traits>::write_claims(b.payload_claims, true, w);
+			const size_t full = json.size() - json.size() % 3;
+			base::append_encoded<alphabet::base64url_unpadded>(json.data(), full, token);
+			tmpl = std::make_shared<const shared>(b, algo, std::move(token), json.substr(full));
+		}
+	public:
+		/**
+		 * Set a payload claim for the next tokens
+		 * \param id Name of the claim
+		 * \param c Claim to add
+		 * \return *this to allow for method chaining
+		 * \throws std::invalid_argument If the claim is already part of the template
+		 */
+		prepared_builder& set_payload_claim(const std::string& id, basic_claim<json_traits> c) {
+			if (tmpl->static_names.count(id) != 0)
+				throw std::invalid_argument("claim is already set by the template");
+			payload_claims[id] = std::move(c);
+			return *this;
+		}
+		/**
+		 * Remove all claims set since the template was prepared
+		 * \return *this to allow for method chaining
+		 */
+		prepared_builder& clear() { payload_claims.clear(); return *this; }
+		/**
+		 * Set subject claim
+		 * \param str Subject to set
+		 * \return *this to allow for method chaining
+		 */
+		prepared_builder& set_subject(const std::string& str) { return set_payload_claim("sub", basic_claim<json_traits>(str)); }
 		/**
-		 * ES384 algorithm
+		 * Set expires at claim
+		 * \param d Expires time
+		 * \return *this to allow for method chaining
 		 */
-		struct es384 : public ecdsa {
-#if 0
-			/**
-			 * Construct new instance of algorithm
-			 * \param public_key ECDSA public key in PEM format
-			 * \param private_key ECDSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 */
-			es384(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: ecdsa(public_key, private_key, public_key_password, private_key_password, EVP_sha384, "ES384")
-			{}
-#endif
-			es384(const mbedtls_ecp_keypair *keypair)
-				: ecdsa(keypair, MBEDTLS_MD_SHA384, "ES384")
-			{}
-		};
+		prepared_builder& set_expires_at(const date& d) { return set_payload_claim("exp", basic_claim<json_traits>(d)); }
 		/**
-		 * ES512 algorithm
+		 * Set not before claim
+		 * \param d First valid time
+		 * \return *this to allow for method chaining
 		 */
-		struct es512 : public ecdsa {
-#if 0
-			/**
-			 * Construct new instance of algorithm
-			 * \param public_key ECDSA public key in PEM format
-			 * \param private_key ECDSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 */
-			es512(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: ecdsa(public_key, private_key, public_key_password, private_key_password, EVP_sha512, "ES512")
-			{}
-#endif
-			es512(const mbedtls_ecp_keypair *keypair)
-				: ecdsa(keypair, MBEDTLS_MD_SHA512, "ES512")
-			{}
-		};
-
-#if 0
+		prepared_builder& set_not_before(const date& d) { return set_payload_claim("nbf", basic_claim<json_traits>(d)); }
 		/**
-		 * PS256 algorithm
+		 * Set issued at claim
+		 * \param d Issued at time, should be current time
+		 * \return *this to allow for method chaining
 		 */
-		struct ps256 : public pss {
-			/**
-			 * Construct new instance of algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 */
-			ps256(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: pss(public_key, private_key, public_key_password, private_key_password, EVP_sha256, "PS256")
-			{}
-		};
+		prepared_builder& set_issued_at(const date& d) { return set_payload_claim("iat", basic_claim<json_traits>(d)); }
 		/**
-		 * PS384 algorithm
+		 * Set id claim
+		 * \param str ID to set
+		 * \return *this to allow for method chaining
 		 */
-		struct ps384 : public pss {
-			/**
-			 * Construct new instance of algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 */
-			ps384(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: pss(public_key, private_key, public_key_password, private_key_password, EVP_sha384, "PS384")
-			{}
-		};
+		prepared_builder& set_id(const std::string& str) { return set_payload_claim("jti", basic_claim<json_traits>(str)); }
+
 		/**
-		 * PS512 algorithm
+		 * Sign a token made of the template and the claims set on this object
+		 * \return Final token as a string
 		 */
-		struct ps512 : public pss {
-			/**
-			 * Construct new instance of algorithm
-			 * \param public_key RSA public key in PEM format
-			 * \param private_key RSA private key or empty string if not available. If empty, signing will always fail.
-			 * \param public_key_password Password to decrypt public key pem.
-			 * \param privat_key_password Password to decrypt private key pem.
-			 */
-			ps512(const std::string& public_key, const std::string& private_key = "", const std::string& public_key_password = "", const std::string& private_key_password = "")
-				: pss(public_key, private_key, public_key_password, private_key_password, EVP_sha512, "PS512")
-			{}
-		};
-#endif
-	}
+		std::string sign() const {
+			std::string token;
+			sign_into(token);
+			return token;
+		}
+		/**
+		 * Sign a token made of the template and the claims set on this object into out
+		 * \param out String receiving the token, its previous contents are replaced
+		 */
+		void sign_into(std::string& out) const {
+			const shared& t = *tmpl;
+			out.assign(t.prefix);
+			{
+				base::encoder<alphabet::base64url_unpadded> enc(out);
+				enc.write(t.pending.data(), t.pending.size());
+				basic_builder<json_traits>::write_claims(payload_claims, !t.has_static, enc);
+				enc.put('}');
+				enc.finish();
+			}
+			const std::string signature = t.signer.sign(t.algo, out);
+			out += '.';
+			base::append_encoded<alphabet::base64url_unpadded>(signature.data(), signature.size(), out);
+		}
+	};
 
 	/**
-	 * Convenience wrapper for JSON value
+	 * Signer for a token with a detached payload, get one from builder::sign_detached.
+	 * Pass the payload to update() in as many pieces as it arrives in, finish() returns the token with an
+	 * empty payload part, "header..signature". The algorithms of this library hash the payload as it comes,
+	 * others without start() get it collected and signed as one string.
 	 */
-	class claim {
-		picojson::value val;
+	template<typename T>
+	class detached_signer {
 	public:
-		enum class type {
-			null,
-			boolean,
-			number,
-			string,
-			array,
-			object,
-			int64
-		};
-
-		claim()
-			: val()
-		{}
-#if JWT_CLAIM_EXPLICIT
-		explicit claim(std::string s)
-			: val(std::move(s))
-		{}
-		explicit claim(const date& s)
-			: val(int64_t(std::chrono::system_clock::to_time_t(s)))
-		{}
-		explicit claim(const std::set<std::string>& s)
-			: val(picojson::array(s.cbegin(), s.cend()))
-		{}
-		explicit claim(const picojson::value& val)
-			: val(val)
-		{}
-#else
-		claim(std::string s)
-			: val(std::move(s))
-		{}
-		claim(const date& s)
-			: val(int64_t(std::chrono::system_clock::to_time_t(s)))
-		{}
-		claim(const std::set<std::string>& s)
-			: val(picojson::array(s.cbegin(), s.cend()))
-		{}
-		claim(const picojson::value& val)
-			: val(val)
-		{}
-#endif
-
 		/**
-		 * Get wrapped json object
-		 * \return Wrapped json object
+		 * \param algo Algorithm to sign with, copied
+		 * \param header_base64 Encoded header of the token
+		 * \param encoding Whether the header marks the payload as unencoded
 		 */
-		picojson::value to_json() const {
-			return val;
+		detached_signer(const T& algo, std::string header_base64, payload_encoding encoding)
+			: algo(algo), header_base64(std::move(header_base64))
+		{
+			input.reset(new details::detached_input(details::stream_checker<T>::start(this->algo), this->header_base64, encoding));
 		}
-
 		/**
-		 * Get type of contained object
-		 * \return Type
-		 * \throws std::logic_error An internal error occured
+		 * Add the next part of the payload
+		 * \param data Payload bytes
+		 * \param size Length of data
+		 * \return *this to allow chaining
 		 */
-		type get_type() const {
-			if (val.is<picojson::null>()) return type::null;
-			else if (val.is<bool>()) return type::boolean;
-			else if (val.is<int64_t>()) return type::int64;
-			else if (val.is<double>()) return type::number;
-			else if (val.is<std::string>()) return type::string;
-			else if (val.is<picojson::array>()) return type::array;
-			else if (val.is<picojson::object>()) return type::object;
-			else throw std::logic_error("internal error");
+		detached_signer& update(const char* data, size_t size) {
+			input->update(data, size);
+			return *this;
 		}
-
+#if JWT_HAS_STRING_VIEW
+		/// Add the next part of the payload
+		detached_signer& update(std::string_view data) { return update(data.data(), data.size()); }
+#else
+		/// Add the next part of the payload
+		detached_signer& update(const std::string& data) { return update(data.data(), data.size()); }
+#endif
 		/**
-		 * Get the contained object as a string
-		 * \return content as string
-		 * \throws std::bad_cast Content was not a string
+		 * Add a chain of buffers, such as the pieces of a socket read
+		 * \param first Iterator to the first buffer, buffers provide data() and size()
+		 * \param last Iterator past the last buffer
+		 * \return *this to allow chaining
 		 */
-		const std::string& as_string() const {
-			if (!val.is<std::string>())
-				throw std::bad_cast();
-			return val.get<std::string>();
+		template<typename Iterator>
+		detached_signer& update(Iterator first, Iterator last) {
+			for (; first != last; ++first)
+				update((const char*)first->data(), first->size());
+			return *this;
 		}
 		/**
-		 * Get the contained object as a date
-		 * \return content as date
-		 * \throws std::bad_cast Content was not a date
+		 * Sign the payload passed so far, the signer can not be used afterwards
+		 * \return Token with an empty payload part
+		 * \throws signature_generation_exception
 		 */
-		date as_date() const {
-			return std::chrono::system_clock::from_time_t(as_int());
+		std::string finish() {
+			const std::string signature = details::stream_checker<T>::sign(algo, input->finish());
+			std::string token;
+			token.reserve(header_base64.size() + 2 + base::encoded_size<alphabet::base64url_unpadded>(signature.size()));
+			token.append(header_base64).append("..");
+			base::append_encoded<alphabet::base64url_unpadded>(signature.data(), signature.size(), token);
+			return token;
 		}
+	private:
+		T algo;
+		std::string header_base64;
+		std::unique_ptr<details::detached_input> input;
+	};
+
+	typedef basic_builder<picojson_traits> builder;
+
+	/**
+	 * Fixed size thread pool running batches of work.
+	 * A batch is split into ranges that are spread over one queue per thread. Threads that run out of
+	 * work steal ranges from the other queues, so a few slow items do not hold up the rest of the batch.
+	 */
+	class thread_pool {
+		typedef std::function<void(size_t, size_t)> job_type;
+		struct work_queue {
+			std::mutex mutex;
+			std::deque<std::pair<size_t, size_t>> ranges;
+		};
+
+		/// One queue per worker, the last one belongs to the thread calling run
+		std::vector<std::unique_ptr<work_queue>> queues;
+		std::vector<std::thread> threads;
+		/// Serializes calls to run
+		std::mutex run_mutex;
+		/// Protects job, generation, active and stopping
+		std::mutex state_mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		const job_type* job = nullptr;
+		size_t generation = 0;
+		/// Workers currently taking part in a batch
+		size_t active = 0;
+		bool stopping = false;
+		/// Ranges of the current batch not finished yet
+		std::atomic<size_t> pending{ 0 };
+		std::mutex error_mutex;
+		std::exception_ptr error;
+	public:
 		/**
-		 * Get the contained object as an array
-		 * \return content as array
-		 * \throws std::bad_cast Content was not an array
+		 * Start a new pool
+		 * \param workers Number of threads to start in addition to the thread calling run
 		 */
-		const picojson::array& as_array() const {
-			if (!val.is<picojson::array>())
-				throw std::bad_cast();
-			return val.get<picojson::array>();
+		explicit thread_pool(size_t workers = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0) {
+			for (size_t i = 0; i <= workers; i++)
+				queues.emplace_back(new work_queue());
+			for (size_t i = 0; i < workers; i++)
+				threads.emplace_back(&thread_pool::worker, this, i);
+		}
+		~thread_pool() {
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (auto& t : threads)
+				t.join();
 		}
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
 		/**
-		 * Get the contained object as a set of strings
-		 * \return content as set of strings
-		 * \throws std::bad_cast Content was not a set
+		 * Number of threads working on a batch, including the calling thread
 		 */
-		const std::set<std::string> as_set() const {
-			std::set<std::string> res;
-			for(auto& e : as_array()) {
-				if(!e.is<std::string>())
-					throw std::bad_cast();
-				res.insert(e.get<std::string>());
-			}
-			return res;
+		size_t concurrency() const {
+			return queues.size();
 		}
+
 		/**
-		 * Get the contained object as an integer
-		 * \return content as int
-		 * \throws std::bad_cast Content was not an int
+		 * Run fn over [0, count) and wait until all of it is done.
+		 * The calling thread works on the batch as well. Concurrent calls run one after another.
+		 * \param count Number of items
+		 * \param grain Maximum number of items passed to a single call of fn
+		 * \param fn Function called with the begin and end of a range of items
+		 * \throws Rethrows the first exception thrown by fn after the batch is done
 		 */
-		int64_t as_int() const {
-			if (!val.is<int64_t>())
-				throw std::bad_cast();
-			return val.get<int64_t>();
+		void run(size_t count, size_t grain, const job_type& fn) {
+			if (count == 0)
+				return;
+			if (grain == 0)
+				grain = 1;
+			std::lock_guard<std::mutex> run_lock(run_mutex);
+			size_t ranges = 0;
+			for (size_t begin = 0; begin < count; begin += grain, ranges++) {
+				work_queue& q = *queues[ranges % queues.size()];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				q.ranges.emplace_back(begin, count - begin < grain ? count : begin + grain);
+			}
+			pending = ranges;
+			error = nullptr;
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				job = &fn;
+				generation++;
+			}
+			wake.notify_all();
+
+			work(queues.size() - 1, fn);
+
+			std::unique_lock<std::mutex> lock(state_mutex);
+			done.wait(lock, [this]() { return pending == 0 && active == 0; });
+			job = nullptr;
+			lock.unlock();
+			if (error)
+				std::rethrow_exception(error);
+		}
+	private:
+		void worker(size_t self) {
+			size_t seen = 0;
+			std::unique_lock<std::mutex> lock(state_mutex);
+			while (true) {
+				wake.wait(lock, [&]() { return stopping || (job != nullptr && generation != seen); });
+				if (stopping)
+					return;
+				seen = generation;
+				const job_type* fn = job;
+				active++;
+				lock.unlock();
+				work(self, *fn);
+				lock.lock();
+				active--;
+				done.notify_all();
+			}
+		}
+
+		void work(size_t self, const job_type& fn) {
+			std::pair<size_t, size_t> range;
+			while (take(self, range)) {
+				try {
+					fn(range.first, range.second);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+				if (pending.fetch_sub(1) == 1) {
+					std::lock_guard<std::mutex> lock(state_mutex);
+					done.notify_all();
+				}
+			}
+		}
+
+		/// Pop from the back of our own queue, steal from the front of the others
+		bool take(size_t self, std::pair<size_t, size_t>& range) {
+			{
+				work_queue& q = *queues[self];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (!q.ranges.empty()) {
+					range = q.ranges.back();
+					q.ranges.pop_back();
+					return true;
+				}
+			}
+			for (size_t i = 1; i < queues.size(); i++) {
+				work_queue& q = *queues[(self + i) % queues.size()];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (!q.ranges.empty()) {
+					range = q.ranges.front();
+					q.ranges.pop_front();
+					return true;
+				}
+			}
+			return false;
 		}
+	};
+
+	/**
+	 * Threads running posted jobs in the order they were posted.
+	 * Meant to keep signature checks off threads that must not block, like those of an event loop.
+	 * verifier::verify_async accepts any type with a post(std::function<void()>) member instead, for
+	 * example one handing jobs to an io_context or collecting them for a hardware accelerator.
+	 */
+	class crypto_executor {
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::function<void()>> jobs;
+		bool stopping = false;
+	public:
 		/**
-		 * Get the contained object as a bool
-		 * \return content as bool
-		 * \throws std::bad_cast Content was not a bool
+		 * Start the threads
+		 * \param workers Number of threads to start, at least one
 		 */
-		bool as_bool() const {
-			if (!val.is<bool>())
-				throw std::bad_cast();
-			return val.get<bool>();
+		explicit crypto_executor(size_t workers = 1) {
+			if (workers == 0)
+				workers = 1;
+			for (size_t i = 0; i < workers; i++)
+				threads.emplace_back(&crypto_executor::worker, this);
+		}
+		/// Runs all jobs posted so far before returning
+		~crypto_executor() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (auto& t : threads)
+				t.join();
 		}
+		crypto_executor(const crypto_executor&) = delete;
+		crypto_executor& operator=(const crypto_executor&) = delete;
+
 		/**
-		 * Get the contained object as a number
-		 * \return content as double
-		 * \throws std::bad_cast Content was not a number
+		 * Queue a job to run on one of the threads
+		 * \param job Function to run, must not throw
 		 */
-		double as_number() const {
-			if (!val.is<double>())
-				throw std::bad_cast();
-			return val.get<double>();
+		void post(std::function<void()> job) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs.push_back(std::move(job));
+			}
+			wake.notify_one();
+		}
+	private:
+		void worker() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+				std::function<void()> job = std::move(jobs.front());
+				jobs.pop_front();
+				lock.unlock();
+				job();
+				lock.lock();
+			}
 		}
 	};
 
 	/**
-	 * Base class that represents a token payload.
-	 * Contains Convenience accessors for common claims.
+	 * Outcome of verifying a single token of a batch
 	 */
-	class payload {
-	protected:
-		std::unordered_map<std::string, claim> payload_claims;
+	struct verify_result {
+		/// Whether the token was decoded and verified successfully
+		bool valid = false;
+		/// Reason of the failure, empty if valid
+		std::string error;
+		/// Reason of the failure as jwt::failure, empty if valid or if an exception was caught instead
+		std::error_code code;
+	};
+
+	/**
+	 * Sharded cache of tokens whose signature has already been verified.
+	 * Entries are keyed on a SHA-256 digest of the signed data and the signature and expire no later
+	 * than the token. A hit only skips the signature check, claims are still checked every time.
+	 */
+	class verified_token_cache {
 	public:
+		typedef std::array<unsigned char, 32> key_type;
+
 		/**
-		 * Check if issuer is present ("iss")
-		 * \return true if present, false otherwise
+		 * Create an empty cache
+		 * \param capacity Maximum number of tokens to remember
+		 * \param shards Number of independently locked parts
 		 */
-		bool has_issuer() const noexcept { return has_payload_claim("iss"); }
+		explicit verified_token_cache(size_t capacity = 4096, size_t shards = 16)
+			: max_entries(capacity)
+		{
+			if (shards == 0)
+				shards = 1;
+			shard_capacity = (capacity + shards - 1) / shards;
+			for (size_t i = 0; i < shards; i++)
+				this->shards.emplace_back(new shard());
+		}
+
 		/**
-		 * Check if subject is present ("sub")
-		 * \return true if present, false otherwise
+		 * Compute the cache key of a token
+		 * \param data Signed part of the token (header and payload in base64)
+		 * \param signature Decoded signature
+		 * \param key_fingerprint Digest identifying the verification key if it can change, nullptr otherwise
 		 */
-		bool has_subject() const noexcept { return has_payload_claim("sub"); }
+		static key_type make_key(const char* data, size_t data_len, const char* signature, size_t signature_len, const std::array<unsigned char, 32>* key_fingerprint = nullptr) {
+			key_type key;
+			mbedtls_sha256_context ctx;
+			mbedtls_sha256_init(&ctx);
+			if (mbedtls_sha256_starts_ret(&ctx, 0) != 0
+				|| mbedtls_sha256_update_ret(&ctx, (const unsigned char*)data, data_len) != 0
+				|| mbedtls_sha256_update_ret(&ctx, (const unsigned char*)".", 1) != 0
+				|| mbedtls_sha256_update_ret(&ctx, (const unsigned char*)signature, signature_len) != 0
+				|| (key_fingerprint != nullptr && mbedtls_sha256_update_ret(&ctx, key_fingerprint->data(), key_fingerprint->size()) != 0)
+				|| mbedtls_sha256_finish_ret(&ctx, key.data()) != 0) {
+				mbedtls_sha256_free(&ctx);
+				throw std::runtime_error("failed to hash token");
+			}
+			mbedtls_sha256_free(&ctx);
+			return key;
+		}
+
+		/**
+		 * Check whether a token is known, dropping it if it has expired
+		 * \param key Key of the token
+		 * \param now Current time
+		 */
+		bool contains(const key_type& key, date now) {
+			shard& s = shard_for(key);
+			std::lock_guard<std::mutex> lock(s.mutex);
+			auto it = s.entries.find(key);
+			if (it == s.entries.end())
+				return false;
+			if (it->second <= now) {
+				s.entries.erase(it);
+				return false;
+			}
+			return true;
+		}
+
+		/**
+		 * Remember a token.
+		 * If its shard is full, expired entries are dropped first, then an arbitrary one.
+		 * \param key Key of the token
+		 * \param expires Time at which the entry must be forgotten
+		 * \param now Current time
+		 */
+		void insert(const key_type& key, date expires, date now) {
+			if (expires <= now || shard_capacity == 0)
+				return;
+			shard& s = shard_for(key);
+			std::lock_guard<std::mutex> lock(s.mutex);
+			if (s.entries.size() >= shard_capacity && s.entries.count(key) == 0) {
+				for (auto it = s.entries.begin(); it != s.entries.end();) {
+					if (it->second <= now)
+						it = s.entries.erase(it);
+					else
+						++it;
+				}
+				if (s.entries.size() >= shard_capacity)
+					s.entries.erase(s.entries.begin());
+			}
+			s.entries[key] = expires;
+		}
+
+		/// Forget all tokens
+		void clear() {
+			for (auto& s : shards) {
+				std::lock_guard<std::mutex> lock(s->mutex);
+				s->entries.clear();
+			}
+		}
+
+		/// Number of tokens currently remembered, including expired ones not dropped yet
+		size_t size() const {
+			size_t res = 0;
+			for (auto& s : shards) {
+				std::lock_guard<std::mutex> lock(s->mutex);
+				res += s->entries.size();
+			}
+			return res;
+		}
+
+		/// Capacity passed to the constructor
+		size_t capacity() const { return max_entries; }
+		/// Number of shards
+		size_t shard_count() const { return shards.size(); }
+	private:
+		struct key_hash {
+			size_t operator()(const key_type& key) const {
+				size_t res;
+				memcpy(&res, key.data(), sizeof(res));
+				return res;
+			}
+		};
+		struct shard {
+			mutable std::mutex mutex;
+			std::unordered_map<key_type, date, key_hash> entries;
+		};
+
+		shard& shard_for(const key_type& key) {
+			// The first bytes are used by key_hash, pick the shard from the last one
+			return *shards[key[key.size() - 1] % shards.size()];
+		}
+
+		size_t max_entries;
+		size_t shard_capacity;
+		std::vector<std::unique_ptr<shard>> shards;
+	};
+
+	/**
+	 * Set of revoked or already used token ids (the jti claim), see verifier::with_revocation_list and
+	 * verifier::with_replay_protection.
+	 * Ids are kept in 64 time buckets by the time they may be forgotten, usually the exp of their token, and a
+	 * bucket is dropped as a whole once that time has passed. Ids that would have to be kept longer than the
+	 * horizon are refused, since forgetting them early would accept the token again. Lookups take no lock: a Bloom filter with one bit
+	 * slice per bucket answers most of them, the others probe an open addressing table of 64 bit fingerprints.
+	 * Adding an id locks one of a few stripes, so the same id is never stored twice.
+	 */
+	class revocation_list {
+	public:
 		/**
-		 * Check if audience is present ("aud")
-		 * \return true if present, false otherwise
+		 * Create an empty list
+		 * \param capacity Number of ids the list is sized for, it holds twice as many before it is full
+		 * \param horizon Longest time an id is kept, ids expiring later are refused
 		 */
-		bool has_audience() const noexcept { return has_payload_claim("aud"); }
+		explicit revocation_list(size_t capacity = 16384, std::chrono::seconds horizon = std::chrono::hours(24))
+			: max_entries(capacity)
+		{
+			size_t size = 64;
+			while (size < capacity * 2)
+				size *= 2;
+			table_mask = size - 1;
+			table.reset(new std::atomic<uint64_t>[size]());
+			filter_mask = size - 1;
+			filter.reset(new std::atomic<uint64_t>[size]());
+			// An id may be kept a bucket longer than asked for, the two outermost buckets are not handed out
+			bucket_width = horizon.count() / (buckets - 2);
+			if (bucket_width < 1)
+				bucket_width = 1;
+			for (auto& e : bucket_epochs)
+				e.store(no_epoch, std::memory_order_relaxed);
+		}
+		revocation_list(const revocation_list&) = delete;
+		revocation_list& operator=(const revocation_list&) = delete;
+
+#if JWT_HAS_STRING_VIEW
 		/**
-		 * Check if expires is present ("exp")
-		 * \return true if present, false otherwise
+		 * Revoke a token id
+		 * \param id Value of the jti claim
+		 * \param expires Time after which the id can be forgotten, usually the exp of the token
+		 * \param now Current time
+		 * \throws std::length_error The list is full
+		 * \throws std::out_of_range expires lies beyond the horizon, see covers()
 		 */
-		bool has_expires_at() const noexcept { return has_payload_claim("exp"); }
+		void revoke(std::string_view id, date expires, date now) { add(id.data(), id.size(), expires, now, false); }
 		/**
-		 * Check if not before is present ("nbf")
-		 * \return true if present, false otherwise
+		 * Record the use of a token id
+		 * \param id Value of the jti claim
+		 * \param expires Time after which the id can be forgotten, usually the exp of the token
+		 * \param now Current time
+		 * \return Whether the id was new, false if it was used or revoked before
+		 * \throws std::length_error The list is full
+		 * \throws std::out_of_range expires lies beyond the horizon, see covers()
 		 */
-		bool has_not_before() const noexcept { return has_payload_claim("nbf"); }
+		bool use(std::string_view id, date expires, date now) { return add(id.data(), id.size(), expires, now, true); }
 		/**
-		 * Check if issued at is present ("iat")
-		 * \return true if present, false otherwise
+		 * Check whether a token id was revoked or used and has not expired
+		 * \param id Value of the jti claim
+		 * \param now Current time
 		 */
-		bool has_issued_at() const noexcept { return has_payload_claim("iat"); }
+		bool contains(std::string_view id, date now) const { return find(id.data(), id.size(), now); }
+#else
 		/**
-		 * Check if token id is present ("jti")
-		 * \return true if present, false otherwise
+		 * Revoke a token id
+		 * \param id Value of the jti claim
+		 * \param expires Time after which the id can be forgotten, usually the exp of the token
+		 * \param now Current time
+		 * \throws std::length_error The list is full
+		 * \throws std::out_of_range expires lies beyond the horizon, see covers()
 		 */
-		bool has_id() const noexcept { return has_payload_claim("jti"); }
+		void revoke(const std::string& id, date expires, date now) { add(id.data(), id.size(), expires, now, false); }
 		/**
-		 * Get issuer claim
-		 * \return issuer as string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * Record the use of a token id
+		 * \param id Value of the jti claim
+		 * \param expires Time after which the id can be forgotten, usually the exp of the token
+		 * \param now Current time
+		 * \return Whether the id was new, false if it was used or revoked before
+		 * \throws std::length_error The list is full
+		 * \throws std::out_of_range expires lies beyond the horizon, see covers()
 		 */
-		const std::string& get_issuer() const { return get_payload_claim("iss").as_string(); }
+		bool use(const std::string& id, date expires, date now) { return add(id.data(), id.size(), expires, now, true); }
 		/**
-		 * Get subject claim
-		 * \return subject as string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * Check whether a token id was revoked or used and has not expired
+		 * \param id Value of the jti claim
+		 * \param now Current time
 		 */
-		const std::string& get_subject() const { return get_payload_claim("sub").as_string(); }
+		bool contains(const std::string& id, date now) const { return find(id.data(), id.size(), now); }
+#endif
+
 		/**
-		 * Get audience claim
-		 * \return audience as a set of strings
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a set (Should not happen in a valid token)
+		 * Revoke the ids of a denylist snapshot, for example one fetched from a shared store.
+		 * Ids already in the list are kept, so tokens can be verified while a snapshot is loaded.
+		 * \param first Iterator to the first entry, entries hold the id as first and its expiry as second
+		 * \param last Iterator past the last entry
+		 * \param now Current time
+		 * \throws std::length_error The list is full, the entries before are revoked
+		 * \throws std::out_of_range An entry expires beyond the horizon, the entries before are revoked
 		 */
-		std::set<std::string> get_audience() const { 
-			auto aud = get_payload_claim("aud");
-			if(aud.get_type() == jwt::claim::type::string) return { aud.as_string()};
-			else return aud.as_set();
+		template<typename Iterator>
+		void load(Iterator first, Iterator last, date now) {
+			for (; first != last; ++first)
+				revoke(first->first, first->second, now);
 		}
+
 		/**
-		 * Get expires claim
-		 * \return expires as a date in utc
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a date (Should not happen in a valid token)
+		 * Check whether an id expiring at a time can be added now. That is always the case up to horizon()
+		 * from now, and up to a bucket later depending on where now falls in its bucket.
+		 * \param expires Time after which the id can be forgotten
+		 * \param now Current time
 		 */
-		const date get_expires_at() const { return get_payload_claim("exp").as_date(); }
+		bool covers(date expires, date now) const {
+			return epoch_of(expires) <= epoch_of(now) + int64_t(buckets) - 2;
+		}
+
+		/// Forget all ids
+		void clear() {
+			std::unique_lock<std::mutex> locks[stripes];
+			for (size_t i = 0; i < stripes; i++)
+				locks[i] = std::unique_lock<std::mutex>(stripe_mutexes[i]);
+			std::lock_guard<std::mutex> lock(bucket_mutex);
+			for (size_t i = 0; i <= table_mask; i++)
+				table[i].store(0, std::memory_order_relaxed);
+			for (size_t i = 0; i <= filter_mask; i++)
+				filter[i].store(0, std::memory_order_relaxed);
+			for (auto& e : bucket_epochs)
+				e.store(no_epoch, std::memory_order_release);
+		}
+
 		/**
-		 * Get not valid before claim
-		 * \return nbf date in utc
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a date (Should not happen in a valid token)
+		 * Number of ids that have not expired
+		 * \param now Current time
 		 */
-		const date get_not_before() const { return get_payload_claim("nbf").as_date(); }
+		size_t size(date now) const {
+			const int64_t current = epoch_of(now);
+			size_t res = 0;
+			for (size_t i = 0; i <= table_mask; i++) {
+				const uint64_t v = table[i].load(std::memory_order_relaxed);
+				if (v != 0 && live(v, current))
+					res++;
+			}
+			return res;
+		}
+
+		/// Capacity passed to the constructor
+		size_t capacity() const { return max_entries; }
+		/// Longest time an id is kept, rounded down to whole buckets
+		std::chrono::seconds horizon() const { return std::chrono::seconds(bucket_width * (buckets - 2)); }
+	private:
+		static constexpr size_t buckets = 64;
+		static constexpr size_t stripes = 16;
+		/// Low bits of a table entry hold the epoch of its bucket, the others the fingerprint
+		static constexpr uint64_t epoch_mask = (uint64_t(1) << 24) - 1;
+		static constexpr int64_t no_epoch = std::numeric_limits<int64_t>::min();
+
+		static uint64_t mix(uint64_t x) {
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdULL;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+		static uint64_t fingerprint(const char* id, size_t size) {
+			uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+			for (; size >= 8; id += 8, size -= 8) {
+				uint64_t w;
+				memcpy(&w, id, 8);
+				h = mix(h ^ w);
+			}
+			uint64_t w = 0;
+			memcpy(&w, id, size);
+			h = mix(h ^ w);
+			// Zero marks free table entries
+			return (h & ~epoch_mask) != 0 ? h : h | (epoch_mask + 1);
+		}
+
+		/// Number of the bucket a time falls into
+		int64_t epoch_of(date t) const {
+			const int64_t s = std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+			return s >= 0 ? s / bucket_width : -((bucket_width - 1 - s) / bucket_width);
+		}
+		/// Whether the bucket of a table entry is one of the epochs current - 1 to current + buckets - 2
+		static bool live(uint64_t entry, int64_t current) {
+			return ((entry - uint64_t(current - 1)) & epoch_mask) < buckets;
+		}
+		/// Bucket slices of the filter that may hold an id
+		uint64_t filter_slices(uint64_t h) const {
+			const uint64_t g = mix(h ^ 0x6a09e667f3bcc908ULL);
+			return filter[g & filter_mask].load(std::memory_order_acquire) & filter[(g >> 32) & filter_mask].load(std::memory_order_acquire);
+		}
+
+		bool find(const char* id, size_t size, date now) const {
+			const uint64_t h = fingerprint(id, size);
+			if (filter_slices(h) == 0)
+				return false;
+			const int64_t current = epoch_of(now);
+			for (size_t i = (h >> 24) & table_mask, n = 0; n <= table_mask; i = (i + 1) & table_mask, n++) {
+				const uint64_t v = table[i].load(std::memory_order_acquire);
+				if (v == 0)
+					return false;
+				if (((v ^ h) & ~epoch_mask) == 0 && live(v, current))
+					return true;
+			}
+			return false;
+		}
+
 		/**
-		 * Get issued at claim
-		 * \return issued at as date in utc
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a date (Should not happen in a valid token)
+		 * Make the filter slice of a bucket belong to an epoch, clearing what the earlier epoch of the bucket left
+		 * \return false if a later epoch has the bucket already, which means the epoch is over
 		 */
-		const date get_issued_at() const { return get_payload_claim("iat").as_date(); }
+		bool open_bucket(int64_t epoch) {
+			auto& owner = bucket_epochs[uint64_t(epoch) % buckets];
+			if (owner.load(std::memory_order_acquire) == epoch)
+				return true;
+			std::lock_guard<std::mutex> lock(bucket_mutex);
+			const int64_t previous = owner.load(std::memory_order_relaxed);
+			if (previous == epoch)
+				return true;
+			if (previous > epoch)
+				return false;
+			// The slice of a bucket that was never used is clear already
+			if (previous != no_epoch) {
+				const uint64_t keep = ~(uint64_t(1) << (uint64_t(epoch) % buckets));
+				for (size_t i = 0; i <= filter_mask; i++)
+					filter[i].fetch_and(keep, std::memory_order_relaxed);
+			}
+			owner.store(epoch, std::memory_order_release);
+			return true;
+		}
+
+		/// Store an id unless it is there already, once makes that a failure
+		bool add(const char* id, size_t size, date expires, date now, bool once) {
+			if (expires <= now)
+				return true;
+			if (!covers(expires, now))
+				throw std::out_of_range("token id expires beyond the horizon of the revocation list");
+			const int64_t current = epoch_of(now);
+			const int64_t epoch = epoch_of(expires);
+			const uint64_t h = fingerprint(id, size);
+			std::lock_guard<std::mutex> lock(stripe_mutexes[h % stripes]);
+			if (!open_bucket(epoch))
+				return true;
+			const uint64_t entry = (h & ~epoch_mask) | (uint64_t(epoch) & epoch_mask);
+			// The filter is set first, so lookups never skip an id that is in the table
+			const uint64_t slice = uint64_t(1) << (uint64_t(epoch) % buckets);
+			const uint64_t g = mix(h ^ 0x6a09e667f3bcc908ULL);
+			filter[g & filter_mask].fetch_or(slice, std::memory_order_release);
+			filter[(g >> 32) & filter_mask].fetch_or(slice, std::memory_order_release);
+			for (;;) {
+				// Entries of other stripes can take a free entry meanwhile, the probe starts over then
+				size_t free = table_mask + 1;
+				uint64_t free_value = 0;
+				bool retry = false;
+				for (size_t i = (h >> 24) & table_mask, n = 0; n <= table_mask; i = (i + 1) & table_mask, n++) {
+					uint64_t v = table[i].load(std::memory_order_acquire);
+					if (v == 0) {
+						if (free > table_mask)
+							free = i;
+						break;
+					}
+					if (!live(v, current)) {
+						if (free > table_mask) {
+							free = i;
+							free_value = v;
+						}
+						continue;
+					}
+					if (((v ^ h) & ~epoch_mask) != 0)
+						continue;
+					if (once)
+						return false;
+					// Keep the later expiry, ids of this stripe are only changed with its lock held
+					if (((v - uint64_t(current - 1)) & epoch_mask) < uint64_t(epoch - (current - 1)))
+						retry = !table[i].compare_exchange_strong(v, entry, std::memory_order_release);
+					if (!retry)
+						return true;
+					break;
+				}
+				if (retry)
+					continue;
+				if (free > table_mask)
+					throw std::length_error("revocation list full");
+				if (table[free].compare_exchange_strong(free_value, entry, std::memory_order_release))
+					return true;
+			}
+		}
+
+		size_t max_entries;
+		int64_t bucket_width;
+		size_t table_mask;
+		std::unique_ptr<std::atomic<uint64_t>[]> table;
+		size_t filter_mask;
+		/// Bit b of a filter word belongs to the bucket of the epochs that are b modulo buckets
+		std::unique_ptr<std::atomic<uint64_t>[]> filter;
+		/// Epoch each bucket currently holds
+		std::atomic<int64_t> bucket_epochs[buckets];
+		/// Serializes moving buckets to another epoch
+		std::mutex bucket_mutex;
+		/// Serialize adding ids, picked by fingerprint
+		std::mutex stripe_mutexes[stripes];
+	};
+
+	/**
+	 * Immutable set of verification keys indexed by key id (the kid header).
+	 */
+	class key_set {
+	public:
 		/**
-		 * Get id claim
-		 * \return id as string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * A single verification key
 		 */
-		const std::string& get_id() const { return get_payload_claim("jti").as_string(); }
+		struct key {
+			/// Algorithm the key is used with
+			std::string alg;
+			/// SHA-256 digest of the key material, identifies the key independent of its id
+			std::array<unsigned char, 32> fingerprint;
+			/// Signature check of the algorithm, sets failure::invalid_signature instead of throwing
+			std::function<void(const std::string&, const std::string&, std::error_code&)> check;
+			/// Copy of the algorithm if it is an HMAC, lets batches check these signatures together
+			std::shared_ptr<const algorithm::hmacsha> mac;
+			/// Start and finish a signature check of data passed in pieces, see algorithm::digest_stream
+			std::function<algorithm::digest_stream()> start;
+			std::function<void(algorithm::digest_stream&, const std::string&, std::error_code&)> check_stream;
+
+			/**
+			 * Check a signature
+			 * \throws signature_verification_exception If the signature does not match
+			 */
+			void verify(const std::string& data, const std::string& signature) const {
+				std::error_code ec;
+				check(data, signature, ec);
+				if (ec)
+					throw signature_verification_exception();
+			}
+			/// Check a signature, setting ec to failure::invalid_signature if it does not match
+			void verify(const std::string& data, const std::string& signature, std::error_code& ec) const {
+				check(data, signature, ec);
+			}
+		};
+
 		/**
-		 * Check if a payload claim is present
-		 * \return true if claim was present, false otherwise
+		 * Add a key
+		 * \param kid Key id
+		 * \param alg Algorithm to use, alg.name() must match the alg header of tokens signed with it
+		 * \param material Key material or any other string that changes whenever the key changes
+		 * \return *this to allow chaining
 		 */
-		bool has_payload_claim(const std::string& name) const noexcept { return payload_claims.count(name) != 0; }
+		template<typename Algorithm>
+		key_set& add(const std::string& kid, Algorithm alg, const std::string& material) {
+			std::shared_ptr<key> k = std::make_shared<key>();
+			k->alg = alg.name();
+			k->fingerprint = fingerprint_of(k->alg, material);
+			k->check = [alg](const std::string& data, const std::string& signature, std::error_code& ec) {
+				details::signature_checker<const Algorithm>::verify(alg, data, signature, ec);
+			};
+			if (const algorithm::hmacsha* mac = details::hmac_of(alg))
+				k->mac = std::make_shared<const algorithm::hmacsha>(*mac);
+			k->start = [alg]() {
+				return details::stream_checker<const Algorithm>::start(alg);
+			};
+			k->check_stream = [alg](algorithm::digest_stream& data, const std::string& signature, std::error_code& ec) {
+				details::stream_checker<const Algorithm>::verify(alg, data, signature, ec);
+			};
+			keys[kid] = std::move(k);
+			return *this;
+		}
+
 		/**
-		 * Get payload claim
-		 * \return Requested claim
-		 * \throws std::runtime_error If claim was not present
+		 * Find a key by id
+		 * \return The key or nullptr if there is none with this id
 		 */
-		const claim& get_payload_claim(const std::string& name) const {
-			if (!has_payload_claim(name))
-				throw std::runtime_error("claim not found");
-			return payload_claims.at(name);
+		const key* find(const std::string& kid) const {
+			auto it = keys.find(kid);
+			return it == keys.end() ? nullptr : it->second.get();
 		}
+
+		/// Number of keys
+		size_t size() const { return keys.size(); }
+
 		/**
-		 * Get all payload claims
-		 * \return map of claims
+		 * Parse a JWK Set (RFC 7517) with RSA, EC, OKP (Ed25519) and oct keys.
+		 * Keys without kid, keys not meant for signatures and unsupported key types are skipped.
+		 * RSA keys without alg are used as RS256, EC and OKP keys get their algorithm from the curve.
+		 * \param jwks JWK Set document
+		 * \param previous Keys to reuse if their id and material did not change
+		 * \throws std::runtime_error The document is invalid
+		 * \throws rsa_exception, ecdsa_exception, eddsa_exception A key is invalid
 		 */
-		std::unordered_map<std::string, claim> get_payload_claims() const { return payload_claims; }
+		static key_set parse_jwks(const std::string& jwks, const key_set* previous = nullptr) {
+			picojson::value val;
+			auto err = picojson::parse(val, jwks);
+			if (!err.empty())
+				throw std::runtime_error(err);
+			if (!val.is<picojson::object>() || !val.get("keys").is<picojson::array>())
+				throw std::runtime_error("invalid jwks: missing keys array");
+
+			key_set res;
+			for (auto& jwk : val.get("keys").get<picojson::array>()) {
+				if (!jwk.is<picojson::object>())
+					throw std::runtime_error("invalid jwks: key is not an object");
+				auto& obj = jwk.get<picojson::object>();
+				auto kid = member(obj, "kid");
+				auto kty = member(obj, "kty");
+				auto use = member(obj, "use");
+				auto alg = member(obj, "alg");
+				if (kid.empty() || (!use.empty() && use != "sig"))
+					continue;
+
+				std::string material;
+				if (kty == "RSA") {
+					if (alg.empty())
+						alg = "RS256";
+					material = kty + "." + member(obj, "n") + "." + member(obj, "e");
+				}
+				else if (kty == "EC") {
+					auto crv = member(obj, "crv");
+					auto curve_alg = crv == "P-256" ? "ES256" : crv == "P-384" ? "ES384" : crv == "P-521" ? "ES512" : "";
+					if (alg.empty())
+						alg = curve_alg;
+					if (alg != curve_alg)
+						continue;
+					material = kty + "." + crv + "." + member(obj, "x") + "." + member(obj, "y");
+				}
+				else if (kty == "OKP") {
+					if (member(obj, "crv") != "Ed25519" || (!alg.empty() && alg != "EdDSA"))
+						continue;
+					alg = "EdDSA";
+					material = kty + ".Ed25519." + member(obj, "x");
+				}
+				else if (kty == "oct")
+					material = kty + "." + member(obj, "k");
+				else
+					continue;
+
+				if (previous) {
+					auto it = previous->keys.find(kid);
+					if (it != previous->keys.end() && it->second->alg == alg && it->second->fingerprint == fingerprint_of(alg, material)) {
+						res.keys[kid] = it->second;
+						continue;
+					}
+				}
+
+				if (kty == "RSA") {
+					auto der = rsa_public_key_der(decode_member(obj, "n"), decode_member(obj, "e"));
+					if (alg == "RS256") res.add(kid, algorithm::rs256(der), material);
+					else if (alg == "RS384") res.add(kid, algorithm::rs384(der), material);
+					else if (alg == "RS512") res.add(kid, algorithm::rs512(der), material);
+					else if (alg == "PS256") res.add(kid, algorithm::ps256(der), material);
+					else if (alg == "PS384") res.add(kid, algorithm::ps384(der), material);
+					else if (alg == "PS512") res.add(kid, algorithm::ps512(der), material);
+				}
+				else if (kty == "EC") {
+					mbedtls_ecp_keypair kp;
+					mbedtls_ecp_keypair_init(&kp);
+					const mbedtls_ecp_group_id id = alg == "ES256" ? MBEDTLS_ECP_DP_SECP256R1 : alg == "ES384" ? MBEDTLS_ECP_DP_SECP384R1 : MBEDTLS_ECP_DP_SECP521R1;
+					auto x = decode_member(obj, "x");
+					auto y = decode_member(obj, "y");
+					int rc = mbedtls_ecp_group_load(&kp.grp, id);
+					if (rc == 0 && (x.size() != (kp.grp.pbits + 7) / 8 || y.size() != x.size()))
+						rc = -1;
+					if (rc == 0)
+						rc = mbedtls_mpi_read_binary(&kp.Q.X, (const unsigned char*)x.data(), x.size());
+					if (rc == 0)
+						rc = mbedtls_mpi_read_binary(&kp.Q.Y, (const unsigned char*)y.data(), y.size());
+					if (rc == 0)
+						rc = mbedtls_mpi_lset(&kp.Q.Z, 1);
+					if (rc == 0)
+						rc = mbedtls_ecp_check_pubkey(&kp.grp, &kp.Q);
+					if (rc != 0) {
+						mbedtls_ecp_keypair_free(&kp);
+						throw ecdsa_exception("failed to load key " + kid + ": invalid public key");
+					}
+					try {
+						if (alg == "ES256") res.add(kid, algorithm::es256(&kp), material);
+						else if (alg == "ES384") res.add(kid, algorithm::es384(&kp), material);
+						else res.add(kid, algorithm::es512(&kp), material);
+					}
+					catch (...) {
+						mbedtls_ecp_keypair_free(&kp);
+						throw;
+					}
+					mbedtls_ecp_keypair_free(&kp);
+				}
+				else if (kty == "OKP") {
+					auto x = decode_member(obj, "x");
+					if (x.size() != 32)
+						throw eddsa_exception("failed to load key " + kid + ": invalid public key");
+					res.add(kid, algorithm::ed25519(x), material);
+				}
+				else {
+					if (alg == "HS256") res.add(kid, algorithm::hs256(decode_member(obj, "k")), material);
+					else if (alg == "HS384") res.add(kid, algorithm::hs384(decode_member(obj, "k")), material);
+					else if (alg == "HS512") res.add(kid, algorithm::hs512(decode_member(obj, "k")), material);
+				}
+			}
+			return res;
+		}
+	private:
+		std::unordered_map<std::string, std::shared_ptr<const key>> keys;
+
+		static std::array<unsigned char, 32> fingerprint_of(const std::string& alg, const std::string& material) {
+			std::string data = alg + "." + material;
+			std::array<unsigned char, 32> res;
+			if (mbedtls_sha256_ret((const unsigned char*)data.data(), data.size(), res.data(), 0) != 0)
+				throw std::runtime_error("failed to hash key");
+			mbedtls_platform_zeroize(&data[0], data.size());
+			return res;
+		}
+
+		static std::string member(const picojson::object& obj, const std::string& name) {
+			auto it = obj.find(name);
+			if (it == obj.end() || !it->second.is<std::string>())
+				return "";
+			return it->second.get<std::string>();
+		}
+
+		static std::string decode_member(const picojson::object& obj, const std::string& name) {
+			return base::decode<alphabet::base64url_unpadded>(member(obj, name));
+		}
+
+		/// DER encoded SubjectPublicKeyInfo of an RSA public key
+		static std::string rsa_public_key_der(const std::string& n, const std::string& e) {
+			mbedtls_pk_context pk;
+			mbedtls_pk_init(&pk);
+			int rc = mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA));
+			if (rc == 0)
+				rc = mbedtls_rsa_import_raw(mbedtls_pk_rsa(pk), (const unsigned char*)n.data(), n.size(), nullptr, 0, nullptr, 0, nullptr, 0, (const unsigned char*)e.data(), e.size());
+			if (rc == 0)
+				rc = mbedtls_rsa_complete(mbedtls_pk_rsa(pk));
+			std::vector<unsigned char> buf(n.size() + e.size() + 64);
+			if (rc == 0)
+				rc = mbedtls_pk_write_pubkey_der(&pk, buf.data(), buf.size());
+			mbedtls_pk_free(&pk);
+			if (rc <= 0)
+				throw rsa_exception("failed to load public key: invalid modulus or exponent");
+			// mbedtls writes DER at the end of the buffer
+			return std::string((const char*)buf.data() + buf.size() - rc, rc);
+		}
 	};
 
 	/**
-	 * Base class that represents a token header.
-	 * Contains Convenience accessors for common claims.
+	 * Holder of the current key_set, replaced in read-copy-update style.
+	 * Readers get a snapshot that stays valid while they use it. They take no lock and never wait for a
+	 * writer, a writer waits for the readers that may still be copying the snapshot it replaced.
 	 */
-	class header {
-	protected:
-		std::unordered_map<std::string, claim> header_claims;
+	class key_store {
+		/// Heap allocated so readers can copy it while another one is being published
+		std::atomic<const std::shared_ptr<const key_set>*> current;
+		/// Readers copying a snapshot, by the parity of the epoch they started in
+		mutable std::atomic<size_t> readers[2];
+		mutable std::atomic<size_t> epoch;
+		/// Serializes writers
+		std::mutex update_mutex;
+
+		/// Publish keys and free the holder they replace once no reader can be copying it anymore
+		void publish(std::shared_ptr<const key_set> keys) {
+			const std::shared_ptr<const key_set>* previous = current.exchange(new std::shared_ptr<const key_set>(std::move(keys)));
+			// A reader that registers after its slot was seen empty finds the new holder.
+			// Flipping the epoch before each wait keeps new readers off the slot being drained.
+			for (int i = 0; i < 2; i++) {
+				const size_t drained = epoch.fetch_add(1) & 1;
+				while (readers[drained].load() != 0)
+					std::this_thread::yield();
+			}
+			delete previous;
+		}
 	public:
+		key_store()
+			: key_store(key_set())
+		{}
+		explicit key_store(key_set keys)
+			: current(new std::shared_ptr<const key_set>(std::make_shared<const key_set>(std::move(keys)))),
+			epoch(0)
+		{
+			readers[0].store(0);
+			readers[1].store(0);
+		}
+		~key_store() {
+			delete current.load();
+		}
+		key_store(const key_store&) = delete;
+		key_store& operator=(const key_store&) = delete;
+
 		/**
-		 * Check if algortihm is present ("alg")
-		 * \return true if present, false otherwise
+		 * Get the current keys
 		 */
-		bool has_algorithm() const noexcept { return has_header_claim("alg"); }
+		std::shared_ptr<const key_set> snapshot() const {
+			std::atomic<size_t>& slot = readers[epoch.load() & 1];
+			slot.fetch_add(1);
+			std::shared_ptr<const key_set> res = *current.load();
+			slot.fetch_sub(1, std::memory_order_release);
+			return res;
+		}
+
 		/**
-		 * Check if type is present ("typ")
-		 * \return true if present, false otherwise
+		 * Replace all keys
 		 */
-		bool has_type() const noexcept { return has_header_claim("typ"); }
+		void replace(key_set keys) {
+			std::lock_guard<std::mutex> lock(update_mutex);
+			publish(std::make_shared<const key_set>(std::move(keys)));
+		}
+
 		/**
-		 * Check if content type is present ("cty")
-		 * \return true if present, false otherwise
+		 * Replace all keys with the ones of a JWK Set.
+		 * Keys whose id and material did not change keep their already parsed state.
+		 * \throws std::runtime_error, rsa_exception, ecdsa_exception The document is invalid, the current keys are left alone
 		 */
-		bool has_content_type() const noexcept { return has_header_claim("cty"); }
+		void load_jwks(const std::string& jwks) {
+			std::lock_guard<std::mutex> lock(update_mutex);
+			// Only writers replace the holder, and they hold the lock
+			const key_set* previous = current.load()->get();
+			publish(std::make_shared<const key_set>(key_set::parse_jwks(jwks, previous)));
+		}
+	};
+
+
+	/**
+	 * Verifier class used to check if a decoded token contains all claims required by your application and has a valid signature.
+	 *
+	 * Algorithms are stored type erased unless their types are listed in Algorithms. Listed types are kept
+	 * in a tuple and called directly after comparing the parsed alg header, without virtual calls.
+	 */
+	template<typename Clock, typename... Algorithms>
+	class verifier {
+		struct algo_base {
+			virtual ~algo_base() = default;
+			virtual void verify(const std::string& data, const std::string& sig, std::error_code& ec) = 0;
+			virtual const algorithm::hmacsha* hmac() const noexcept = 0;
+			virtual algorithm::digest_stream start() const = 0;
+			virtual void verify(algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) = 0;
+		};
+		template<typename T>
+		struct algo : public algo_base {
+			T alg;
+			explicit algo(T a) : alg(a) {}
+			virtual void verify(const std::string& data, const std::string& sig, std::error_code& ec) override {
+				details::signature_checker<T>::verify(alg, data, sig, ec);
+			}
+			virtual const algorithm::hmacsha* hmac() const noexcept override {
+				return details::hmac_of(alg);
+			}
+			virtual algorithm::digest_stream start() const override {
+				return details::stream_checker<T>::start(alg);
+			}
+			virtual void verify(algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) override {
+				details::stream_checker<T>::verify(alg, data, sig, ec);
+			}
+		};
+
+		/// A required claim compiled into the form checked for every token
+		struct claim_check {
+			enum class kind {
+				string,
+				int64,
+				array,
+				audience,
+				unsupported
+			};
+			kind type;
+			std::string name;
+			claim expected;
+			/// Expected values of array and audience checks, mapped to their position
+			std::unordered_map<std::string, size_t> values;
+		};
+		/// Claim names looked up for every token, created once
+		struct registered_names {
+			const std::string exp{ "exp" };
+			const std::string nbf{ "nbf" };
+			const std::string iat{ "iat" };
+			const std::string jti{ "jti" };
+			static const registered_names& get() {
+				static const registered_names names;
+				return names;
+			}
+		};
+		/// Token id and the time it may be forgotten, read by read_id
+		struct token_id {
+			bool present = false;
+			std::string value;
+			date expires = date::max();
+		};
+		/// Everything the signature check of a token needs, so it can run apart from the token
+		struct signature_job {
+			/// Signed data, the encoded header and payload
+			std::string data;
+			/// Decoded signature, empty if cached
+			std::string signature;
+			std::string algo;
+			algorithm_id id = algorithm_id::unknown;
+			/// Keeps the key alive even if the store is updated meanwhile
+			std::shared_ptr<const key_set> key_snapshot;
+			const key_set::key* key = nullptr;
+			/// Whether the token cache already vouches for the signature
+			bool cached = false;
+			verified_token_cache::key_type cache_key;
+			date time;
+			/// Time the token cache may remember the token until
+			date expires;
+			/// Id of the token if the verifier checks it
+			token_id id_claim;
+		};
+
+		/// Required claims
+		std::unordered_map<std::string, claim> claims;
+		/// Leeway time for exp, nbf and iat
+		size_t default_leeway = 0;
+		/// Checks compiled from claims, excluding exp, nbf and iat
+		std::vector<claim_check> checks;
+		/// Leeways compiled from default_leeway and claims
+		std::chrono::seconds exp_leeway{ 0 };
+		std::chrono::seconds nbf_leeway{ 0 };
+		std::chrono::seconds iat_leeway{ 0 };
+		/// Instance of clock type
+		Clock clock;
+		/// Supported algorithms with a known name
+		std::array<std::shared_ptr<algo_base>, static_cast<size_t>(algorithm_id::unknown)> known_algs;
+		/// Supported algorithms with any other name
+		std::unordered_map<std::string, std::shared_ptr<algo_base>> algs;
+		/// Supported algorithms of the types listed in Algorithms
+		std::tuple<std::shared_ptr<Algorithms>...> listed_algs;
+		/// Tokens with a verified signature, nullptr if caching is disabled
+		std::shared_ptr<verified_token_cache> token_cache;
+		/// Longest time a token stays in token_cache
+		std::chrono::seconds token_cache_max_age{ 0 };
+		/// Keys looked up by the kid header, nullptr if not used
+		std::shared_ptr<const key_store> keys;
+		/// Longest accepted token and header, payload or signature part in base64, 0 for no limit
+		size_t max_token_size = 0;
+		size_t max_segment_size = 0;
+		/// Whether exp, nbf, iat and the required claims are checked before the signature
+		bool early_rejection = false;
+		/// Checks of the jti claim, nullptr or empty if not used
+		std::shared_ptr<const revocation_list> revoked_ids;
+		std::function<bool(const std::string&, date)> revocation_check;
+		std::shared_ptr<revocation_list> used_ids;
+	public:
 		/**
-		 * Check if key id is present ("kid")
-		 * \return true if present, false otherwise
+		 * Constructor for building a new verifier instance
+		 * \param c Clock instance
 		 */
-		bool has_key_id() const noexcept { return has_header_claim("kid"); }
+		explicit verifier(Clock c) : clock(c) {}
+
 		/**
-		 * Get algorithm claim
-		 * \return algorithm as string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * Set default leeway to use.
+		 * \param leeway Default leeway to use if not specified otherwise
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_algorithm() const { return get_header_claim("alg").as_string(); }
+		verifier& leeway(size_t leeway) { default_leeway = leeway; compile(); return *this; }
 		/**
-		 * Get type claim
-		 * \return type as a string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * Set leeway for expires at.
+		 * If not specified the default leeway will be used.
+		 * \param leeway Set leeway to use for expires at.
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_type() const { return get_header_claim("typ").as_string(); }
+		verifier& expires_at_leeway(size_t leeway) { return with_claim("exp", claim(std::chrono::system_clock::from_time_t(leeway))); }
 		/**
-		 * Get content type claim
-		 * \return content type as string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * Set leeway for not before.
+		 * If not specified the default leeway will be used.
+		 * \param leeway Set leeway to use for not before.
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_content_type() const { return get_header_claim("cty").as_string(); }
+		verifier& not_before_leeway(size_t leeway) { return with_claim("nbf", claim(std::chrono::system_clock::from_time_t(leeway))); }
 		/**
-		 * Get key id claim
-		 * \return key id as string
-		 * \throws std::runtime_error If claim was not present
-		 * \throws std::bad_cast Claim was present but not a string (Should not happen in a valid token)
+		 * Set leeway for issued at.
+		 * If not specified the default leeway will be used.
+		 * \param leeway Set leeway to use for issued at.
+		 * \return *this to allow chaining
+		 */
+		verifier& issued_at_leeway(size_t leeway) { return with_claim("iat", claim(std::chrono::system_clock::from_time_t(leeway))); }
+		/**
+		 * Set an issuer to check for.
+		 * Check is casesensitive.
+		 * \param iss Issuer to check for.
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_key_id() const { return get_header_claim("kid").as_string(); }
+		verifier& with_issuer(const std::string& iss) { return with_claim("iss", claim(iss)); }
 		/**
-		 * Check if a header claim is present
-		 * \return true if claim was present, false otherwise
+		 * Set a subject to check for.
+		 * Check is casesensitive.
+		 * \param sub Subject to check for.
+		 * \return *this to allow chaining
 		 */
-		bool has_header_claim(const std::string& name) const noexcept { return header_claims.count(name) != 0; }
+		verifier& with_subject(const std::string& sub) { return with_claim("sub", claim(sub)); }
 		/**
-		 * Get header claim
-		 * \return Requested claim
-		 * \throws std::runtime_error If claim was not present
+		 * Set an audience to check for.
+		 * If any of the specified audiences is not present in the token the check fails.
+		 * \param aud Audience to check for.
+		 * \return *this to allow chaining
 		 */
-		const claim& get_header_claim(const std::string& name) const {
-			if (!has_header_claim(name))
-				throw std::runtime_error("claim not found");
-			return header_claims.at(name);
-		}
+		verifier& with_audience(const std::set<std::string>& aud) { return with_claim("aud", claim(aud)); }
 		/**
-		 * Get all header claims
-		 * \return map of claims
+		 * Set an id to check for.
+		 * Check is casesensitive.
+		 * \param id ID to check for.
+		 * \return *this to allow chaining
 		 */
-		std::unordered_map<std::string, claim> get_header_claims() const { return header_claims; }
-	};
-
-	/**
-	 * Class containing all information about a decoded token
-	 */
-	class decoded_jwt : public header, public payload {
-	protected:
-		/// Unmodifed token, as passed to constructor
-		const std::string token;
-		/// Header part decoded from base64
-		std::string header;
-		/// Unmodified header part in base64
-		std::string header_base64;
-		/// Payload part decoded from base64
-		std::string payload;
-		/// Unmodified payload part in base64
-		std::string payload_base64;
-		/// Signature part decoded from base64
-		std::string signature;
-		/// Unmodified signature part in base64
-		std::string signature_base64;
-	public:
+		verifier& with_id(const std::string& id) { return with_claim("jti", claim(id)); }
 		/**
-		 * Constructor 
-		 * Parses a given token
-		 * \param token The token to parse
-		 * \throws std::invalid_argument Token is not in correct format
-		 * \throws std::runtime_error Base64 decoding failed or invalid json
+		 * Specify a claim to check for.
+		 * \param name Name of the claim to check for
+		 * \param c Claim to check for
+		 * \return *this to allow chaining
 		 */
-		explicit decoded_jwt(const std::string& token)
-			: token(token)
-		{
-			auto hdr_end = token.find('.');
-			if (hdr_end == std::string::npos)
-				throw std::invalid_argument("invalid token supplied");
-			auto payload_end = token.find('.', hdr_end + 1);
-			if (payload_end == std::string::npos)
-				throw std::invalid_argument("invalid token supplied");
-			header = header_base64 = token.substr(0, hdr_end);
-			payload = payload_base64 = token.substr(hdr_end + 1, payload_end - hdr_end - 1);
-			signature = signature_base64 = token.substr(payload_end + 1);
-
-			// Fix padding: JWT requires padding to get removed
-			auto fix_padding = [](std::string& str) {
-				switch (str.size() % 4) {
-				case 1:
-					str += alphabet::base64url::fill();
-#if defined(__cpp_attributes) && defined(__has_cpp_attribute)
-#if __has_cpp_attribute(fallthrough)
-					[[fallthrough]];
-#endif
-#endif
-				case 2:
-					str += alphabet::base64url::fill();
-#if defined(__cpp_attributes) && defined(__has_cpp_attribute)
-#if __has_cpp_attribute(fallthrough)
-					[[fallthrough]];
-#endif
-#endif
-				case 3:
-					str += alphabet::base64url::fill();
-#if defined(__cpp_attributes) && defined(__has_cpp_attribute)
-#if __has_cpp_attribute(fallthrough)
-					[[fallthrough]];
-#endif
-#endif
-				default:
-					break;
-				}
-			};
-			fix_padding(header);
-			fix_padding(payload);
-			fix_padding(signature);
-
-			header = base::decode<alphabet::base64url>(header);
-			payload = base::decode<alphabet::base64url>(payload);
-			signature = base::decode<alphabet::base64url>(signature);
-
-			auto parse_claims = [](const std::string& str) {
-				std::unordered_map<std::string, claim> res;
-				picojson::value val;
-				if (!picojson::parse(val, str).empty())
-					throw std::runtime_error("Invalid json");
-
-				for (auto& e : val.get<picojson::object>()) { res.insert({ e.first, claim(e.second) }); }
-
-				return res;
-			};
-
-			header_claims = parse_claims(header);
-			payload_claims = parse_claims(payload);
+		verifier& with_claim(const std::string& name, claim c) {
+			// Throws before anything changes if the claim cannot be checked
+			if (name == "exp" || name == "nbf" || name == "iat")
+				c.as_date();
+			else
+				compile_check(name, c);
+			claims[name] = std::move(c);
+			compile();
+			return *this;
 		}
 
 		/**
-		 * Get token string, as passed to constructor
-		 * \return token as passed to constructor
-		 */
-		const std::string& get_token() const { return token; }
-		/**
-		 * Get header part as json string
-		 * \return header part after base64 decoding
+		 * Add an algorithm available for checking.
+		 * \param alg Algorithm to allow
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_header() const { return header; }
+		template<typename Algorithm>
+		verifier& allow_algorithm(Algorithm alg) {
+			store_algorithm(std::move(alg), std::integral_constant<bool, (details::type_index<Algorithm, Algorithms...>::value < sizeof...(Algorithms))>());
+			// Entries were verified with the previous set of keys, which copies of this verifier may still share
+			if (token_cache)
+				token_cache = std::make_shared<verified_token_cache>(token_cache->capacity(), token_cache->shard_count());
+			return *this;
+		}
+
 		/**
-		 * Get payload part as json string
-		 * \return payload part after base64 decoding
+		 * Verify tokens with a kid header using the matching key of a key store.
+		 * Tokens without kid are still checked with the algorithms added by allow_algorithm.
+		 * \param store Keys to use, they can be replaced while the verifier is in use
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_payload() const { return payload; }
+		verifier& with_key_store(std::shared_ptr<const key_store> store) {
+			keys = std::move(store);
+			return *this;
+		}
+
 		/**
-		 * Get signature part as json string
-		 * \return signature part after base64 decoding
+		 * Remember tokens with a verified signature and skip the signature check when they are seen again.
+		 * Claims, including exp, nbf and iat, are still checked every time.
+		 * \param capacity Maximum number of tokens to remember
+		 * \param max_age Longest time to remember a token, tokens are never remembered past their exp
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_signature() const { return signature; }
+		verifier& with_token_cache(size_t capacity = 4096, std::chrono::seconds max_age = std::chrono::seconds(300)) {
+			token_cache = std::make_shared<verified_token_cache>(capacity);
+			token_cache_max_age = max_age;
+			return *this;
+		}
+
 		/**
-		 * Get header part as base64 string
-		 * \return header part before base64 decoding
+		 * Reject oversized tokens before any other check.
+		 * verify_batch applies the token limit before decoding.
+		 * \param max_token Longest accepted token, 0 for no limit
+		 * \param max_segment Longest accepted header, payload or signature part in base64, 0 for no limit
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_header_base64() const { return header_base64; }
+		verifier& with_size_limits(size_t max_token, size_t max_segment = 0) {
+			max_token_size = max_token;
+			max_segment_size = max_segment;
+			return *this;
+		}
+
 		/**
-		 * Get payload part as base64 string
-		 * \return payload part before base64 decoding
+		 * Check exp, nbf, iat and the required claims before the signature instead of after it, so
+		 * expired or otherwise unacceptable tokens never cost a public key operation.
+		 * Only the reason reported for such tokens changes, a token passes either way only if all checks pass.
+		 * \param enable Whether to check the claims first
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_payload_base64() const { return payload_base64; }
+		verifier& with_early_rejection(bool enable = true) {
+			early_rejection = enable;
+			return *this;
+		}
+
 		/**
-		 * Get signature part as base64 string
-		 * \return signature part before base64 decoding
+		 * Reject tokens whose id (the jti claim) is in a revocation list.
+		 * Ids are checked once the signature and all other claims passed, tokens without jti are accepted.
+		 * \param list Revoked ids, they can be added while the verifier is in use
+		 * \return *this to allow chaining
 		 */
-		const std::string& get_signature_base64() const { return signature_base64; }
-
-	};
-
-	/**
-	 * Builder class to build and sign a new token
-	 * Use jwt::create() to get an instance of this class.
-	 */
-	class builder {
-		std::unordered_map<std::string, claim> header_claims;
-		std::unordered_map<std::string, claim> payload_claims;
+		verifier& with_revocation_list(std::shared_ptr<const revocation_list> list) {
+			revoked_ids = std::move(list);
+			return *this;
+		}
 
-		builder() {}
-		friend builder create();
-	public:
 		/**
-		 * Set a header claim.
-		 * \param id Name of the claim
-		 * \param c Claim to add
-		 * \return *this to allow for method chaining
+		 * Reject tokens whose id (the jti claim) a function reports as revoked, for example a lookup in a shared store.
+		 * It runs after the revocation list, so ids revoked there never reach it, and tokens without jti are accepted.
+		 * \param is_revoked Called with the jti and exp of the token, date::max() without exp, from all verifying threads at once
+		 * \return *this to allow chaining
 		 */
-		builder& set_header_claim(const std::string& id, claim c) { header_claims[id] = std::move(c); return *this; }
+		verifier& with_revocation_check(std::function<bool(const std::string&, date)> is_revoked) {
+			revocation_check = std::move(is_revoked);
+			return *this;
+		}
+
 		/**
-		 * Set a payload claim.
-		 * \param id Name of the claim
-		 * \param c Claim to add
-		 * \return *this to allow for method chaining
+		 * Accept every token id (the jti claim) only once.
+		 * Ids of valid tokens are added to the list until their exp passes. Tokens without jti or exp are rejected
+		 * with failure::missing_claim, tokens whose exp lies beyond the horizon of the list with
+		 * failure::claim_mismatch, as the list could not remember their id for as long as they are valid.
+		 * The revocation list and check run first, so revoked tokens do not use up their id.
+		 * \param list Ids seen so far, share it between verifiers that accept the same tokens
+		 * \return *this to allow chaining
 		 */
-		builder& set_payload_claim(const std::string& id, claim c) { payload_claims[id] = std::move(c); return *this; }
+		verifier& with_replay_protection(std::shared_ptr<revocation_list> list) {
+			used_ids = std::move(list);
+			return *this;
+		}
+
 		/**
-		 * Set algorithm claim
-		 * You normally don't need to do this, as the algorithm is automatically set if you don't change it.
-		 * \param str Name of algorithm
-		 * \return *this to allow for method chaining
+		 * Verify the given token.
+		 * \param jwt Token to check
+		 * \throws token_verification_exception Verification failed
 		 */
-		builder& set_algorithm(const std::string& str) { return set_header_claim("alg", claim(str)); }
+		template<typename json_traits>
+		void verify(const basic_decoded_jwt<json_traits>& jwt) const {
+			verify_token(jwt, details::no_observer());
+		}
 		/**
-		 * Set type claim
-		 * \param str Type to set
-		 * \return *this to allow for method chaining
+		 * Verify the given token, reporting the algorithm, stage timings and failures to an observer.
+		 * \param jwt Token to check
+		 * \param observer Observer to report to, see null_observer
+		 * \throws token_verification_exception Verification failed
 		 */
-		builder& set_type(const std::string& str) { return set_header_claim("typ", claim(str)); }
+		template<typename json_traits, typename Observer>
+		void verify(const basic_decoded_jwt<json_traits>& jwt, Observer& observer) const {
+			verify_token(jwt, observer);
+		}
 		/**
-		 * Set content type claim
-		 * \param str Type to set
-		 * \return *this to allow for method chaining
+		 * Verify the given token without throwing if it is invalid.
+		 * \param jwt Token to check
+		 * \param ec Receives the reason verification failed, cleared otherwise
+		 * \throws std::bad_alloc
 		 */
-		builder& set_content_type(const std::string& str) { return set_header_claim("cty", claim(str)); }
+		template<typename json_traits>
+		void verify(const basic_decoded_jwt<json_traits>& jwt, std::error_code& ec) const {
+			const std::string* claim_name;
+			ec = check_token(jwt, details::no_observer(), claim_name);
+		}
 		/**
-		 * Set key id claim
-		 * \param str Key id to set
-		 * \return *this to allow for method chaining
+		 * Verify the given token without throwing if it is invalid, reporting to an observer.
+		 * \param jwt Token to check
+		 * \param observer Observer to report to, see null_observer
+		 * \param ec Receives the reason verification failed, cleared otherwise
+		 * \throws std::bad_alloc
 		 */
-		builder& set_key_id(const std::string& str) { return set_header_claim("kid", claim(str)); }
+		template<typename json_traits, typename Observer>
+		void verify(const basic_decoded_jwt<json_traits>& jwt, Observer& observer, std::error_code& ec) const {
+			const std::string* claim_name;
+			ec = check_token(jwt, observer, claim_name);
+		}
+#if JWT_HAS_STRING_VIEW
 		/**
-		 * Set issuer claim
-		 * \param str Issuer to set
-		 * \return *this to allow for method chaining
+		 * Verify the given token.
+		 * \param jwt Token to check
+		 * \throws token_verification_exception Verification failed
 		 */
-		builder& set_issuer(const std::string& str) { return set_payload_claim("iss", claim(str)); }
+		template<typename json_traits>
+		void verify(const basic_decoded_jwt_view<json_traits>& jwt) const {
+			verify_token(jwt, details::no_observer());
+		}
 		/**
-		 * Set subject claim
-		 * \param str Subject to set
-		 * \return *this to allow for method chaining
+		 * Verify the given token, reporting the algorithm, stage timings and failures to an observer.
+		 * \param jwt Token to check
+		 * \param observer Observer to report to, see null_observer
+		 * \throws token_verification_exception Verification failed
 		 */
-		builder& set_subject(const std::string& str) { return set_payload_claim("sub", claim(str)); }
+		template<typename json_traits, typename Observer>
+		void verify(const basic_decoded_jwt_view<json_traits>& jwt, Observer& observer) const {
+			verify_token(jwt, observer);
+		}
 		/**
-		 * Set audience claim
-		 * \param l Audience set
-		 * \return *this to allow for method chaining
+		 * Verify the given token without throwing if it is invalid.
+		 * \param jwt Token to check
+		 * \param ec Receives the reason verification failed, cleared otherwise
+		 * \throws std::bad_alloc
 		 */
-		builder& set_audience(const std::set<std::string>& l) { return set_payload_claim("aud", claim(l)); }
+		template<typename json_traits>
+		void verify(const basic_decoded_jwt_view<json_traits>& jwt, std::error_code& ec) const {
+			const std::string* claim_name;
+			ec = check_token(jwt, details::no_observer(), claim_name);
+		}
 		/**
-		 * Set audience claim
-		 * \param aud Single audience
-		 * \return *this to allow for method chaining
+		 * Verify the given token without throwing if it is invalid, reporting to an observer.
+		 * \param jwt Token to check
+		 * \param observer Observer to report to, see null_observer
+		 * \param ec Receives the reason verification failed, cleared otherwise
+		 * \throws std::bad_alloc
 		 */
-		builder& set_audience(const std::string& aud) { return set_payload_claim("aud", claim(aud)); }
+		template<typename json_traits, typename Observer>
+		void verify(const basic_decoded_jwt_view<json_traits>& jwt, Observer& observer, std::error_code& ec) const {
+			const std::string* claim_name;
+			ec = check_token(jwt, observer, claim_name);
+		}
+#endif
 		/**
-		 * Set expires at claim
-		 * \param d Expires time
-		 * \return *this to allow for method chaining
+		 * Decode and verify a batch of tokens on a thread pool.
+		 * Failures are reported per token instead of being thrown.
+		 * \param tokens Tokens to verify
+		 * \param count Number of tokens
+		 * \param results Receives one result per token
+		 * \param pool Pool to run on, the calling thread takes part as well
 		 */
-		builder& set_expires_at(const date& d) { return set_payload_claim("exp", claim(d)); }
+		void verify_batch(const std::string* tokens, size_t count, verify_result* results, thread_pool& pool) const {
+			run_batch<decoded_jwt>(tokens, count, results, pool, details::no_observer());
+		}
 		/**
-		 * Set not before claim
-		 * \param d First valid time
-		 * \return *this to allow for method chaining
+		 * Decode and verify a batch of tokens on a thread pool, reporting to an observer.
+		 * \param tokens Tokens to verify
+		 * \param count Number of tokens
+		 * \param results Receives one result per token
+		 * \param pool Pool to run on, the calling thread takes part as well
+		 * \param observer Observer to report to, called from all pool threads at once
 		 */
-		builder& set_not_before(const date& d) { return set_payload_claim("nbf", claim(d)); }
+		template<typename Observer>
+		void verify_batch(const std::string* tokens, size_t count, verify_result* results, thread_pool& pool, Observer& observer) const {
+			run_batch<decoded_jwt>(tokens, count, results, pool, observer);
+		}
 		/**
-		 * Set issued at claim
-		 * \param d Issued at time, should be current time
-		 * \return *this to allow for method chaining
+		 * Decode and verify a batch of tokens on a thread pool.
+		 * \param tokens Tokens to verify
+		 * \param pool Pool to run on, the calling thread takes part as well
+		 * \return One result per token
 		 */
-		builder& set_issued_at(const date& d) { return set_payload_claim("iat", claim(d)); }
+		std::vector<verify_result> verify_batch(const std::vector<std::string>& tokens, thread_pool& pool) const {
+			std::vector<verify_result> results(tokens.size());
+			verify_batch(tokens.data(), tokens.size(), results.data(), pool);
+			return results;
+		}
+#if JWT_HAS_STRING_VIEW
 		/**
-		 * Set id claim
-		 * \param str ID to set
-		 * \return *this to allow for method chaining
+		 * Decode and verify a batch of tokens on a thread pool without copying them.
+		 * Failures are reported per token instead of being thrown.
+		 * \param tokens Tokens to verify
+		 * \param count Number of tokens
+		 * \param results Receives one result per token
+		 * \param pool Pool to run on, the calling thread takes part as well
 		 */
-		builder& set_id(const std::string& str) { return set_payload_claim("jti", claim(str)); }
-
+		void verify_batch(const std::string_view* tokens, size_t count, verify_result* results, thread_pool& pool) const {
+			run_batch<decoded_jwt_view>(tokens, count, results, pool, details::no_observer());
+		}
 		/**
-		 * Sign token and return result
-		 * \param algo Instance of an algorithm to sign the token with
-		 * \return Final token as a string
+		 * Decode and verify a batch of tokens on a thread pool without copying them, reporting to an observer.
+		 * \param tokens Tokens to verify
+		 * \param count Number of tokens
+		 * \param results Receives one result per token
+		 * \param pool Pool to run on, the calling thread takes part as well
+		 * \param observer Observer to report to, called from all pool threads at once
 		 */
-		template<typename T>
-		std::string sign(const T& algo) {
-			this->set_algorithm(algo.name());
-
-			picojson::object obj_header;
-			for (auto& e : header_claims) {
-				obj_header.insert({ e.first, e.second.to_json() });
-			}
-			picojson::object obj_payload;
-			for (auto& e : payload_claims) {
-				obj_payload.insert({ e.first, e.second.to_json() });
-			}
-
-			auto encode = [](const std::string& data) {
-				auto base = base::encode<alphabet::base64url>(data);
-				auto pos = base.find(alphabet::base64url::fill());
-				base = base.substr(0, pos);
-				return base;
-			};
-
-			std::string header = encode(picojson::value(obj_header).serialize());
-			std::string payload = encode(picojson::value(obj_payload).serialize());
-
-			std::string token = header + "." + payload;
-
-			return token + "." + encode(algo.sign(token));
+		template<typename Observer>
+		void verify_batch(const std::string_view* tokens, size_t count, verify_result* results, thread_pool& pool, Observer& observer) const {
+			run_batch<decoded_jwt_view>(tokens, count, results, pool, observer);
 		}
-	};
-
-	/**
-	 * Verifier class used to check if a decoded token contains all claims required by your application and has a valid signature.
-	 */
-	template<typename Clock>
-	class verifier {
-		struct algo_base {
-			virtual ~algo_base() = default;
-			virtual void verify(const std::string& data, const std::string& sig) = 0;
-		};
-		template<typename T>
-		struct algo : public algo_base {
-			T alg;
-			explicit algo(T a) : alg(a) {}
-			virtual void verify(const std::string& data, const std::string& sig) override {
-				alg.verify(data, sig);
-			}
-		};
-
-		/// Required claims
-		std::unordered_map<std::string, claim> claims;
-		/// Leeway time for exp, nbf and iat
-		size_t default_leeway = 0;
-		/// Instance of clock type
-		Clock clock;
-		/// Supported algorithms
-		std::unordered_map<std::string, std::shared_ptr<algo_base>> algs;
-	public:
 		/**
-		 * Constructor for building a new verifier instance
-		 * \param c Clock instance
+		 * Decode and verify a batch of tokens on a thread pool without copying them.
+		 * \param tokens Tokens to verify
+		 * \param pool Pool to run on, the calling thread takes part as well
+		 * \return One result per token
 		 */
-		explicit verifier(Clock c) : clock(c) {}
+		std::vector<verify_result> verify_batch(const std::vector<std::string_view>& tokens, thread_pool& pool) const {
+			std::vector<verify_result> results(tokens.size());
+			verify_batch(tokens.data(), tokens.size(), results.data(), pool);
+			return results;
+		}
+#endif
 
 		/**
-		 * Set default leeway to use.
-		 * \param leeway Default leeway to use if not specified otherwise
-		 * \return *this to allow chaining
+		 * Verify a token, running its signature check on an executor.
+		 * Size limits, the algorithm or key id and all claims are checked on the calling thread first, the same way
+		 * with_early_rejection does. Only the public key or mac operation is posted, so the token may be destroyed
+		 * once this returns. The verifier has to stay alive until done was called. Revocation and replay checks of
+		 * the jti claim run after the signature check, so they are done on the executor as well.
+		 * \param jwt Token to check, decoded_jwt or decoded_jwt_view
+		 * \param executor Object with a post(std::function<void()>) member like crypto_executor
+		 * \param done Called with the outcome as jwt::failure, on the calling thread if no signature check was
+		 * needed or it was rejected before, otherwise on the executor
 		 */
-		verifier& leeway(size_t leeway) { default_leeway = leeway; return *this; }
+		template<typename Token, typename Executor, typename Callback>
+		void verify_async(const Token& jwt, Executor& executor, Callback done) const {
+			std::shared_ptr<signature_job> job;
+			const std::error_code ec = start_async(jwt, job);
+			if (!job) {
+				done(ec);
+				return;
+			}
+			executor.post([this, job, done]() mutable {
+				done(finish_async(*job));
+			});
+		}
+#if JWT_HAS_COROUTINE
 		/**
-		 * Set leeway for expires at.
-		 * If not specified the default leeway will be used.
-		 * \param leeway Set leeway to use for expires at.
-		 * \return *this to allow chaining
+		 * Awaitable returned by verify_async, co_await yields the outcome as std::error_code.
+		 * The coroutine is resumed on the executor if a signature check was posted.
 		 */
-		verifier& expires_at_leeway(size_t leeway) { return with_claim("exp", claim(std::chrono::system_clock::from_time_t(leeway))); }
+		template<typename Executor>
+		class async_verification {
+			friend class verifier;
+			const verifier& owner;
+			Executor& executor;
+			std::shared_ptr<signature_job> job;
+			std::error_code result;
+
+			async_verification(const verifier& owner, Executor& executor)
+				: owner(owner), executor(executor)
+			{}
+		public:
+			bool await_ready() const noexcept { return !job; }
+			void await_suspend(std::coroutine_handle<> handle) {
+				executor.post([this, handle]() {
+					result = owner.finish_async(*job);
+					handle.resume();
+				});
+			}
+			std::error_code await_resume() const noexcept { return result; }
+		};
 		/**
-		 * Set leeway for not before.
-		 * If not specified the default leeway will be used.
-		 * \param leeway Set leeway to use for not before.
-		 * \return *this to allow chaining
+		 * Verify a token from a coroutine, running its signature check on an executor.
+		 * Works like the callback version: co_await verifier.verify_async(jwt, executor) yields the outcome.
+		 * \param jwt Token to check, decoded_jwt or decoded_jwt_view
+		 * \param executor Object with a post(std::function<void()>) member like crypto_executor
 		 */
-		verifier& not_before_leeway(size_t leeway) { return with_claim("nbf", claim(std::chrono::system_clock::from_time_t(leeway))); }
+		template<typename Token, typename Executor>
+		async_verification<Executor> verify_async(const Token& jwt, Executor& executor) const {
+			async_verification<Executor> op(*this, executor);
+			op.result = start_async(jwt, op.job);
+			return op;
+		}
+#endif
+
 		/**
-		 * Set leeway for issued at.
-		 * If not specified the default leeway will be used.
-		 * \param leeway Set leeway to use for issued at.
-		 * \return *this to allow chaining
+		 * Signature check of a token with a detached payload, get one from verify_detached.
+		 * Pass the payload to update() in as many pieces as it arrives in, for example the pages of a
+		 * memory mapped file or the buffers of a socket read, and call finish() once all of it is there.
+		 * The algorithms of this library hash the payload as it comes, others get it collected.
 		 */
-		verifier& issued_at_leeway(size_t leeway) { return with_claim("iat", claim(std::chrono::system_clock::from_time_t(leeway))); }
+		class detached_verification {
+			friend class verifier;
+			/// Reason verify_detached rejected the token, empty if the signature is still to be checked
+			std::error_code error;
+			std::string message;
+			std::unique_ptr<details::detached_input> input;
+			std::function<void(algorithm::digest_stream&, const std::string&, std::error_code&)> check;
+			std::string signature;
+
+			detached_verification() {}
+		public:
+			/**
+			 * Add the next part of the payload, ignored if the token was rejected already
+			 * \param data Payload bytes
+			 * \param size Length of data
+			 * \return *this to allow chaining
+			 */
+			detached_verification& update(const char* data, size_t size) {
+				if (input)
+					input->update(data, size);
+				return *this;
+			}
+#if JWT_HAS_STRING_VIEW
+			/// Add the next part of the payload
+			detached_verification& update(std::string_view data) { return update(data.data(), data.size()); }
+#else
+			/// Add the next part of the payload
+			detached_verification& update(const std::string& data) { return update(data.data(), data.size()); }
+#endif
+			/**
+			 * Add a chain of buffers
+			 * \param first Iterator to the first buffer, buffers provide data() and size()
+			 * \param last Iterator past the last buffer
+			 * \return *this to allow chaining
+			 */
+			template<typename Iterator>
+			detached_verification& update(Iterator first, Iterator last) {
+				for (; first != last; ++first)
+					update((const char*)first->data(), first->size());
+				return *this;
+			}
+			/**
+			 * Check the signature over the payload passed so far, the object can not be used afterwards
+			 * \throws signature_verification_exception If the signature does not match
+			 * \throws token_verification_exception If verify_detached rejected the token
+			 */
+			void finish() {
+				std::error_code ec;
+				finish(ec);
+				if (ec == failure::invalid_signature)
+					throw signature_verification_exception();
+				if (ec)
+					throw token_verification_exception(message);
+			}
+			/**
+			 * Check the signature over the payload passed so far without throwing
+			 * \param ec Receives the reason the token was rejected, cleared if it is valid
+			 */
+			void finish(std::error_code& ec) {
+				ec = error;
+				if (!input)
+					return;
+				check(input->finish(), signature, ec);
+				input.reset();
+				if (ec)
+					error = ec;
+				else
+					error = make_error_code(failure::invalid_signature);
+			}
+		};
 		/**
-		 * Set an issuer to check for.
-		 * Check is casesensitive.
-		 * \param iss Issuer to check for.
-		 * \return *this to allow chaining
+		 * Start checking a token with a detached payload (RFC 7515 appendix F), "header..signature".
+		 * The header is checked right away, so tokens with a wrong algorithm or unknown key id are rejected
+		 * before any of the payload is read. An unencoded payload (b64 false, RFC 7797) is signed as is,
+		 * otherwise in base64url. Size limits only apply to the token and the payload is not parsed,
+		 * so verifiers that require claims reject these tokens.
+		 * \param token Token with an empty payload part
+		 * \return Check to pass the payload to
+		 * \throws token_verification_exception The token is malformed or not accepted by this verifier
 		 */
-		verifier& with_issuer(const std::string& iss) { return with_claim("iss", claim(iss)); }
+		template<typename json_traits = picojson_traits>
+		detached_verification verify_detached(const std::string& token) const {
+			std::error_code ec;
+			detached_verification res = verify_detached<json_traits>(token, ec);
+			if (ec)
+				throw token_verification_exception(res.message);
+			return res;
+		}
 		/**
-		 * Set a subject to check for.
-		 * Check is casesensitive.
-		 * \param sub Subject to check for.
-		 * \return *this to allow chaining
+		 * Start checking a token with a detached payload without throwing, see verify_detached above
+		 * \param token Token with an empty payload part
+		 * \param ec Receives the reason if the token is rejected, finish() of the result reports it again
+		 * \return Check to pass the payload to
 		 */
-		verifier& with_subject(const std::string& sub) { return with_claim("sub", claim(sub)); }
+		template<typename json_traits = picojson_traits>
+		detached_verification verify_detached(const std::string& token, std::error_code& ec) const {
+			detached_verification res;
+			const std::string* claim_name = nullptr;
+			ec = start_detached<json_traits>(token, res, claim_name);
+			if (ec) {
+				res.error = ec;
+				res.message = describe(ec, claim_name);
+			}
+			return res;
+		}
+	private:
 		/**
-		 * Set an audience to check for.
-		 * If any of the specified audiences is not present in the token the check fails.
-		 * \param aud Audience to check for.
-		 * \return *this to allow chaining
+		 * Checks of verify_detached done before the payload is read
+		 * \param res Receives the stream and the signature check
 		 */
-		verifier& with_audience(const std::set<std::string>& aud) { return with_claim("aud", claim(aud)); }
+		template<typename json_traits>
+		std::error_code start_detached(const std::string& token, detached_verification& res, const std::string*& claim_name) const {
+			auto& observer = details::no_observer();
+			if (!checks.empty())
+				return reject_claim(observer, failure::missing_claim, checks.front().name, claim_name);
+			if (checks_id())
+				return reject_claim(observer, failure::missing_claim, registered_names::get().jti, claim_name);
+			const size_t header_end = token.find('.');
+			if (header_end == std::string::npos || token.compare(header_end, 2, "..") != 0 || token.find('.', header_end + 2) != std::string::npos)
+				return reject(observer, failure::malformed_token);
+			const size_t signature_size = token.size() - header_end - 2;
+			if ((max_token_size != 0 && token.size() > max_token_size)
+				|| (max_segment_size != 0 && std::max(header_end, signature_size) > max_segment_size))
+				return reject(observer, failure::token_too_large);
+			std::string header_json;
+			if (!base::try_decode_into<alphabet::base64url_unpadded>(token.substr(0, header_end), header_json)
+				|| !base::try_decode_into<alphabet::base64url_unpadded>(token.substr(header_end + 2), res.signature))
+				return reject(observer, failure::invalid_base64);
+			details::detached_header<json_traits> header;
+			if (!header.parse(header_json))
+				return reject(observer, failure::invalid_json);
+			payload_encoding encoding;
+			if (!header.payload_encoding_of(encoding))
+				return reject(observer, failure::malformed_token);
+
+			signature_job job;
+			std::error_code ec = resolve_algorithm(header, observer, job);
+			if (ec)
+				return ec;
+			algorithm::digest_stream stream = start_stream(job, res.check);
+			res.input.reset(new details::detached_input(std::move(stream), token.substr(0, header_end), encoding));
+			return std::error_code();
+		}
+
 		/**
-		 * Set an id to check for.
-		 * Check is casesensitive.
-		 * \param id ID to check for.
-		 * \return *this to allow chaining
+		 * Start hashing the data of a signature check for the algorithm or key found by resolve_algorithm
+		 * \param check Receives the function finishing the check, it keeps the algorithm or key alive
 		 */
-		verifier& with_id(const std::string& id) { return with_claim("jti", claim(id)); }
+		algorithm::digest_stream start_stream(const signature_job& job, std::function<void(algorithm::digest_stream&, const std::string&, std::error_code&)>& check) const {
+			if (job.key) {
+				std::shared_ptr<const key_set> snapshot = job.key_snapshot;
+				const key_set::key* key = job.key;
+				check = [snapshot, key](algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) {
+					key->check_stream(data, sig, ec);
+				};
+				return key->start();
+			}
+			std::unique_ptr<algorithm::digest_stream> listed;
+			if (listed_dispatch<0>::stream(*this, job.id, job.algo, listed, check))
+				return std::move(*listed);
+			std::shared_ptr<algo_base> alg;
+			if (job.id != algorithm_id::unknown)
+				alg = known_algs[static_cast<size_t>(job.id)];
+			else
+				alg = algs.find(job.algo)->second;
+			check = [alg](algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) {
+				alg->verify(data, sig, ec);
+			};
+			return alg->start();
+		}
+		/// Checks of verify_async done on the calling thread, job is left empty if nothing remains to be done
+		template<typename Token>
+		std::error_code start_async(const Token& jwt, std::shared_ptr<signature_job>& job) const {
+			auto& observer = details::no_observer();
+			std::error_code ec = check_size(jwt, observer);
+			if (ec)
+				return ec;
+			const date time = clock.now();
+			const std::string* claim_name = nullptr;
+			if ((ec = check_claims(jwt, observer, time, claim_name)))
+				return ec;
+			std::shared_ptr<signature_job> prepared = std::make_shared<signature_job>();
+			if ((ec = prepare_signature(jwt, observer, time, *prepared)) || (ec = read_id(jwt, observer, prepared->id_claim, claim_name)))
+				return ec;
+			if (prepared->cached)
+				return check_id(prepared->id_claim, time, observer, claim_name);
+			job = std::move(prepared);
+			return ec;
+		}
+		/// Checks of verify_async done on the executor
+		std::error_code finish_async(const signature_job& job) const {
+			std::error_code ec = check_signature(job, details::no_observer());
+			const std::string* claim_name = nullptr;
+			if (!ec)
+				ec = check_id(job.id_claim, job.time, details::no_observer(), claim_name);
+			return ec;
+		}
+
+		template<typename Decoded, typename TokenString, typename Observer>
+		void run_batch(const TokenString* tokens, size_t count, verify_result* results, thread_pool& pool, Observer& observer) const {
+			// Small ranges keep stealing effective when signature checks differ a lot in cost
+			size_t grain = count / (pool.concurrency() * 8);
+			grain = grain < 1 ? 1 : (grain > 64 ? 64 : grain);
+			pool.run(count, grain, [&](size_t begin, size_t end) {
+				// Tokens are checked in windows, so the HMAC signatures of a window are hashed together
+				const size_t window = details::sha256::lanes;
+				std::deque<Decoded> decoded;
+				const Decoded* jwts[window];
+				signature_job jobs[window];
+				date times[window];
+				const std::string* claim_names[window];
+				std::chrono::nanoseconds spent[window];
+				const algorithm::hmacsha* macs[window];
+				const std::string* data[window];
+				const std::string* signatures[window];
+				std::error_code codes[window];
+				size_t batched[window];
+				for (size_t first = begin; first < end; first += window) {
+					const size_t n = end - first < window ? end - first : window;
+					decoded.clear();
+					for (size_t i = 0; i < n; i++) {
+						verify_result& res = results[first + i];
+						res.code.clear();
+						jwts[i] = nullptr;
+						claim_names[i] = nullptr;
+						macs[i] = nullptr;
+						// Rejected tokens are common in a batch, so they are handled without exceptions
+						try {
+							if (max_token_size != 0 && tokens[first + i].size() > max_token_size) {
+								res.code = reject(observer, failure::token_too_large);
+								continue;
+							}
+							decoded.emplace_back(tokens[first + i], claim_parsing::eager, observer, res.code);
+							jwts[i] = &decoded.back();
+							if (!res.code)
+								res.code = check_size(*jwts[i], observer);
+							if (res.code)
+								continue;
+							times[i] = clock.now();
+							if (early_rejection && (res.code = check_claims(*jwts[i], observer, times[i], claim_names[i])))
+								continue;
+							const auto start = stage_clock<Observer>();
+							jobs[i] = signature_job();
+							res.code = prepare_signature(*jwts[i], observer, times[i], jobs[i]);
+							if (!res.code && !jobs[i].cached)
+								macs[i] = find_hmac(jobs[i]);
+							spent[i] = stage_clock<Observer>() - start;
+						}
+						catch (const std::exception& e) {
+							jwts[i] = nullptr;
+							res.code.clear();
+							res.error = e.what();
+						}
+					}
+
+					size_t hmacs = 0;
+					for (size_t i = 0; i < n; i++) {
+						verify_result& res = results[first + i];
+						if (jwts[i] == nullptr || res.code)
+							continue;
+						if (macs[i] != nullptr) {
+							data[hmacs] = &jobs[i].data;
+							signatures[hmacs] = &jobs[i].signature;
+							macs[hmacs] = macs[i];
+							batched[hmacs++] = i;
+							continue;
+						}
+						try {
+							const auto start = stage_clock<Observer>();
+							res.code = check_signature(jobs[i], observer);
+							spent[i] += stage_clock<Observer>() - start;
+						}
+						catch (const std::exception& e) {
+							jwts[i] = nullptr;
+							res.error = e.what();
+						}
+					}
+					if (hmacs != 0) {
+						const auto start = stage_clock<Observer>();
+						algorithm::hmacsha::verify_batch(macs, data, signatures, hmacs, codes);
+						const auto share = (stage_clock<Observer>() - start) / static_cast<int>(hmacs);
+						for (size_t j = 0; j < hmacs; j++) {
+							const size_t i = batched[j];
+							try {
+								results[first + i].code = finish_signature(jobs[i], codes[j], observer);
+								spent[i] += share;
+							}
+							catch (const std::exception& e) {
+								jwts[i] = nullptr;
+								results[first + i].error = e.what();
+							}
+						}
+					}
+
+					for (size_t i = 0; i < n; i++) {
+						verify_result& res = results[first + i];
+						if (jwts[i] == nullptr && !res.code) {
+							res.valid = false;
+							continue;
+						}
+						try {
+							if (!res.code) {
+								if (details::observer_enabled<Observer>::value)
+									observer.on_stage(stage::signature, spent[i]);
+								if (!early_rejection)
+									res.code = check_claims(*jwts[i], observer, times[i], claim_names[i]);
+								if (!res.code)
+									res.code = check_id(*jwts[i], observer, times[i], claim_names[i]);
+							}
+							res.valid = !res.code;
+							if (res.valid)
+								res.error.clear();
+							else
+								res.error = describe(res.code, claim_names[i]);
+						}
+						catch (const std::exception& e) {
+							res.valid = false;
+							res.code.clear();
+							res.error = e.what();
+						}
+					}
+				}
+			});
+		}
+
+		/// Time for stage reports, only read when the observer takes them
+		template<typename Observer>
+		static std::chrono::steady_clock::time_point stage_clock() {
+			return details::observer_enabled<Observer>::value ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+		}
+
+		template<typename Observer>
+		static std::error_code reject(Observer& observer, failure reason) {
+			observer.on_failure(reason);
+			return make_error_code(reason);
+		}
+		template<typename Observer>
+		static std::error_code reject_claim(Observer& observer, failure reason, const std::string& name, const std::string*& claim_name) {
+			claim_name = &name;
+			return reject(observer, reason);
+		}
+
+		/// Message of a failure as thrown by verify, naming the claim where there is one
+		static std::string describe(const std::error_code& ec, const std::string* claim_name) {
+			if (ec.category() != failure_category::get())
+				return ec.message();
+			switch (static_cast<failure>(ec.value())) {
+			case failure::not_yet_valid: return "token expired";
+			case failure::missing_claim: return "decoded_jwt is missing " + *claim_name + " claim";
+			case failure::claim_type_mismatch: return "claim " + *claim_name + " type mismatch";
+			case failure::claim_mismatch: return "claim " + *claim_name + " does not match expected";
+			case failure::unsupported_claim: return "internal error";
+			default: return ec.message();
+			}
+		}
+
+		template<typename Token, typename Observer>
+		void verify_token(const Token& jwt, Observer& observer) const {
+			const std::string* claim_name = nullptr;
+			const std::error_code ec = check_token(jwt, observer, claim_name);
+			if (!ec)
+				return;
+			if (ec == failure::invalid_signature)
+				throw signature_verification_exception();
+			throw token_verification_exception(describe(ec, claim_name));
+		}
+
 		/**
-		 * Specify a claim to check for.
-		 * \param name Name of the claim to check for
-		 * \param c Claim to check for
-		 * \return *this to allow chaining
+		 * Check a token without throwing for invalid ones
+		 * \param claim_name Receives the name of the claim a claim failure refers to
+		 * \return The reason the token was rejected, empty if it is valid
 		 */
-		verifier& with_claim(const std::string& name, claim c) { claims[name] = c; return *this; }
+		template<typename Token, typename Observer>
+		std::error_code check_token(const Token& jwt, Observer& observer, const std::string*& claim_name) const {
+			std::error_code ec = check_size(jwt, observer);
+			if (ec)
+				return ec;
+			const date time = clock.now();
+			if (early_rejection && (ec = check_claims(jwt, observer, time, claim_name)))
+				return ec;
+
+			details::stage_timer<Observer> signature_timer(observer, stage::signature);
+			signature_job job;
+			ec = prepare_signature(jwt, observer, time, job);
+			if (!ec)
+				ec = check_signature(job, observer);
+			if (ec)
+				return ec;
+			signature_timer.done();
+
+			if (!early_rejection && (ec = check_claims(jwt, observer, time, claim_name)))
+				return ec;
+			return check_id(jwt, observer, time, claim_name);
+		}
+
+		template<typename Token, typename Observer>
+		std::error_code check_size(const Token& jwt, Observer& observer) const {
+			if (max_token_size == 0 && max_segment_size == 0)
+				return std::error_code();
+			const size_t header_size = jwt.get_header_base64().size();
+			const size_t payload_size = jwt.get_payload_base64().size();
+			const size_t signature_size = jwt.get_signature_base64().size();
+			if ((max_token_size != 0 && header_size + payload_size + signature_size + 2 > max_token_size)
+				|| (max_segment_size != 0 && std::max(std::max(header_size, payload_size), signature_size) > max_segment_size))
+				return reject(observer, failure::token_too_large);
+			return std::error_code();
+		}
 
 		/**
-		 * Add an algorithm available for checking.
-		 * \param alg Algorithm to allow
-		 * \return *this to allow chaining
+		 * Look up the algorithm or key of a token and collect what its signature check needs
+		 * \param job Receives the signature check, which does not refer to the token
 		 */
+		template<typename Token, typename Observer>
+		std::error_code prepare_signature(const Token& jwt, Observer& observer, date time, signature_job& job) const {
+			const std::error_code ec = resolve_algorithm(jwt, observer, job);
+			if (ec)
+				return ec;
+
+			const auto& header_base64 = jwt.get_header_base64();
+			const auto& payload_base64 = jwt.get_payload_base64();
+			const auto& signature = jwt.get_signature();
+			job.data.reserve(header_base64.size() + 1 + payload_base64.size());
+			job.data.append(header_base64.data(), header_base64.size()).append(1, '.').append(payload_base64.data(), payload_base64.size());
+			job.time = time;
+			if (token_cache) {
+				job.cache_key = verified_token_cache::make_key(job.data.data(), job.data.size(), signature.data(), signature.size(), job.key ? &job.key->fingerprint : nullptr);
+				job.cached = token_cache->contains(job.cache_key, time);
+				job.expires = time + token_cache_max_age;
+				const std::string& exp = registered_names::get().exp;
+				if (jwt.has_payload_claim(exp)) {
+					const auto& c = jwt.get_payload_claim(exp);
+					if (c.get_type() == json::type::int64 && c.as_date() < job.expires)
+						job.expires = c.as_date();
+				}
+			}
+			if (!job.cached)
+				job.signature.assign(signature.data(), signature.size());
+			return std::error_code();
+		}
+
+		/// Find the algorithm or key for the alg and kid headers of a token
+		template<typename Header, typename Observer>
+		std::error_code resolve_algorithm(const Header& jwt, Observer& observer, signature_job& job) const {
+			if (!jwt.has_algorithm() || jwt.get_header_claim("alg").get_type() != json::type::string)
+				return reject(observer, failure::wrong_algorithm);
+			job.algo = jwt.get_algorithm();
+			observer.on_algorithm(job.algo);
+			if (keys && jwt.has_key_id()) {
+				if (jwt.get_header_claim("kid").get_type() != json::type::string)
+					return reject(observer, failure::unknown_key_id);
+				job.key_snapshot = keys->snapshot();
+				job.key = job.key_snapshot->find(jwt.get_key_id());
+				if (job.key == nullptr)
+					return reject(observer, failure::unknown_key_id);
+				if (job.key->alg != job.algo)
+					return reject(observer, failure::wrong_algorithm);
+			}
+			std::error_code ec;
+			job.id = parse_algorithm_id(job.algo);
+			if (!job.key && !verify_signature(job.id, job.algo, nullptr, nullptr, ec))
+				return reject(observer, failure::wrong_algorithm);
+			return std::error_code();
+		}
+
+		/// Run a signature check prepared by prepare_signature and remember the token if it passed
+		template<typename Observer>
+		std::error_code check_signature(const signature_job& job, Observer& observer) const {
+			if (job.cached)
+				return std::error_code();
+			std::error_code ec;
+			if (job.key)
+				job.key->verify(job.data, job.signature, ec);
+			else
+				verify_signature(job.id, job.algo, &job.data, &job.signature, ec);
+			return finish_signature(job, ec, observer);
+		}
+		/// Report the outcome of a signature check and remember the token if it passed
+		template<typename Observer>
+		std::error_code finish_signature(const signature_job& job, const std::error_code& ec, Observer& observer) const {
+			if (ec)
+				return reject(observer, failure::invalid_signature);
+			if (token_cache)
+				token_cache->insert(job.cache_key, job.expires, job.time);
+			return std::error_code();
+		}
+
+		/// Check exp, nbf, iat and the required claims
+		template<typename Token, typename Observer>
+		std::error_code check_claims(const Token& jwt, Observer& observer, date time, const std::string*& claim_name) const {
+			details::stage_timer<Observer> claims_timer(observer, stage::claims);
+			const registered_names& names = registered_names::get();
+			if (jwt.has_payload_claim(names.exp)) {
+				const auto& exp = jwt.get_payload_claim(names.exp);
+				if (exp.get_type() != json::type::int64)
+					return reject_claim(observer, failure::claim_type_mismatch, names.exp, claim_name);
+				if (time > exp.as_date() + exp_leeway)
+					return reject(observer, failure::expired);
+			}
+			if (jwt.has_payload_claim(names.iat)) {
+				const auto& iat = jwt.get_payload_claim(names.iat);
+				if (iat.get_type() != json::type::int64)
+					return reject_claim(observer, failure::claim_type_mismatch, names.iat, claim_name);
+				if (time < iat.as_date() - iat_leeway)
+					return reject(observer, failure::not_yet_valid);
+			}
+			if (jwt.has_payload_claim(names.nbf)) {
+				const auto& nbf = jwt.get_payload_claim(names.nbf);
+				if (nbf.get_type() != json::type::int64)
+					return reject_claim(observer, failure::claim_type_mismatch, names.nbf, claim_name);
+				if (time < nbf.as_date() - nbf_leeway)
+					return reject(observer, failure::not_yet_valid);
+			}
+			for (auto& check : checks) {
+				if (check.type == claim_check::kind::audience) {
+					if (!jwt.has_payload_claim(check.name))
+						return reject(observer, failure::audience_mismatch);
+					auto& aud = jwt.get_payload_claim(check.name);
+					bool found = false;
+					if (aud.get_type() == json::type::string)
+						found = check.values.size() == 0 || (check.values.size() == 1 && check.values.count(aud.as_string()) == 1);
+					else if (aud.get_type() == json::type::array)
+						found = match_values<typename Token::traits_type>(aud.as_array(), check.values, false);
+					if (!found)
+						return reject(observer, failure::audience_mismatch);
+					continue;
+				}
+
+				if (!jwt.has_payload_claim(check.name))
+					return reject_claim(observer, failure::missing_claim, check.name, claim_name);
+				auto& jc = jwt.get_payload_claim(check.name);
+				if (jc.get_type() != check.expected.get_type())
+					return reject_claim(observer, failure::claim_type_mismatch, check.name, claim_name);
+				bool matches;
+				switch (check.type) {
+				case claim_check::kind::int64: matches = jc.as_int() == check.expected.as_int(); break;
+				case claim_check::kind::string: matches = jc.as_string() == check.expected.as_string(); break;
+				case claim_check::kind::array: matches = match_values<typename Token::traits_type>(jc.as_array(), check.values, true); break;
+				default: return reject_claim(observer, failure::unsupported_claim, check.name, claim_name);
+				}
+				if (!matches)
+					return reject_claim(observer, failure::claim_mismatch, check.name, claim_name);
+			}
+			claims_timer.done();
+			return std::error_code();
+		}
+
+		/// Whether the jti claim is checked
+		bool checks_id() const { return revoked_ids || revocation_check || used_ids; }
+		/// Read the jti claim and the time its entry may be forgotten, if the verifier checks it
+		template<typename Token, typename Observer>
+		std::error_code read_id(const Token& jwt, Observer& observer, token_id& id, const std::string*& claim_name) const {
+			if (!checks_id())
+				return std::error_code();
+			const registered_names& names = registered_names::get();
+			if (jwt.has_payload_claim(names.jti)) {
+				const auto& jti = jwt.get_payload_claim(names.jti);
+				if (jti.get_type() != json::type::string)
+					return reject_claim(observer, failure::claim_type_mismatch, names.jti, claim_name);
+				id.present = true;
+				id.value = jti.as_string();
+			}
+			// check_claims accepted the type of exp already, the token stays valid for the leeway
+			if (jwt.has_payload_claim(names.exp))
+				id.expires = jwt.get_payload_claim(names.exp).as_date() + exp_leeway;
+			return std::error_code();
+		}
+		/// Check the jti claim after the signature and all other claims passed
+		template<typename Token, typename Observer>
+		std::error_code check_id(const Token& jwt, Observer& observer, date time, const std::string*& claim_name) const {
+			if (!checks_id())
+				return std::error_code();
+			token_id id;
+			const std::error_code ec = read_id(jwt, observer, id, claim_name);
+			if (ec)
+				return ec;
+			return check_id(id, time, observer, claim_name);
+		}
+		template<typename Observer>
+		std::error_code check_id(const token_id& id, date time, Observer& observer, const std::string*& claim_name) const {
+			if (!id.present) {
+				if (used_ids)
+					return reject_claim(observer, failure::missing_claim, registered_names::get().jti, claim_name);
+				return std::error_code();
+			}
+			if (revoked_ids && revoked_ids->contains(id.value, time))
+				return reject(observer, failure::token_revoked);
+			if (revocation_check && revocation_check(id.value, id.expires))
+				return reject(observer, failure::token_revoked);
+			if (!used_ids)
+				return std::error_code();
+			const registered_names& names = registered_names::get();
+			if (id.expires == date::max())
+				return reject_claim(observer, failure::missing_claim, names.exp, claim_name);
+			if (!used_ids->covers(id.expires, time))
+				return reject_claim(observer, failure::claim_mismatch, names.exp, claim_name);
+			if (!used_ids->use(id.value, id.expires, time))
+				return reject(observer, failure::token_replayed);
+			return std::error_code();
+		}
+
 		template<typename Algorithm>
-		verifier& allow_algorithm(Algorithm alg) {
-			algs[alg.name()] = std::make_shared<algo<Algorithm>>(alg);
-			return *this;
+		void store_algorithm(Algorithm alg, std::true_type) {
+			std::get<details::type_index<Algorithm, Algorithms...>::value>(listed_algs) = std::make_shared<Algorithm>(std::move(alg));
+		}
+		template<typename Algorithm>
+		void store_algorithm(Algorithm alg, std::false_type) {
+			const algorithm_id id = parse_algorithm_id(alg.name());
+			if (id != algorithm_id::unknown)
+				known_algs[static_cast<size_t>(id)] = std::make_shared<algo<Algorithm>>(alg);
+			else
+				algs[alg.name()] = std::make_shared<algo<Algorithm>>(alg);
 		}
 
-		/**
-		 * Verify the given token.
-		 * \param jwt Token to check
-		 * \throws token_verification_exception Verification failed
-		 */
-		void verify(const decoded_jwt& jwt) const {
-			const std::string data = jwt.get_header_base64() + "." + jwt.get_payload_base64();
-			const std::string sig = jwt.get_signature();
-			const std::string& algo = jwt.get_algorithm();
-			if (algs.count(algo) == 0)
-				throw token_verification_exception("wrong algorithm");
-			algs.at(algo)->verify(data, sig);
-
-			auto assert_claim_eq = [](const decoded_jwt& jwt, const std::string& key, const claim& c) {
-				if (!jwt.has_payload_claim(key))
-					throw token_verification_exception("decoded_jwt is missing " + key + " claim");
-				auto& jc = jwt.get_payload_claim(key);
-				if (jc.get_type() != c.get_type())
-					throw token_verification_exception("claim " + key + " type mismatch");
-				if (c.get_type() == claim::type::int64) {
-					if (c.as_date() != jc.as_date())
-						throw token_verification_exception("claim " + key + " does not match expected");
-				}
-				else if (c.get_type() == claim::type::array) {
-					auto s1 = c.as_set();
-					auto s2 = jc.as_set();
-					if (s1.size() != s2.size())
-						throw token_verification_exception("claim " + key + " does not match expected");
-					auto it1 = s1.cbegin();
-					auto it2 = s2.cbegin();
-					while (it1 != s1.cend() && it2 != s2.cend()) {
-						if (*it1++ != *it2++)
-							throw token_verification_exception("claim " + key + " does not match expected");
-					}
+		/// Checks the listed algorithms, starting at index I
+		template<size_t I, bool End = (I == sizeof...(Algorithms))>
+		struct listed_dispatch {
+			static bool verify(const verifier& v, algorithm_id id, const std::string& name, const std::string* data, const std::string* sig, std::error_code& ec) {
+				typedef typename std::tuple_element<I, std::tuple<Algorithms...>>::type algorithm_type;
+				const auto& alg = std::get<I>(v.listed_algs);
+				const algorithm_id listed_id = details::algorithm_id_of<algorithm_type>::value;
+				if (alg && (listed_id == algorithm_id::unknown ? alg->name() == name : listed_id == id)) {
+					if (data != nullptr)
+						details::signature_checker<algorithm_type>::verify(*alg, *data, *sig, ec);
+					return true;
+				}
+				return listed_dispatch<I + 1>::verify(v, id, name, data, sig, ec);
+			}
+			/// Find the listed algorithm for a token, setting mac if it is an HMAC
+			static bool hmac(const verifier& v, algorithm_id id, const std::string& name, const algorithm::hmacsha*& mac) {
+				typedef typename std::tuple_element<I, std::tuple<Algorithms...>>::type algorithm_type;
+				const auto& alg = std::get<I>(v.listed_algs);
+				const algorithm_id listed_id = details::algorithm_id_of<algorithm_type>::value;
+				if (alg && (listed_id == algorithm_id::unknown ? alg->name() == name : listed_id == id)) {
+					mac = details::hmac_of(*alg);
+					return true;
 				}
-				else if (c.get_type() == claim::type::string) {
-					if (c.as_string() != jc.as_string())
-						throw token_verification_exception("claim " + key + " does not match expected");
+				return listed_dispatch<I + 1>::hmac(v, id, name, mac);
+			}
+			/// Start a streamed signature check with the listed algorithm for a token
+			static bool stream(const verifier& v, algorithm_id id, const std::string& name, std::unique_ptr<algorithm::digest_stream>& stream,
+				std::function<void(algorithm::digest_stream&, const std::string&, std::error_code&)>& check) {
+				typedef typename std::tuple_element<I, std::tuple<Algorithms...>>::type algorithm_type;
+				const std::shared_ptr<algorithm_type> alg = std::get<I>(v.listed_algs);
+				const algorithm_id listed_id = details::algorithm_id_of<algorithm_type>::value;
+				if (alg && (listed_id == algorithm_id::unknown ? alg->name() == name : listed_id == id)) {
+					stream.reset(new algorithm::digest_stream(details::stream_checker<algorithm_type>::start(*alg)));
+					check = [alg](algorithm::digest_stream& data, const std::string& sig, std::error_code& ec) {
+						details::stream_checker<algorithm_type>::verify(*alg, data, sig, ec);
+					};
+					return true;
 				}
-				else throw token_verification_exception("internal error");
-			};
+				return listed_dispatch<I + 1>::stream(v, id, name, stream, check);
+			}
+		};
+		template<size_t I>
+		struct listed_dispatch<I, true> {
+			static bool verify(const verifier&, algorithm_id, const std::string&, const std::string*, const std::string*, std::error_code&) {
+				return false;
+			}
+			static bool hmac(const verifier&, algorithm_id, const std::string&, const algorithm::hmacsha*&) {
+				return false;
+			}
+			static bool stream(const verifier&, algorithm_id, const std::string&, std::unique_ptr<algorithm::digest_stream>&,
+				std::function<void(algorithm::digest_stream&, const std::string&, std::error_code&)>&) {
+				return false;
+			}
+		};
+
+		/// The HMAC algorithm a prepared signature check uses, nullptr if it uses another algorithm
+		const algorithm::hmacsha* find_hmac(const signature_job& job) const {
+			if (job.key)
+				return job.key->mac.get();
+			const algorithm::hmacsha* mac = nullptr;
+			if (listed_dispatch<0>::hmac(*this, job.id, job.algo, mac))
+				return mac;
+			const algo_base* alg = nullptr;
+			if (job.id != algorithm_id::unknown)
+				alg = known_algs[static_cast<size_t>(job.id)].get();
+			else {
+				auto it = algs.find(job.algo);
+				if (it != algs.end())
+					alg = it->second.get();
+			}
+			return alg ? alg->hmac() : nullptr;
+		}
 
-			auto time = clock.now();
+		/**
+		 * Find the algorithm for a token and check its signature
+		 * \param data Signed data or nullptr to only check whether the algorithm is allowed
+		 * \param ec Set to failure::invalid_signature if the signature does not match
+		 * \return Whether the algorithm is allowed
+		 */
+		bool verify_signature(algorithm_id id, const std::string& name, const std::string* data, const std::string* sig, std::error_code& ec) const {
+			if (listed_dispatch<0>::verify(*this, id, name, data, sig, ec))
+				return true;
+			algo_base* alg = nullptr;
+			if (id != algorithm_id::unknown)
+				alg = known_algs[static_cast<size_t>(id)].get();
+			else {
+				auto it = algs.find(name);
+				if (it != algs.end())
+					alg = it->second.get();
+			}
+			if (alg == nullptr)
+				return false;
+			if (data != nullptr)
+				alg->verify(*data, *sig, ec);
+			return true;
+		}
 
-			if (jwt.has_expires_at()) {
-				auto leeway = claims.count("exp") == 1 ? std::chrono::system_clock::to_time_t(claims.at("exp").as_date()) : default_leeway;
-				auto exp = jwt.get_expires_at();
-				if (time > exp + std::chrono::seconds(leeway))
-					throw token_verification_exception("token expired");
+		/**
+		 * Compile a required claim into a check
+		 * \throws std::bad_cast The claim cannot be used for this check
+		 */
+		static claim_check compile_check(const std::string& name, const claim& c) {
+			claim_check check;
+			check.name = name;
+			check.expected = c;
+			if (name == "aud") {
+				check.type = claim_check::kind::audience;
+				if (c.get_type() == claim::type::string)
+					check.values.emplace(c.as_string(), 0);
+				else
+					add_values(check, c.as_array());
 			}
-			if (jwt.has_issued_at()) {
-				auto leeway = claims.count("iat") == 1 ? std::chrono::system_clock::to_time_t(claims.at("iat").as_date()) : default_leeway;
-				auto iat = jwt.get_issued_at();
-				if (time < iat - std::chrono::seconds(leeway))
-					throw token_verification_exception("token expired");
+			else if (c.get_type() == claim::type::int64)
+				check.type = claim_check::kind::int64;
+			else if (c.get_type() == claim::type::string)
+				check.type = claim_check::kind::string;
+			else if (c.get_type() == claim::type::array) {
+				check.type = claim_check::kind::array;
+				add_values(check, c.as_array());
 			}
-			if (jwt.has_not_before()) {
-				auto leeway = claims.count("nbf") == 1 ? std::chrono::system_clock::to_time_t(claims.at("nbf").as_date()) : default_leeway;
-				auto nbf = jwt.get_not_before();
-				if (time < nbf - std::chrono::seconds(leeway))
-					throw token_verification_exception("token expired");
+			else
+				check.type = claim_check::kind::unsupported;
+			return check;
+		}
+
+		static void add_values(claim_check& check, const picojson::array& values) {
+			for (auto& e : values) {
+				if (!e.is<std::string>())
+					throw std::bad_cast();
+				check.values.emplace(e.get<std::string>(), check.values.size());
 			}
-			for (auto& c : claims)
-			{
-				if (c.first == "exp" || c.first == "iat" || c.first == "nbf") {
-					// Nothing to do here, already checked
-				}
-				else if (c.first == "aud") {
-					if (!jwt.has_audience())
-						throw token_verification_exception("token doesn't contain the required audience");
-					auto aud = jwt.get_audience();
-					auto expected = c.second.as_set();
-					for (auto& e : expected)
-						if (aud.count(e) == 0)
-							throw token_verification_exception("token doesn't contain the required audience");
+		}
+
+		/**
+		 * Rebuild the check plan from the required claims
+		 */
+		void compile() {
+			auto leeway_of = [this](const char* name) {
+				auto it = claims.find(name);
+				return std::chrono::seconds(it == claims.end() ? default_leeway : std::chrono::system_clock::to_time_t(it->second.as_date()));
+			};
+			exp_leeway = leeway_of("exp");
+			nbf_leeway = leeway_of("nbf");
+			iat_leeway = leeway_of("iat");
+			checks.clear();
+			for (auto& c : claims) {
+				if (c.first != "exp" && c.first != "nbf" && c.first != "iat")
+					checks.push_back(compile_check(c.first, c.second));
+			}
+		}
+
+		/**
+		 * Check the string values of a json array against the expected ones
+		 * \param exact Whether every value must be expected, otherwise other values are ignored
+		 * \return Whether all expected values were found
+		 */
+		template<typename json_traits>
+		static bool match_values(const typename json_traits::array_type& arr, const std::unordered_map<std::string, size_t>& values, bool exact) {
+			uint64_t found_small = 0;
+			std::vector<bool> found_large(values.size() > 64 ? values.size() : 0);
+			size_t found = 0;
+			for (auto& e : arr) {
+				auto it = json_traits::get_type(e) == json::type::string ? values.find(json_traits::as_string(e)) : values.end();
+				if (it == values.end()) {
+					if (exact)
+						return false;
+					continue;
 				}
-				else {
-					assert_claim_eq(jwt, c.first, c.second);
+				if (values.size() <= 64) {
+					const uint64_t bit = uint64_t(1) << it->second;
+					if ((found_small & bit) == 0) {
+						found_small |= bit;
+						found++;
+					}
+				}
+				else if (!found_large[it->second]) {
+					found_large[it->second] = true;
+					found++;
 				}
 			}
+			return found == values.size();
 		}
 	};
 
@@ -1568,6 +8141,25 @@ namespace jwt {
 		return verify<default_clock>({});
 	}
 
+	/**
+	 * Create a verifier with a closed set of algorithm types dispatched without virtual calls
+	 * \param c Clock instance to use
+	 * \return verifier instance
+	 */
+	template<typename... Algorithms, typename Clock>
+	verifier<Clock, Algorithms...> verify_with(Clock c) {
+		return verifier<Clock, Algorithms...>(c);
+	}
+
+	/**
+	 * Create a verifier with a closed set of algorithm types dispatched without virtual calls, using the default clock
+	 * \return verifier instance
+	 */
+	template<typename... Algorithms>
+	verifier<default_clock, Algorithms...> verify_with() {
+		return verifier<default_clock, Algorithms...>(default_clock{});
+	}
+
 	/**
 	 * Return a builder instance to create a new token
 	 */
@@ -1579,12 +8171,151 @@ namespace jwt {
 	/**
 	 * Decode a token
 	 * \param token Token to decode
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \return Decoded token
+	 * \throws std::invalid_argument Token is not in correct format
+	 * \throws std::runtime_error Base64 decoding failed or invalid json
+	 */
+    inline
+	decoded_jwt decode(const std::string& token, claim_parsing mode = claim_parsing::eager) {
+		return decoded_jwt(token, mode);
+	}
+	/**
+	 * Decode a token, taking over its storage instead of copying it
+	 * \param token Token to decode
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \return Decoded token
+	 * \throws std::invalid_argument Token is not in correct format
+	 * \throws std::runtime_error Base64 decoding failed or invalid json
+	 */
+	inline
+	decoded_jwt decode(std::string&& token, claim_parsing mode = claim_parsing::eager) {
+		return decoded_jwt(std::move(token), mode);
+	}
+	/**
+	 * Decode a token, reporting sizes, stage timings and failures to an observer
+	 * \param token Token to decode
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \param observer Observer to report to, see null_observer
+	 * \return Decoded token
+	 * \throws std::invalid_argument Token is not in correct format
+	 * \throws std::runtime_error Base64 decoding failed or invalid json
+	 */
+	template<typename Observer>
+	decoded_jwt decode(const std::string& token, claim_parsing mode, Observer& observer) {
+		return decoded_jwt(token, mode, observer);
+	}
+	/**
+	 * Decode a token without throwing if it is invalid
+	 * \param token Token to decode
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \param ec Receives the reason if the token is invalid, the returned object must not be used then
+	 * \return Decoded token
+	 * \throws std::bad_alloc
+	 */
+	inline
+	decoded_jwt decode(const std::string& token, claim_parsing mode, std::error_code& ec) {
+		return decoded_jwt(token, mode, ec);
+	}
+	/**
+	 * Decode a token without throwing if it is invalid, taking over its storage instead of copying it
+	 * \param token Token to decode
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \param ec Receives the reason if the token is invalid, the returned object must not be used then
+	 * \return Decoded token
+	 * \throws std::bad_alloc
+	 */
+	inline
+	decoded_jwt decode(std::string&& token, claim_parsing mode, std::error_code& ec) {
+		return decoded_jwt(std::move(token), mode, ec);
+	}
+	/**
+	 * Decode a token without throwing if it is invalid
+	 * \param token Token to decode
+	 * \param ec Receives the reason if the token is invalid, the returned object must not be used then
+	 * \return Decoded token
+	 * \throws std::bad_alloc
+	 */
+	inline
+	decoded_jwt decode(const std::string& token, std::error_code& ec) {
+		return decoded_jwt(token, claim_parsing::eager, ec);
+	}
+	/**
+	 * Decode a token without throwing if it is invalid, taking over its storage instead of copying it
+	 * \param token Token to decode
+	 * \param ec Receives the reason if the token is invalid, the returned object must not be used then
 	 * \return Decoded token
+	 * \throws std::bad_alloc
+	 */
+	inline
+	decoded_jwt decode(std::string&& token, std::error_code& ec) {
+		return decoded_jwt(std::move(token), claim_parsing::eager, ec);
+	}
+#if JWT_HAS_STRING_VIEW
+	/**
+	 * Decode a token without copying it
+	 * \param token Token to decode, must outlive the returned object
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \return Decoded token referencing the given buffer
 	 * \throws std::invalid_argument Token is not in correct format
 	 * \throws std::runtime_error Base64 decoding failed or invalid json
 	 */
     inline
-	decoded_jwt decode(const std::string& token) {
-		return decoded_jwt(token);
+	decoded_jwt_view decode_view(std::string_view token, claim_parsing mode = claim_parsing::eager) {
+		return decoded_jwt_view(token, mode);
+	}
+	/**
+	 * Decode a token without copying it, reporting sizes, stage timings and failures to an observer
+	 * \param token Token to decode, must outlive the returned object
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \param observer Observer to report to, see null_observer
+	 * \return Decoded token referencing the given buffer
+	 * \throws std::invalid_argument Token is not in correct format
+	 * \throws std::runtime_error Base64 decoding failed or invalid json
+	 */
+	template<typename Observer>
+	decoded_jwt_view decode_view(std::string_view token, claim_parsing mode, Observer& observer) {
+		return decoded_jwt_view(token, mode, observer);
+	}
+	/**
+	 * Decode a token without copying it and without throwing if it is invalid
+	 * \param token Token to decode, must outlive the returned object
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \param ec Receives the reason if the token is invalid, the returned object must not be used then
+	 * \return Decoded token referencing the given buffer
+	 * \throws std::bad_alloc
+	 */
+	inline
+	decoded_jwt_view decode_view(std::string_view token, claim_parsing mode, std::error_code& ec) {
+		return decoded_jwt_view(token, mode, ec);
+	}
+	/**
+	 * Decode a token without copying it and without throwing if it is invalid
+	 * \param token Token to decode, must outlive the returned object
+	 * \param ec Receives the reason if the token is invalid, the returned object must not be used then
+	 * \return Decoded token referencing the given buffer
+	 * \throws std::bad_alloc
+	 */
+	inline
+	decoded_jwt_view decode_view(std::string_view token, std::error_code& ec) {
+		return decoded_jwt_view(token, claim_parsing::eager, ec);
+	}
+#endif
+#if JWT_HAS_MEMORY_RESOURCE
+	/**
+	 * Decode a token without copying it, allocating the decoded storage from a memory resource.
+	 * Meant for request scoped arenas such as std::pmr::monotonic_buffer_resource, which release
+	 * everything the token allocated at once.
+	 * \param token Token to decode, must outlive the returned object
+	 * \param resource Memory resource for the decoded storage, must outlive the returned object
+	 * \param mode Whether to parse the payload claims now or on first access
+	 * \return Decoded token referencing the given buffer
+	 * \throws std::invalid_argument Token is not in correct format
+	 * \throws std::runtime_error Base64 decoding failed or invalid json
+	 */
+	inline
+	decoded_jwt_view decode_view(std::string_view token, std::pmr::memory_resource* resource, claim_parsing mode = claim_parsing::eager) {
+		return decoded_jwt_view(token, resource, mode);
 	}
+#endif
 }